@@ -86,6 +86,10 @@ def export_joints_meta_data(data, armature):
     # We'll return this to remember our order when exporting matrices for each sample.
     joint_names = [] 
     
+    # Joint ids are per animation file, start counting from zero again.
+    global num_joints
+    num_joints = 0
+    
     # Search for root candidates (deform joints that have no parents)
     bones = armature.pose.bones
     root_candidates = [b for b in bones if not b.parent and b.bone.use_deform == True]
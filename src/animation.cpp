@@ -1,4 +1,15 @@
 
+#if ARCH_X64 || ARCH_X86
+#include <immintrin.h>
+#define POSE_SAMPLING_SIMD 1
+#define SKINNING_SIMD      1
+#else
+#define POSE_SAMPLING_SIMD 0
+#define SKINNING_SIMD      0
+#endif
+
+#define SKINNING_JOB_BATCH_SIZE 256 // In blocks of SKINNING_BLOCK_SIZE vertices.
+
 FUNCTION void print_sqts(Array<SQT> transforms)
 {
     debug_print("{ ");
@@ -8,45 +19,759 @@ FUNCTION void print_sqts(Array<SQT> transforms)
     debug_print("} \n\n");
 }
 
+//~ Pose Samples
+//
+FUNCTION Pose_Sample get_pose_sample(Sampled_Animation *anim, s32 sample_index)
+{
+    s64 offset = (s64)sample_index * anim->joints.count;
+    
+    Pose_Sample result  = {};
+    result.rotations    = anim->rotations    + offset;
+    result.translations = anim->translations + offset;
+    result.scales       = anim->scales       + offset;
+    return result;
+}
+
+FUNCTION Pose_Sample push_pose_sample(Arena *arena, s32 num_joints)
+{
+    Pose_Sample result  = {};
+    result.rotations    = (Quaternion *) arena_push(arena, num_joints * sizeof(Quaternion), SAMPLE_STREAM_ALIGNMENT);
+    result.translations = (V3 *)         arena_push(arena, num_joints * sizeof(V3),         SAMPLE_STREAM_ALIGNMENT);
+    result.scales       = (f32 *)        arena_push(arena, num_joints * sizeof(f32),        SAMPLE_STREAM_ALIGNMENT);
+    return result;
+}
+
+FUNCTION void copy_pose_sample(Pose_Sample dst, Pose_Sample src, s32 num_joints)
+{
+    MEMORY_COPY(dst.rotations,    src.rotations,    num_joints * sizeof(Quaternion));
+    MEMORY_COPY(dst.translations, src.translations, num_joints * sizeof(V3));
+    MEMORY_COPY(dst.scales,       src.scales,       num_joints * sizeof(f32));
+}
+
+FUNCTION inline Quaternion nlerp_short_path(Quaternion a, f32 t, Quaternion b)
+{
+    // Sampled and dequantized keys can be on either side of the sphere, so every rotation lerp of clip
+    // data goes through here (or does the same thing, like the SSE kernel in lerp_pose_samples()).
+    if (dot(a, b) < 0.0f) b = -b;
+    return nlerp(a, t, b);
+}
+
+//~ Animation Compression
+//
+#define SMALLEST_THREE_BITS 15
+#define SMALLEST_THREE_MAX  ((1 << SMALLEST_THREE_BITS) - 1)
+#define SMALLEST_THREE_MASK ((1ULL << SMALLEST_THREE_BITS) - 1)
+
+// The three smallest components of a unit quaternion are in range [-1/sqrt(2), 1/sqrt(2)].
+GLOBAL f32 const SMALLEST_THREE_RANGE = 0.70710678f;
+
+FUNCTION Quantized_Quaternion quantize_quaternion(Quaternion q)
+{
+    // Find the largest component; we drop it and reconstruct it from the other three.
+    s32 largest = 0;
+    for (s32 i = 1; i < 4; i++) {
+        if (ABS(q.I[i]) > ABS(q.I[largest]))
+            largest = i;
+    }
+    
+    // q and -q are the same rotation, so make the dropped component positive.
+    if (q.I[largest] < 0)
+        q = -q;
+    
+    u64 bits = (u64)largest;
+    for (s32 i = 0; i < 4; i++) {
+        if (i == largest) continue;
+        
+        f32 normalized = CLAMP01((q.I[i] + SMALLEST_THREE_RANGE) / (2.0f * SMALLEST_THREE_RANGE));
+        u64 quantized  = (u64)(normalized * SMALLEST_THREE_MAX + 0.5f);
+        bits           = (bits << SMALLEST_THREE_BITS) | quantized;
+    }
+    
+    Quantized_Quaternion result;
+    result.I[0] = (u16)(bits >> 32);
+    result.I[1] = (u16)(bits >> 16);
+    result.I[2] = (u16)(bits >>  0);
+    return result;
+}
+
+FUNCTION Quaternion dequantize_quaternion(Quantized_Quaternion qq)
+{
+    u64 bits    = ((u64)qq.I[0] << 32) | ((u64)qq.I[1] << 16) | (u64)qq.I[2];
+    s32 largest = (s32)((bits >> (3*SMALLEST_THREE_BITS)) & 3);
+    
+    Quaternion result = {};
+    f32 sum2  = 0.0f;
+    s32 shift = 2*SMALLEST_THREE_BITS;
+    for (s32 i = 0; i < 4; i++) {
+        if (i == largest) continue;
+        
+        f32 normalized = (f32)((bits >> shift) & SMALLEST_THREE_MASK) / (f32)SMALLEST_THREE_MAX;
+        result.I[i]    = normalized * (2.0f * SMALLEST_THREE_RANGE) - SMALLEST_THREE_RANGE;
+        sum2          += SQUARE(result.I[i]);
+        shift         -= SMALLEST_THREE_BITS;
+    }
+    result.I[largest] = _sqrt(CLAMP_LOWER(1.0f - sum2, 0.0f));
+    
+    return result;
+}
+
+FUNCTION inline u16 quantize_unorm16(f32 value, f32 min, f32 extent)
+{
+    f32 normalized = CLAMP01(safe_div0(value - min, extent));
+    u16 result     = (u16)(normalized * U16_MAX + 0.5f);
+    return result;
+}
+
+FUNCTION inline f32 dequantize_unorm16(u16 value, f32 min, f32 extent)
+{
+    f32 result = min + extent * ((f32)value / (f32)U16_MAX);
+    return result;
+}
+
+struct Keyframe_Reducer
+{
+    // @Note: Model space transforms are SQTs too; scales are uniform, so they compose like local ones.
+    // All arrays are per sample, then per joint.
+    
+    Sampled_Animation *anim;
+    Quaternion *rotation_keys; // The sample rotations as they come out of quantization.
+    SQT *exact;         // Model space, from the samples.
+    SQT *reduced;       // Model space, from reduced_local, for the joints reduced so far.
+    SQT *reduced_local; // Tracks as playback will see them: reduced ones, constant ones from the first sample.
+};
+
+FUNCTION inline SQT concatenate_sqt(SQT parent, SQT local)
+{
+    SQT result;
+    result.rotation    = parent.rotation * local.rotation;
+    result.translation = parent.translation + parent.rotation * (local.translation * parent.scale);
+    result.scale       = parent.scale * local.scale;
+    return result;
+}
+
+FUNCTION f32 get_rotation_distance(Quaternion a, Quaternion b)
+{
+    // How far apart the rotations put a point at distance 1, 2*sin(theta/2). Going by the distance c 
+    // between the unit quaternions, which is 2*sin(theta/4): sqrt(1 - dot^2) has no precision left in f32
+    // for angles around the keyframe tolerances.
+    
+    f32 c = MIN(length(a - b), length(a + b));
+    return 2.0f * c * _sqrt(CLAMP_LOWER(1.0f - 0.25f*c*c, 0.0f));
+}
+
+FUNCTION f32 get_model_space_error(SQT a, SQT b, f32 radius)
+{
+    // Bound on how far apart a and b put a point within radius of the joint.
+    
+    f32 rotation = get_rotation_distance(a.rotation, b.rotation);
+    return length(a.translation - b.translation) + radius*(ABS(a.scale - b.scale) + b.scale*rotation);
+}
+
+FUNCTION void lerp_track_sample(Keyframe_Reducer *r, Track_Kind kind, s32 joint_index, s32 k0, s32 k1, s32 sample_index, SQT *out)
+{
+    // What playback gives the track at sample_index, between keys at samples k0 and k1. Rotations are 
+    // interpolated the way sample_compressed_clip() does it.
+    
+    Pose_Sample a = get_pose_sample(r->anim, k0);
+    Pose_Sample b = get_pose_sample(r->anim, k1);
+    f32 t         = (k1 > k0)? (f32)(sample_index - k0) / (f32)(k1 - k0) : 0.0f;
+    
+    switch (kind) {
+        case TrackKind_ROTATION: {
+            s32 num_joints = (s32)r->anim->joints.count;
+            Quaternion qa  = r->rotation_keys[(s64)k0*num_joints + joint_index];
+            Quaternion qb  = r->rotation_keys[(s64)k1*num_joints + joint_index];
+            out->rotation  = nlerp_short_path(qa, t, qb);
+        } break;
+        
+        case TrackKind_TRANSLATION: out->translation = lerp(a.translations[joint_index], t, b.translations[joint_index]); break;
+        case TrackKind_SCALE:       out->scale       = lerp(a.scales[joint_index],       t, b.scales[joint_index]);       break;
+    }
+}
+
+FUNCTION f32 get_segment_error(Keyframe_Reducer *r, Track_Kind kind, s32 joint_index, f32 lever_arm, s32 k0, s32 k1)
+{
+    // Max model space error of the points lever_arm around the joint if we drop the samples of the track 
+    // between k0 and k1 and interpolate them from k0 and k1 instead. The joint's ancestors and its tracks
+    // that were reduced before this one are taken as they'll play back, so their errors count too.
+    
+    s32 num_joints = (s32)r->anim->joints.count;
+    s32 parent     = r->anim->joints[joint_index].parent_id;
+    f32 max_error  = 0.0f;
+    for (s32 sample_index = k0 + 1; sample_index < k1; sample_index++) {
+        s64 base  = (s64)sample_index * num_joints;
+        SQT local = r->reduced_local[base + joint_index];
+        lerp_track_sample(r, kind, joint_index, k0, k1, sample_index, &local);
+        
+        SQT model = (parent >= 0)? concatenate_sqt(r->reduced[base + parent], local) : local;
+        max_error = MAX(max_error, get_model_space_error(model, r->exact[base + joint_index], lever_arm));
+    }
+    
+    return max_error;
+}
+
+FUNCTION s32 reduce_track(Keyframe_Reducer *r, Track_Kind kind, s32 joint_index, f32 lever_arm, f32 tolerance, u16 *key_samples_out)
+{
+    // @Note: Greedy keyframe reduction: starting from a key, extend the segment as far as we can while the 
+    // samples we skip stay within tolerance, then start a new segment from its end. The first and last 
+    // samples are always kept. Returns the number of keys written to key_samples_out, and puts the track
+    // as it'll play back in r->reduced_local.
+    //
+    // Segments grow by doubling and then bisect back, so long still stretches don't get rechecked sample 
+    // by sample. Every segment we keep has been checked in full.
+    
+    Sampled_Animation *anim = r->anim;
+    s32 num_samples = anim->num_samples;
+    s32 num_joints  = (s32)anim->joints.count;
+    s32 num_keys    = 0;
+    
+    key_samples_out[num_keys++] = 0;
+    
+    s32 start = 0;
+    while (start < num_samples - 1) {
+        s32 end = start + 1;
+        if (REDUCE_KEYFRAMES) {
+            // Find a segment that's too long (or the end of the clip)...
+            s32 step = 1;
+            s32 bad  = num_samples;
+            while (end + 1 < num_samples) {
+                s32 next = MIN(end + step, num_samples - 1);
+                if (get_segment_error(r, kind, joint_index, lever_arm, start, next) > tolerance) {
+                    bad = next;
+                    break;
+                }
+                end   = next;
+                step *= 2;
+            }
+            
+            // ...then the longest good one before it.
+            while (bad - end > 1) {
+                s32 mid = end + (bad - end)/2;
+                if (get_segment_error(r, kind, joint_index, lever_arm, start, mid) <= tolerance) end = mid;
+                else                                                                             bad = mid;
+            }
+        }
+        
+        key_samples_out[num_keys++] = (u16)end;
+        start = end;
+    }
+    
+    for (s32 k = 0; k + 1 < num_keys; k++) {
+        for (s32 sample_index = key_samples_out[k]; sample_index <= key_samples_out[k + 1]; sample_index++)
+            lerp_track_sample(r, kind, joint_index, key_samples_out[k], key_samples_out[k + 1], sample_index, &r->reduced_local[(s64)sample_index*num_joints + joint_index]);
+    }
+    if (num_keys == 1)
+        lerp_track_sample(r, kind, joint_index, 0, 0, 0, &r->reduced_local[joint_index]);
+    
+    return num_keys;
+}
+
+FUNCTION void compress_sampled_animation(Arena *arena, Sampled_Animation *anim, f32 tolerance = KEYFRAME_REDUCTION_TOLERANCE)
+{
+    // @Note: Compresses the raw sample streams of anim into anim->compressed:
+    // - Tracks that never change are only stored once in the constant pose.
+    // - Animated tracks only keep the samples that survive keyframe reduction (see reduce_track()), which 
+    //   keeps every joint within tolerance of its model space position.
+    // - Rotation keys are stored as "smallest three" 48-bit quaternions.
+    // - Translation and scale keys are quantized to 16-bit within their per-track range.
+    
+    s32 num_joints  = (s32)anim->joints.count;
+    s32 num_samples = anim->num_samples;
+    if (!num_joints || !num_samples) return;
+    
+    // Key sample indices are u16.
+    ASSERT((num_samples - 1) <= (s32)U16_MAX);
+    
+    u64 used_before = arena->used;
+    
+    Compressed_Clip *clip = PUSH_STRUCT_ZERO(arena, Compressed_Clip);
+    
+    // The constant pose is the first sample.
+    Pose_Sample first   = get_pose_sample(anim, 0);
+    clip->constant_pose = push_pose_sample(arena, num_joints);
+    copy_pose_sample(clip->constant_pose, first, num_joints);
+    
+    //
+    // Find the animated tracks.
+    //
+    Arena_Temp scratch = get_scratch(&arena, 1);
+    defer(free_scratch(scratch));
+    
+    Compressed_Track *tracks[3];
+    s32               num_tracks[3] = {};
+    for (s32 kind = 0; kind < 3; kind++)
+        tracks[kind] = PUSH_ARRAY_ZERO(scratch.arena, Compressed_Track, num_joints);
+    
+    V3  *translation_mins = PUSH_ARRAY(scratch.arena, V3,  num_joints);
+    V3  *translation_maxs = PUSH_ARRAY(scratch.arena, V3,  num_joints);
+    f32 *scale_mins       = PUSH_ARRAY(scratch.arena, f32, num_joints);
+    f32 *scale_maxs       = PUSH_ARRAY(scratch.arena, f32, num_joints);
+    f32 *bone_lengths     = PUSH_ARRAY(scratch.arena, f32, num_joints);
+    
+    // How far each track gets from the first sample: translation distance, rotation distance (see 
+    // get_rotation_distance()) and scale difference.
+    V3  *deviations       = PUSH_ARRAY(scratch.arena, V3,  num_joints);
+    
+    for (s32 joint_index = 0; joint_index < num_joints; joint_index++) {
+        Quaternion q0  = first.rotations[joint_index];
+        V3         t0  = first.translations[joint_index];
+        f32        s0  = first.scales[joint_index];
+        
+        V3  deviation = {};
+        V3  t_min = t0, t_max = t0;
+        f32 s_min = s0, s_max = s0;
+        f32 bone_length = length(t0);
+        
+        for (s32 sample_index = 1; sample_index < num_samples; sample_index++) {
+            Pose_Sample sample = get_pose_sample(anim, sample_index);
+            Quaternion q = sample.rotations[joint_index];
+            V3         t = sample.translations[joint_index];
+            f32        s = sample.scales[joint_index];
+            
+            deviation.x = MAX(deviation.x, length(t - t0));
+            deviation.y = MAX(deviation.y, get_rotation_distance(q0, q));
+            deviation.z = MAX(deviation.z, ABS(s - s0));
+            
+            t_min       = min_v3(t_min, t);
+            t_max       = max_v3(t_max, t);
+            s_min       = MIN(s_min, s);
+            s_max       = MAX(s_max, s);
+            bone_length = MAX(bone_length, length(t) * s_max);
+        }
+        deviations[joint_index]       = deviation;
+        translation_mins[joint_index] = t_min;
+        translation_maxs[joint_index] = t_max;
+        scale_mins[joint_index]       = s_min;
+        scale_maxs[joint_index]       = s_max;
+        bone_lengths[joint_index]     = bone_length;
+    }
+    
+    //
+    // Lever arm of each joint: distance to its farthest descendant (plus the shell distance). Errors in 
+    // a joint's rotation or scale move everything below it in the hierarchy. We walk up from every joint
+    // instead of relying on the joint order of the file.
+    //
+    f32 *lever_arms = PUSH_ARRAY(scratch.arena, f32, num_joints);
+    for (s32 joint_index = 0; joint_index < num_joints; joint_index++)
+        lever_arms[joint_index] = KEYFRAME_REDUCTION_SHELL_DISTANCE;
+    
+    for (s32 joint_index = 0; joint_index < num_joints; joint_index++) {
+        f32 distance = KEYFRAME_REDUCTION_SHELL_DISTANCE;
+        s32 child    = joint_index;
+        s32 parent   = anim->joints[child].parent_id;
+        for (s32 depth = 0; (parent >= 0) && (depth < num_joints); depth++) {
+            distance          += bone_lengths[child];
+            lever_arms[parent] = MAX(lever_arms[parent], distance);
+            
+            child  = parent;
+            parent = anim->joints[child].parent_id;
+        }
+    }
+    
+    //
+    // A track is animated if it moves the points lever arm around its joint.
+    //
+    for (s32 joint_index = 0; joint_index < num_joints; joint_index++) {
+        V3  deviation = deviations[joint_index];
+        f32 lever_arm = lever_arms[joint_index];
+        
+        if (lever_arm*deviation.y > CONSTANT_TRACK_TOLERANCE) {
+            tracks[TrackKind_ROTATION][num_tracks[TrackKind_ROTATION]++].joint_index = (u16)joint_index;
+        }
+        if (deviation.x > CONSTANT_TRACK_TOLERANCE) {
+            translation_mins[num_tracks[TrackKind_TRANSLATION]] = translation_mins[joint_index];
+            translation_maxs[num_tracks[TrackKind_TRANSLATION]] = translation_maxs[joint_index];
+            tracks[TrackKind_TRANSLATION][num_tracks[TrackKind_TRANSLATION]++].joint_index = (u16)joint_index;
+        }
+        if (lever_arm*deviation.z > CONSTANT_TRACK_TOLERANCE) {
+            scale_mins[num_tracks[TrackKind_SCALE]] = scale_mins[joint_index];
+            scale_maxs[num_tracks[TrackKind_SCALE]] = scale_maxs[joint_index];
+            tracks[TrackKind_SCALE][num_tracks[TrackKind_SCALE]++].joint_index = (u16)joint_index;
+        }
+    }
+    
+    //
+    // Joints in hierarchy order, parents first; again we don't rely on the joint order of the file.
+    //
+    s32 *depths    = PUSH_ARRAY_ZERO(scratch.arena, s32, num_joints);
+    s32 *order     = PUSH_ARRAY(scratch.arena, s32, num_joints);
+    s32 max_depth  = 0;
+    for (s32 joint_index = 0; joint_index < num_joints; joint_index++) {
+        for (s32 parent = anim->joints[joint_index].parent_id; (parent >= 0) && (depths[joint_index] < num_joints); parent = anim->joints[parent].parent_id)
+            depths[joint_index]++;
+        max_depth = MAX(max_depth, depths[joint_index]);
+    }
+    s32 num_ordered = 0;
+    for (s32 depth = 0; depth <= max_depth; depth++) {
+        for (s32 joint_index = 0; joint_index < num_joints; joint_index++)
+            if (depths[joint_index] == depth) order[num_ordered++] = joint_index;
+    }
+    
+    //
+    // Split the tolerance down each chain: a joint's tracks may take the model space error up to their 
+    // share of it, counting the animated tracks of its ancestors and of its longest chain of descendants. 
+    // The last track at the end of a chain gets all of it.
+    //
+    s32 *track_kinds   = PUSH_ARRAY_ZERO(scratch.arena, s32, num_joints*3); // Track index + 1 per kind.
+    s32 *tracks_above  = PUSH_ARRAY_ZERO(scratch.arena, s32, num_joints);
+    s32 *tracks_chain  = PUSH_ARRAY_ZERO(scratch.arena, s32, num_joints);
+    for (s32 kind = 0; kind < 3; kind++) {
+        for (s32 i = 0; i < num_tracks[kind]; i++)
+            track_kinds[tracks[kind][i].joint_index*3 + kind] = i + 1;
+    }
+    for (s32 i = 0; i < num_joints; i++) {
+        s32 joint_index = order[i];
+        s32 parent      = anim->joints[joint_index].parent_id;
+        if (parent >= 0) tracks_above[joint_index] = tracks_chain[parent];
+        
+        tracks_chain[joint_index] = tracks_above[joint_index];
+        for (s32 kind = 0; kind < 3; kind++)
+            tracks_chain[joint_index] += (track_kinds[joint_index*3 + kind] > 0);
+    }
+    for (s32 i = num_joints - 1; i >= 0; i--) {
+        s32 parent = anim->joints[order[i]].parent_id;
+        if (parent >= 0) tracks_chain[parent] = MAX(tracks_chain[parent], tracks_chain[order[i]]);
+    }
+    
+    //
+    // Reduce keyframes of the animated tracks, measuring the errors in model space.
+    //
+    s64 num_transforms  = (s64)num_samples * num_joints;
+    Keyframe_Reducer r  = {};
+    r.anim              = anim;
+    r.rotation_keys     = PUSH_ARRAY(scratch.arena, Quaternion, num_transforms);
+    r.exact             = PUSH_ARRAY(scratch.arena, SQT, num_transforms);
+    r.reduced           = PUSH_ARRAY(scratch.arena, SQT, num_transforms);
+    r.reduced_local     = PUSH_ARRAY(scratch.arena, SQT, num_transforms);
+    for (s32 sample_index = 0; sample_index < num_samples; sample_index++) {
+        Pose_Sample sample = get_pose_sample(anim, sample_index);
+        SQT *exact         = r.exact         + (s64)sample_index*num_joints;
+        SQT *local         = r.reduced_local + (s64)sample_index*num_joints;
+        for (s32 i = 0; i < num_joints; i++) {
+            s32 joint_index = order[i];
+            s32 parent      = anim->joints[joint_index].parent_id;
+            
+            SQT sqt = {sample.rotations[joint_index], sample.translations[joint_index], sample.scales[joint_index]};
+            exact[joint_index] = (parent >= 0)? concatenate_sqt(exact[parent], sqt) : sqt;
+            
+            if (track_kinds[joint_index*3 + TrackKind_ROTATION])
+                r.rotation_keys[(s64)sample_index*num_joints + joint_index] = dequantize_quaternion(quantize_quaternion(sqt.rotation));
+            
+            // Constant tracks play back the first sample.
+            if (!track_kinds[joint_index*3 + TrackKind_ROTATION])    sqt.rotation    = first.rotations[joint_index];
+            if (!track_kinds[joint_index*3 + TrackKind_TRANSLATION]) sqt.translation = first.translations[joint_index];
+            if (!track_kinds[joint_index*3 + TrackKind_SCALE])       sqt.scale       = first.scales[joint_index];
+            local[joint_index] = sqt;
+        }
+    }
+    
+    // Each track reduces into its own run of num_samples key samples; they're packed in track order after.
+    u16 *key_samples[3];
+    s32  num_keys[3] = {};
+    for (s32 kind = 0; kind < 3; kind++)
+        key_samples[kind] = PUSH_ARRAY(scratch.arena, u16, (s64)num_tracks[kind] * num_samples);
+    
+    for (s32 i = 0; i < num_joints; i++) {
+        s32 joint_index = order[i];
+        s32 parent      = anim->joints[joint_index].parent_id;
+        s32 num_done    = tracks_above[joint_index];
+        
+        for (s32 kind = 0; kind < 3; kind++) {
+            s32 track_index = track_kinds[joint_index*3 + kind] - 1;
+            if (track_index < 0) continue;
+            
+            num_done++;
+            f32 track_tolerance     = tolerance * (f32)num_done / (f32)tracks_chain[joint_index];
+            Compressed_Track *track = &tracks[kind][track_index];
+            track->num_keys         = (u16)reduce_track(&r, (Track_Kind)kind, joint_index, lever_arms[joint_index], track_tolerance, key_samples[kind] + (s64)track_index*num_samples);
+        }
+        
+        for (s32 sample_index = 0; sample_index < num_samples; sample_index++) {
+            s64 base = (s64)sample_index*num_joints;
+            SQT local = r.reduced_local[base + joint_index];
+            r.reduced[base + joint_index] = (parent >= 0)? concatenate_sqt(r.reduced[base + parent], local) : local;
+        }
+    }
+    
+    for (s32 kind = 0; kind < 3; kind++) {
+        for (s32 i = 0; i < num_tracks[kind]; i++) {
+            Compressed_Track *track = &tracks[kind][i];
+            track->first_key        = (u32)num_keys[kind];
+            MEMORY_COPY(key_samples[kind] + num_keys[kind], key_samples[kind] + (s64)i*num_samples, track->num_keys*sizeof(u16));
+            num_keys[kind]         += track->num_keys;
+        }
+    }
+    
+    //
+    // Copy tracks, key sample indices and quantization ranges.
+    //
+    clip->num_rotation_tracks    = num_tracks[TrackKind_ROTATION];
+    clip->num_translation_tracks = num_tracks[TrackKind_TRANSLATION];
+    clip->num_scale_tracks       = num_tracks[TrackKind_SCALE];
+    
+    clip->rotation_tracks    = PUSH_ARRAY(arena, Compressed_Track, clip->num_rotation_tracks);
+    clip->translation_tracks = PUSH_ARRAY(arena, Compressed_Track, clip->num_translation_tracks);
+    clip->scale_tracks       = PUSH_ARRAY(arena, Compressed_Track, clip->num_scale_tracks);
+    MEMORY_COPY(clip->rotation_tracks,    tracks[TrackKind_ROTATION],    clip->num_rotation_tracks    * sizeof(Compressed_Track));
+    MEMORY_COPY(clip->translation_tracks, tracks[TrackKind_TRANSLATION], clip->num_translation_tracks * sizeof(Compressed_Track));
+    MEMORY_COPY(clip->scale_tracks,       tracks[TrackKind_SCALE],       clip->num_scale_tracks       * sizeof(Compressed_Track));
+    
+    clip->rotation_key_samples    = PUSH_ARRAY(arena, u16, num_keys[TrackKind_ROTATION]);
+    clip->translation_key_samples = PUSH_ARRAY(arena, u16, num_keys[TrackKind_TRANSLATION]);
+    clip->scale_key_samples       = PUSH_ARRAY(arena, u16, num_keys[TrackKind_SCALE]);
+    MEMORY_COPY(clip->rotation_key_samples,    key_samples[TrackKind_ROTATION],    num_keys[TrackKind_ROTATION]    * sizeof(u16));
+    MEMORY_COPY(clip->translation_key_samples, key_samples[TrackKind_TRANSLATION], num_keys[TrackKind_TRANSLATION] * sizeof(u16));
+    MEMORY_COPY(clip->scale_key_samples,       key_samples[TrackKind_SCALE],       num_keys[TrackKind_SCALE]       * sizeof(u16));
+    
+    clip->translation_mins    = PUSH_ARRAY(arena, V3,  clip->num_translation_tracks);
+    clip->translation_extents = PUSH_ARRAY(arena, V3,  clip->num_translation_tracks);
+    clip->scale_mins          = PUSH_ARRAY(arena, f32, clip->num_scale_tracks);
+    clip->scale_extents       = PUSH_ARRAY(arena, f32, clip->num_scale_tracks);
+    MEMORY_COPY(clip->translation_mins, translation_mins, clip->num_translation_tracks * sizeof(V3));
+    MEMORY_COPY(clip->scale_mins,       scale_mins,       clip->num_scale_tracks       * sizeof(f32));
+    for (s32 i = 0; i < clip->num_translation_tracks; i++)
+        clip->translation_extents[i] = translation_maxs[i] - translation_mins[i];
+    for (s32 i = 0; i < clip->num_scale_tracks; i++)
+        clip->scale_extents[i] = scale_maxs[i] - scale_mins[i];
+    
+    //
+    // Quantize the keys.
+    //
+    clip->rotation_keys    = (Quantized_Quaternion *) arena_push(arena, num_keys[TrackKind_ROTATION]    * sizeof(Quantized_Quaternion), SAMPLE_STREAM_ALIGNMENT);
+    clip->translation_keys = (u16 *)                  arena_push(arena, num_keys[TrackKind_TRANSLATION] * 3 * sizeof(u16),              SAMPLE_STREAM_ALIGNMENT);
+    clip->scale_keys       = (u16 *)                  arena_push(arena, num_keys[TrackKind_SCALE]       * sizeof(u16),                  SAMPLE_STREAM_ALIGNMENT);
+    
+    for (s32 i = 0; i < clip->num_rotation_tracks; i++) {
+        Compressed_Track *track = &clip->rotation_tracks[i];
+        for (s32 k = track->first_key; k < (s32)(track->first_key + track->num_keys); k++) {
+            Pose_Sample sample     = get_pose_sample(anim, clip->rotation_key_samples[k]);
+            clip->rotation_keys[k] = quantize_quaternion(sample.rotations[track->joint_index]);
+        }
+    }
+    
+    for (s32 i = 0; i < clip->num_translation_tracks; i++) {
+        Compressed_Track *track = &clip->translation_tracks[i];
+        V3 min    = clip->translation_mins[i];
+        V3 extent = clip->translation_extents[i];
+        for (s32 k = track->first_key; k < (s32)(track->first_key + track->num_keys); k++) {
+            Pose_Sample sample = get_pose_sample(anim, clip->translation_key_samples[k]);
+            V3 t = sample.translations[track->joint_index];
+            for (s32 c = 0; c < 3; c++)
+                clip->translation_keys[k*3 + c] = quantize_unorm16(t.I[c], min.I[c], extent.I[c]);
+        }
+    }
+    
+    for (s32 i = 0; i < clip->num_scale_tracks; i++) {
+        Compressed_Track *track = &clip->scale_tracks[i];
+        for (s32 k = track->first_key; k < (s32)(track->first_key + track->num_keys); k++) {
+            Pose_Sample sample  = get_pose_sample(anim, clip->scale_key_samples[k]);
+            clip->scale_keys[k] = quantize_unorm16(sample.scales[track->joint_index], clip->scale_mins[i], clip->scale_extents[i]);
+        }
+    }
+    
+    clip->size_in_bytes = arena->used - used_before;
+    anim->compressed    = clip;
+}
+
+FUNCTION s32 find_key(u16 *key_samples, s32 num_keys, f32 sample_position, u16 *cursor)
+{
+    // @Note: Returns the last key at or before sample_position. Playback mostly moves forward by less 
+    // than a key per eval, so we step forward from the cached cursor and only binary search when time 
+    // went backwards (looping, set_animation(), negative time multipliers).
+    
+    s32 k = cursor? *cursor : 0;
+    if ((k >= num_keys) || (key_samples[k] > sample_position)) {
+        s32 lo = 0;
+        s32 hi = num_keys - 1;
+        while (lo < hi) {
+            s32 mid = (lo + hi + 1) / 2;
+            if (key_samples[mid] <= sample_position) lo = mid;
+            else                                     hi = mid - 1;
+        }
+        k = lo;
+    } else {
+        while ((k + 1 < num_keys) && (key_samples[k + 1] <= sample_position))
+            k++;
+    }
+    
+    if (cursor) *cursor = (u16)k;
+    return k;
+}
+
+FUNCTION inline f32 get_key_fraction(u16 *key_samples, s32 num_keys, s32 k, f32 sample_position)
+{
+    if (k + 1 >= num_keys) return 0.0f;
+    
+    f32 fraction = (sample_position - key_samples[k]) / (f32)(key_samples[k + 1] - key_samples[k]);
+    return CLAMP01(fraction);
+}
+
+FUNCTION void sample_compressed_clip(Compressed_Clip *clip, s32 num_joints, f32 sample_position, u16 *key_cursors, SQT *out, u64 const *skip_joints = 0, s16 const *remap = 0)
+{
+    // @Note: Variable-rate sampling: each animated track has its own keys, so each track finds its own 
+    // bracketing keys and lerps between them. key_cursors is optional (one per track, see Animation_Channel).
+    // Tracks of joints set in skip_joints (a bitset, optional) aren't sampled; those joints get the 
+    // constant pose. With a remap (see Joint_Remap), joint i of the clip goes to out[remap[i]] and 
+    // skip_joints is indexed the same way; clip joints mapped to -1 aren't sampled at all.
+    
+    Pose_Sample constant = clip->constant_pose;
+    for (s32 i = 0; i < num_joints; i++) {
+        s32 o = remap? remap[i] : i;
+        if (o < 0) continue;
+        
+        out[o].rotation    = constant.rotations[i];
+        out[o].translation = constant.translations[i];
+        out[o].scale       = constant.scales[i];
+    }
+    
+    u16 *cursor = key_cursors;
+    
+    for (s32 i = 0; i < clip->num_rotation_tracks; i++) {
+        Compressed_Track *track = &clip->rotation_tracks[i];
+        s32 o                   = remap? remap[track->joint_index] : track->joint_index;
+        if ((o < 0) || (skip_joints && ((skip_joints[o / 64] >> (o % 64)) & 1))) {
+            if (cursor) cursor++;
+            continue;
+        }
+        u16 *key_samples        = clip->rotation_key_samples + track->first_key;
+        Quantized_Quaternion *keys = clip->rotation_keys     + track->first_key;
+        
+        s32 k  = find_key(key_samples, track->num_keys, sample_position, cursor? cursor++ : 0);
+        s32 k1 = MIN(k + 1, track->num_keys - 1);
+        f32 t  = get_key_fraction(key_samples, track->num_keys, k, sample_position);
+        
+        // Quantizing makes the dropped component positive, so neighbouring keys can be on opposite sides.
+        out[o].rotation = nlerp_short_path(dequantize_quaternion(keys[k]), t, dequantize_quaternion(keys[k1]));
+    }
+    
+    for (s32 i = 0; i < clip->num_translation_tracks; i++) {
+        Compressed_Track *track = &clip->translation_tracks[i];
+        s32 o                   = remap? remap[track->joint_index] : track->joint_index;
+        if ((o < 0) || (skip_joints && ((skip_joints[o / 64] >> (o % 64)) & 1))) {
+            if (cursor) cursor++;
+            continue;
+        }
+        u16 *key_samples        = clip->translation_key_samples + track->first_key;
+        u16 *keys               = clip->translation_keys        + track->first_key*3;
+        V3 min                  = clip->translation_mins[i];
+        V3 extent               = clip->translation_extents[i];
+        
+        s32 k  = find_key(key_samples, track->num_keys, sample_position, cursor? cursor++ : 0);
+        s32 k1 = MIN(k + 1, track->num_keys - 1);
+        f32 t  = get_key_fraction(key_samples, track->num_keys, k, sample_position);
+        
+        V3 a, b;
+        for (s32 c = 0; c < 3; c++) {
+            a.I[c] = dequantize_unorm16(keys[k*3  + c], min.I[c], extent.I[c]);
+            b.I[c] = dequantize_unorm16(keys[k1*3 + c], min.I[c], extent.I[c]);
+        }
+        out[o].translation = lerp(a, t, b);
+    }
+    
+    for (s32 i = 0; i < clip->num_scale_tracks; i++) {
+        Compressed_Track *track = &clip->scale_tracks[i];
+        s32 o                   = remap? remap[track->joint_index] : track->joint_index;
+        if ((o < 0) || (skip_joints && ((skip_joints[o / 64] >> (o % 64)) & 1))) {
+            if (cursor) cursor++;
+            continue;
+        }
+        u16 *key_samples        = clip->scale_key_samples + track->first_key;
+        u16 *keys               = clip->scale_keys        + track->first_key;
+        
+        s32 k  = find_key(key_samples, track->num_keys, sample_position, cursor? cursor++ : 0);
+        s32 k1 = MIN(k + 1, track->num_keys - 1);
+        f32 t  = get_key_fraction(key_samples, track->num_keys, k, sample_position);
+        f32 a  = dequantize_unorm16(keys[k],  clip->scale_mins[i], clip->scale_extents[i]);
+        f32 b  = dequantize_unorm16(keys[k1], clip->scale_mins[i], clip->scale_extents[i]);
+        out[o].scale = lerp(a, t, b);
+    }
+}
+
 //~ Sampled Animation
 //
-FUNCTION b32 load_sampled_animation(Arena *arena, Sampled_Animation *anim, String8 full_path)
+FUNCTION b32 validate_sampled_animation_data(String8 file, String8 full_path)
 {
-    String8 file = os->read_entire_file(full_path);
-    if (!file.data) {
-        debug_print("SAMPLED ANIMATION LOAD ERROR: Couldn't load animation at %S\n", full_path);
-        return false;
+    // @Note: Checks a .sampled_animation the way read_sampled_animation_header() and read_sample_streams()
+    // read it, so broken exporter output is reported instead of tripping asserts later.
+    
+    s32 counts[4]; // Version, frame rate, number of samples and number of joints.
+    if (!get_checked(&file, &counts)) return validation_error(full_path, "truncated header");
+    if ((counts[0] <= 0) || (counts[0] > SAMPLED_ANIMATION_FILE_VERSION)) return validation_error(full_path, "unknown version");
+    if (counts[2] <= 0)                                                return validation_error(full_path, "no samples");
+    if ((counts[2] - 1) > (s32)U16_MAX)                                return validation_error(full_path, "too many samples to compress");
+    if (counts[3] <= 0)                                                return validation_error(full_path, "bad number of joints");
+    if (counts[3] > MAX_JOINTS)                                        return validation_error(full_path, "more joints than MAX_JOINTS");
+    
+    s32 num_joints = counts[3];
+    s32 num_roots  = 0;
+    s32 min_parent = S32_MAX;
+    s32 max_parent = -1;
+    for (s32 joint_index = 0; joint_index < num_joints; joint_index++) {
+        s32 joint_name_len = 0;
+        if (!get_checked(&file, &joint_name_len) || (joint_name_len < 0) || ((u64)joint_name_len > file.count))
+            return validation_error(full_path, "truncated joint name");
+        advance(&file, joint_name_len);
+        
+        s32 parent_id;
+        if (!get_checked(&file, &parent_id)) return validation_error(full_path, "truncated joints");
+        if (parent_id < -1)                  return validation_error(full_path, "joint parent out of range");
+        if (parent_id == -1) num_roots++;
+        else {
+            min_parent = MIN(min_parent, parent_id);
+            max_parent = MAX(max_parent, parent_id);
+        }
+    }
+    
+    // Parent ids of older exports are off by the root's id (see read_sampled_animation_header()).
+    if (num_roots != 1) return validation_error(full_path, "there has to be exactly one root joint");
+    if ((min_parent != S32_MAX) && ((max_parent - min_parent) >= num_joints))
+        return validation_error(full_path, "joint parent out of range");
+    
+    u64 samples_size = (u64)counts[2] * num_joints * sizeof(SQT);
+    if (file.count != samples_size) return validation_error(full_path, "file size doesn't match the number of samples");
+    
+    for (u64 i = 0; i < samples_size / sizeof(SQT); i++) {
+        SQT xform;
+        get(&file, &xform);
+        if (!are_finite((f32 *)&xform, sizeof(SQT) / sizeof(f32))) return validation_error(full_path, "sample isn't finite");
+        if (length(xform.rotation) < 0.5f)                         return validation_error(full_path, "sample rotation isn't a unit quaternion");
     }
-    String8 orig_file = file;
     
-    //-
+    return TRUE;
+}
+
+FUNCTION void read_sampled_animation_header(Arena *arena, Sampled_Animation *anim, String8 *file, String8 full_path)
+{
+    // @Note: Reads everything before the samples; file is left at the first sample.
     
     String8 name = extract_base_name(full_path);
     anim->name   = str8_copy(arena, name);
     
     s32 version = 0;
-    get(&file, &version);
+    get(file, &version);
     ASSERT(version <= SAMPLED_ANIMATION_FILE_VERSION);
     
     // Samples per second
-    get(&file, &anim->frame_rate);
+    get(file, &anim->frame_rate);
     if (anim->frame_rate <= 0) {
         anim->frame_rate = 1;
         debug_print("Animation file %S had frame rate of zero, setting to %d\n", full_path, anim->frame_rate);
     }
     
     // Number of samples
-    get(&file, &anim->num_samples);
+    get(file, &anim->num_samples);
     
     // Number of joints
     s32 num_joints;
-    get(&file, &num_joints);
+    get(file, &num_joints);
     array_init_and_resize(&anim->joints, num_joints);
     
-    // Calculate duration of animation from number of samples and samples per second
+    // Calculate duration of animation from number of samples and samples per second. The exporters write
+    // the pose at the end of the clip too (for loops, the same as the first one), so a clip is one sample
+    // interval shorter than its number of samples; one interval if it only has one sample.
     anim->duration = 1.0f;
     if (anim->joints.data) {
-        anim->duration = anim->num_samples / (f64)anim->frame_rate;
+        anim->duration = MAX(anim->num_samples - 1, 1) / (f64)anim->frame_rate;
     }
     
     // Read Joint name and parent id.
@@ -55,388 +780,3033 @@ FUNCTION b32 load_sampled_animation(Arena *arena, Sampled_Animation *anim, Strin
         
         // Read name
         s32 joint_name_len = 0;
-        get(&file, &joint_name_len);
-        String8 joint_name = str8(file.data, joint_name_len);
-        advance(&file, joint_name_len);
+        get(file, &joint_name_len);
+        String8 joint_name = str8(file->data, joint_name_len);
+        advance(file, joint_name_len);
         joint->name = str8_copy(arena, joint_name);
         
         // Read parent id
-        get(&file, &joint->parent_id);
+        get(file, &joint->parent_id);
+    }
+    
+    // @Hack: Older exports didn't reset the joint id counter between animations, so every parent id in 
+    // the file is off by the id the root got. Joints are exported root first, so the smallest parent id 
+    // is the root's id.
+    s32 parent_id_offset = S32_MAX;
+    for (s32 joint_index = 0; joint_index < anim->joints.count; joint_index++) {
+        s32 parent_id = anim->joints[joint_index].parent_id;
+        if (parent_id >= 0) parent_id_offset = MIN(parent_id_offset, parent_id);
+    }
+    if (parent_id_offset != S32_MAX && parent_id_offset > 0) {
+        for (s32 joint_index = 0; joint_index < anim->joints.count; joint_index++) {
+            Pose_Joint_Info *joint = &anim->joints[joint_index];
+            if (joint->parent_id >= 0) joint->parent_id -= parent_id_offset;
+        }
+    }
+}
+
+FUNCTION void read_sample_streams(Arena *arena, Sampled_Animation *anim, String8 *file)
+{
+    // The exporter writes samples sample-major already, so we just split each SQT into the streams.
+    
+    s64 num_transforms = (s64)anim->num_samples * anim->joints.count;
+    anim->rotations    = (Quaternion *) arena_push(arena, num_transforms * sizeof(Quaternion), SAMPLE_STREAM_ALIGNMENT);
+    anim->translations = (V3 *)         arena_push(arena, num_transforms * sizeof(V3),         SAMPLE_STREAM_ALIGNMENT);
+    anim->scales       = (f32 *)        arena_push(arena, num_transforms * sizeof(f32),        SAMPLE_STREAM_ALIGNMENT);
+    
+    for (s64 i = 0; i < num_transforms; i++) {
+        SQT xform;
+        get(file, &xform);
+        
+        anim->rotations[i]    = xform.rotation;
+        anim->translations[i] = xform.translation;
+        anim->scales[i]       = xform.scale;
+    }
+}
+
+FUNCTION void build_root_motion(Sampled_Animation *anim, V3 t0, Quaternion q0, Root_Motion_Sample *out)
+{
+    // Root motion track of anim's samples, relative to a root at t0 and q0. The root's parent is object 
+    // space, so its rotation relative to q0 is q*conjugate(q0), and the yaw is that rotation's twist 
+    // around the up axis.
+    
+    s32 num_joints = (s32)anim->joints.count;
+    f32 last_yaw   = 0.0f;
+    for (s32 s = 0; s < anim->num_samples; s++) {
+        V3 t         = anim->translations[s*num_joints];
+        Quaternion r = anim->rotations[s*num_joints] * quaternion_conjugate(q0);
+        
+        f32 yaw = 2.0f * atan2f(r.y, r.w);
+        while (yaw - last_yaw >  PI32) yaw -= TAU32;
+        while (yaw - last_yaw < -PI32) yaw += TAU32;
+        last_yaw = yaw;
+        
+        out[s].translation = {t.x - t0.x, 0.0f, t.z - t0.z};
+        out[s].yaw         = yaw;
+    }
+}
+
+FUNCTION void set_reference_pose(Arena *arena, Sampled_Animation *anim)
+{
+    // Keep the first sample around as the reference pose for additive blending.
+    
+    s32 num_joints       = (s32)anim->joints.count;
+    anim->reference_pose = PUSH_ARRAY(arena, SQT, num_joints);
+    for (s32 i = 0; i < num_joints; i++) {
+        anim->reference_pose[i].rotation    = anim->rotations[i];
+        anim->reference_pose[i].translation = anim->translations[i];
+        anim->reference_pose[i].scale       = anim->scales[i];
+    }
+}
+
+//~ Animation Clock
+//
+
+FUNCTION s64 seconds_to_animation_clock(f64 seconds)
+{
+    return (s64) floor(seconds * (f64)ANIMATION_CLOCK_RATE + 0.5);
+}
+
+FUNCTION f64 animation_clock_to_seconds(s64 clock)
+{
+    return (f64)clock / (f64)ANIMATION_CLOCK_RATE;
+}
+
+FUNCTION s64 get_clip_clock_duration(Sampled_Animation *anim)
+{
+    // Whole samples at any frame rate that divides the clock rate, which is all of the ones we export at.
+    // Same length as anim->duration (see read_sampled_animation_header()).
+    
+    if (ANIMATION_CLOCK_RATE % anim->frame_rate == 0)
+        return (s64)MAX(anim->num_samples - 1, 1) * (ANIMATION_CLOCK_RATE / anim->frame_rate);
+    
+    return seconds_to_animation_clock(anim->duration);
+}
+
+FUNCTION s32 get_clip_sample(Sampled_Animation *anim, f64 time, f64 *fraction_out)
+{
+    // @Note: The sample at or before time (clamped to the clip), and how far time is towards the next one
+    // in fraction_out. Samples are ANIMATION_CLOCK_RATE / frame_rate clock ticks apart, so both come from
+    // the clock in integers: channel times are clocks in seconds and turn back into the same clock, so
+    // nothing depends on rounding of the time or the duration.
+    
+    s32 last_sample = anim->num_samples - 1;
+    *fraction_out   = 0.0;
+    if (last_sample <= 0) return 0;
+    
+    s64 index    = 0;
+    f64 fraction = 0.0;
+    if (ANIMATION_CLOCK_RATE % anim->frame_rate == 0) {
+        s64 clock            = MAX(0, seconds_to_animation_clock(time));
+        s64 ticks_per_sample = ANIMATION_CLOCK_RATE / anim->frame_rate;
+        index                = clock / ticks_per_sample;
+        fraction             = (f64)(clock - index*ticks_per_sample) / (f64)ticks_per_sample;
+    } else {
+        f64 position = MAX(0.0, time * (f64)anim->frame_rate);
+        index        = (s64)position;
+        fraction     = position - (f64)index;
+    }
+    
+    if (index >= last_sample) return last_sample;
+    
+    *fraction_out = fraction;
+    return (s32)index;
+}
+
+FUNCTION void set_channel_clock(Animation_Channel *channel, s64 clock)
+{
+    // Wraps looping channels into [0, clock_duration) and clamps the others to it.
+    
+    s64 duration = channel->clock_duration;
+    if (duration <= 0) {
+        clock = 0;
+    } else if (channel->is_looping) {
+        clock %= duration;
+        if (clock < 0) clock += duration;
+    } else {
+        clock = CLAMP(0, clock, duration);
+    }
+    
+    channel->clock        = clock;
+    channel->current_time = animation_clock_to_seconds(clock);
+}
+
+FUNCTION void set_channel_time(Animation_Channel *channel, f64 seconds)
+{
+    set_channel_clock(channel, seconds_to_animation_clock(seconds));
+}
+
+//~ Clip Streaming
+//
+// @Note: A streamed clip is split into blocks of ANIMATION_STREAM_BLOCK_DURATION. The cook reduces and 
+// compresses every block on its own, with its own keys and constant pose, and writes it into the clip's
+// cooked animation as a cooked clip block (see cook_streamed_animation()), so reading a block in is one 
+// read and relocating its pointers. The first block is loaded with the clip and never evicted, so there
+// is always something to sample.
+//
+// Threads: the main thread requests blocks and evicts them (between ticks, nobody is sampling then). The
+// background thread owns a block from QUEUED until it flips it to RESIDENT or FAILED. Animation jobs 
+// only read RESIDENT blocks.
+//
+FUNCTION b32 read_clip_block(Clip_Block *block, u8 const *mapped_data = 0)
+{
+    // @Note: Reads the block's cooked clip block into an arena of its own (copies it if the cooked 
+    // animation is mapped and we have its address) and points the block into it. Returns FALSE if it 
+    // couldn't be read or is broken.
+    
+    Clip_Stream *stream = block->stream;
+    u64 size            = block->file_size;
+    
+    Arena *arena = arena_init(size + KILOBYTES(64));
+    u8 *data     = (u8 *) arena_push(arena, size, COOKED_FILE_ALIGNMENT);
+    b32 valid    = TRUE;
+    if (mapped_data) MEMORY_COPY(data, mapped_data, size);
+    else             valid = (os->read_file_range(stream->path, block->file_offset, data, size) == size);
+    
+    String8 file = str8(data, size);
+    valid        = valid && is_valid_cooked_file(file, &CLIP_BLOCK_COOKED_FILE);
+    if (valid) {
+        Cooked_Section *sections = get_cooked_sections(file);
+        s64 num_root_motion      = stream->has_root_motion? block->num_samples : 0;
+        valid = (sections[ClipBlockSection_CLIP].count == 1) && (sections[ClipBlockSection_ROOT_MOTION].count == num_root_motion);
+    }
+    if (!valid) {
+        arena_free(arena);
+        return FALSE;
+    }
+    
+    relocate_cooked_file(file, &CLIP_BLOCK_COOKED_FILE);
+    block->arena         = arena;
+    block->clip          = (Compressed_Clip *) get_section_data(file, ClipBlockSection_CLIP);
+    block->root_motion   = stream->has_root_motion? (Root_Motion_Sample *) get_section_data(file, ClipBlockSection_ROOT_MOTION) : 0;
+    block->size_in_bytes = arena->used;
+    return TRUE;
+}
+
+FUNCTION void load_clip_block(void *data)
+{
+    // @Note: Runs on the background thread (see push_background_job()).
+    
+    Clip_Block *block = (Clip_Block *) data;
+    if (!read_clip_block(block)) {
+        debug_print("SAMPLED ANIMATION LOAD ERROR: Couldn't read samples %d to %d of %S\n", block->first_sample, block->first_sample + block->num_samples - 1, block->stream->path);
+        atomic_exchange_s32(&block->state, ClipBlockState_FAILED);
+        return;
+    }
+    
+    // Full barrier, so the block is complete before anybody sees it's resident.
+    atomic_exchange_s32(&block->state, ClipBlockState_RESIDENT);
+}
+
+FUNCTION Clip_Block* find_resident_block(Clip_Stream *stream, s32 sample_index)
+{
+    // @Note: The block with sample_index in it. If it isn't here yet, the closest resident block before 
+    // it (the first one always is); callers clamp to its last sample, so the clip holds until it arrives.
+    
+    s32 b = CLAMP(0, sample_index / stream->samples_per_block, stream->num_blocks - 1);
+    if (stream->blocks[b].state != ClipBlockState_RESIDENT) {
+        atomic_add_s32(&clip_streaming.num_misses, 1);
+        while ((b > 0) && (stream->blocks[b].state != ClipBlockState_RESIDENT))
+            b--;
+    }
+    return &stream->blocks[b];
+}
+
+FUNCTION b32 is_clip_time_resident(Sampled_Animation *anim, f64 time)
+{
+    if (!anim->stream) return TRUE;
+    
+    Clip_Stream *stream = anim->stream;
+    f64 fraction;
+    s32 sample_index    = get_clip_sample(anim, time, &fraction);
+    s32 b               = CLAMP(0, sample_index / stream->samples_per_block, stream->num_blocks - 1);
+    return stream->blocks[b].state == ClipBlockState_RESIDENT;
+}
+
+FUNCTION void unlink_lru(Clip_Block *block)
+{
+    block->lru_prev->lru_next = block->lru_next;
+    block->lru_next->lru_prev = block->lru_prev;
+    block->lru_prev = block->lru_next = 0;
+}
+
+FUNCTION void request_clip_block(Clip_Block *block)
+{
+    // @Note: Main thread only. Marks the block as used this tick and queues it for loading if it isn't
+    // resident.
+    
+    Clip_Block *lru = &clip_streaming.lru;
+    if (!lru->lru_next)
+        lru->lru_next = lru->lru_prev = lru;
+    
+    block->last_used_tick = clip_streaming.tick;
+    if (block == &block->stream->blocks[0]) return;
+    
+    if (block->state == ClipBlockState_EMPTY) {
+        // QUEUED before pushing: the background thread may be done with it before push returns.
+        block->state = ClipBlockState_QUEUED;
+        if (!push_background_job(load_clip_block, block)) {
+            block->state = ClipBlockState_EMPTY;
+            return;
+        }
+        clip_streaming.num_loads++;
+    } else if (block->state == ClipBlockState_FAILED) {
+        return;
+    }
+    
+    // Move to the front.
+    if (block->lru_next) unlink_lru(block);
+    block->lru_prev         = lru;
+    block->lru_next         = lru->lru_next;
+    lru->lru_next->lru_prev = block;
+    lru->lru_next           = block;
+}
+
+FUNCTION void request_clip_blocks(Sampled_Animation *anim, f64 t0, f64 t1, b32 looping)
+{
+    // Requests the blocks anim needs to play from t0 to t1 (either direction, wrapping around if looping).
+    
+    if (!anim || !anim->stream) return;
+    Clip_Stream *stream = anim->stream;
+    
+    if (t1 < t0) SWAP(t0, t1, f64);
+    if (!looping) {
+        t0 = CLAMP(0.0, t0, anim->duration);
+        t1 = CLAMP(0.0, t1, anim->duration);
+    }
+    
+    s64 last_sample     = anim->num_samples - 1;
+    f64 samples_per_sec = (f64)last_sample / anim->duration;
+    s64 first           = (s64)floor(t0 * samples_per_sec);
+    s64 one_past_last   = (s64)floor(t1 * samples_per_sec) + 1;
+    
+    // Step a block at a time, and always include the last sample.
+    for (s32 i = 0; i <= stream->num_blocks; i++) {
+        s64 sample = MIN(first + (s64)i*stream->samples_per_block, one_past_last - 1);
+        if (looping) sample = ((sample % last_sample) + last_sample) % last_sample;
+        
+        s32 b = CLAMP(0, (s32)(sample / stream->samples_per_block), stream->num_blocks - 1);
+        request_clip_block(&stream->blocks[b]);
+        
+        if (first + (s64)i*stream->samples_per_block >= one_past_last - 1) break;
+    }
+}
+
+FUNCTION void update_clip_streaming()
+{
+    // @Note: Call once per tick after the players are done evaluating. Evicts the least recently used 
+    // blocks until the resident ones fit the budget, except blocks that were requested this tick.
+    
+    Clip_Block *lru = &clip_streaming.lru;
+    if (!lru->lru_next)
+        lru->lru_next = lru->lru_prev = lru;
+    
+    u64 resident_bytes      = 0;
+    s32 num_resident_blocks = 0;
+    for (Clip_Block *block = lru->lru_next; block != lru; block = block->lru_next) {
+        if (block->state != ClipBlockState_RESIDENT) continue;
+        
+        resident_bytes += block->size_in_bytes;
+        num_resident_blocks++;
+    }
+    
+    Clip_Block *prev = 0;
+    for (Clip_Block *block = lru->lru_prev; (block != lru) && (resident_bytes > ANIMATION_STREAMING_BUDGET); block = prev) {
+        prev = block->lru_prev;
+        
+        // Everything after this one was used this tick too.
+        if (block->last_used_tick == clip_streaming.tick) break;
+        
+        if (block->state == ClipBlockState_QUEUED) continue;
+        if (block->state == ClipBlockState_RESIDENT) {
+            resident_bytes -= block->size_in_bytes;
+            num_resident_blocks--;
+            clip_streaming.num_evictions++;
+            
+            arena_free(block->arena);
+            block->arena         = 0;
+            block->clip          = 0;
+            block->root_motion   = 0;
+            block->size_in_bytes = 0;
+            block->state         = ClipBlockState_EMPTY;
+        }
+        unlink_lru(block);
+    }
+    
+    clip_streaming.resident_bytes      = resident_bytes;
+    clip_streaming.num_resident_blocks = num_resident_blocks;
+    clip_streaming.tick++;
+}
+
+FUNCTION s32 get_samples_per_clip_block(s32 frame_rate)
+{
+    return MAX(1, (s32)(ANIMATION_STREAM_BLOCK_DURATION * MAX(frame_rate, 1) + 0.5));
+}
+
+FUNCTION s32 get_clip_block_count(s32 frame_rate, s32 num_samples)
+{
+    if (num_samples < 2) return 0;
+    
+    s32 samples_per_block = get_samples_per_clip_block(frame_rate);
+    return (num_samples - 1 + samples_per_block - 1) / samples_per_block;
+}
+
+FUNCTION b32 should_stream_animation(s32 frame_rate, s32 num_samples, s32 num_joints)
+{
+    // Takes the counts from the header of the .sampled_animation. Clips that fit in a block aren't worth
+    // it however big they are.
+    
+    if (!STREAM_ANIMATIONS || !COMPRESS_ANIMATIONS) return FALSE;
+    
+    u64 samples_size = (u64)MAX(num_samples, 0) * (u64)MAX(num_joints, 0) * sizeof(SQT);
+    return (samples_size > ANIMATION_STREAM_MIN_SIZE) && (get_clip_block_count(frame_rate, num_samples) > 1);
+}
+
+FUNCTION Clip_Stream* load_clip_stream(Arena *arena, String8 file, String8 cooked_path)
+{
+    // @Note: Streaming from a mapped cooked animation that has a stream section; reads the first block.
+    // Returns 0 and pushes nothing if the stream doesn't add up or the first block is broken.
+    
+    Cooked_Section *sections         = get_cooked_sections(file);
+    Animation_Cooked_Info *info      = (Animation_Cooked_Info *)   get_section_data(file, AnimationSection_INFO);
+    Animation_Cooked_Stream *cooked  = (Animation_Cooked_Stream *) get_section_data(file, AnimationSection_STREAM);
+    Cooked_Clip_Block *cooked_blocks = (Cooked_Clip_Block *)       get_section_data(file, AnimationSection_BLOCKS);
+    
+    s32 samples_per_block = cooked->samples_per_block;
+    s32 num_blocks        = cooked->num_blocks;
+    if ((samples_per_block <= 0) || (info->num_samples < 2) || (num_blocks != (info->num_samples - 1 + samples_per_block - 1) / samples_per_block) ||
+        (sections[AnimationSection_BLOCKS].count != num_blocks))
+        return 0;
+    
+    for (s32 b = 0; b < num_blocks; b++) {
+        Cooked_Clip_Block *cooked_block = &cooked_blocks[b];
+        if (!cooked_block->data || (cooked_block->size > file.count - (u64)(cooked_block->data - file.data))) return 0;
+    }
+    
+    Arena_Temp temp = arena_temp_begin(arena);
+    
+    Clip_Stream *stream       = PUSH_STRUCT_ZERO(arena, Clip_Stream);
+    stream->path              = str8_copy(arena, cooked_path);
+    stream->samples_per_block = samples_per_block;
+    stream->num_blocks        = num_blocks;
+    stream->has_root_motion   = cooked->has_root_motion;
+    stream->loop_root_motion  = cooked->loop_root_motion;
+    stream->blocks            = PUSH_ARRAY_ZERO(arena, Clip_Block, num_blocks);
+    for (s32 b = 0; b < num_blocks; b++) {
+        Clip_Block *block   = &stream->blocks[b];
+        block->stream       = stream;
+        block->first_sample = b * samples_per_block;
+        block->num_samples  = MIN(samples_per_block + 1, info->num_samples - block->first_sample);
+        block->file_offset  = (u64)(cooked_blocks[b].data - file.data);
+        block->file_size    = cooked_blocks[b].size;
+    }
+    
+    // The first block stays resident for good.
+    Clip_Block *block = &stream->blocks[0];
+    if (!read_clip_block(block, cooked_blocks[0].data)) {
+        arena_temp_end(temp);
+        return 0;
+    }
+    block->state = ClipBlockState_RESIDENT;
+    
+    return stream;
+}
+
+//~ Cooked Animations
+//
+FUNCTION String8 get_cooked_animation_path(Arena *arena, String8 full_path)
+{
+    return sprint(arena, "%S.cooked_animation", chop_extension(full_path));
+}
+
+FUNCTION b32 load_and_cook_sampled_animation(Arena *arena, Sampled_Animation *anim, String8 file, String8 full_path)
+{
+    // Loads anim from the contents of a .sampled_animation, then computes its root motion and reference
+    // pose and compresses it. Returns FALSE if the file is broken.
+    
+    if (!validate_sampled_animation_data(file, full_path)) return FALSE;
+    
+    read_sampled_animation_header(arena, anim, &file, full_path);
+    
+    // Allocate sample streams. If we're compressing, the raw streams only live until we're done compressing.
+    Arena_Temp scratch   = get_scratch(&arena, 1);
+    Arena *stream_arena  = COMPRESS_ANIMATIONS? scratch.arena : arena;
+    read_sample_streams(stream_arena, anim, &file);
+    
+    // Root motion track, relative to the first sample.
+    if (anim->joints[0].parent_id < 0) {
+        anim->root_motion = PUSH_ARRAY(arena, Root_Motion_Sample, anim->num_samples);
+        build_root_motion(anim, anim->translations[0], anim->rotations[0], anim->root_motion);
+    }
+    
+    set_reference_pose(arena, anim);
+    
+    if (COMPRESS_ANIMATIONS) {
+        compress_sampled_animation(arena, anim);
+        
+        anim->rotations    = 0;
+        anim->translations = 0;
+        anim->scales       = 0;
+    }
+    free_scratch(scratch);
+    
+    ASSERT(file.count == 0);
+    return TRUE;
+}
+
+FUNCTION void get_compressed_clip_key_counts(Compressed_Clip *clip, s32 *num_keys)
+{
+    // One per Track_Kind. Tracks are stored one after the other, so the last one ends where the keys do.
+    num_keys[TrackKind_ROTATION]    = clip->num_rotation_tracks?    (s32)(clip->rotation_tracks   [clip->num_rotation_tracks    - 1].first_key + clip->rotation_tracks   [clip->num_rotation_tracks    - 1].num_keys) : 0;
+    num_keys[TrackKind_TRANSLATION] = clip->num_translation_tracks? (s32)(clip->translation_tracks[clip->num_translation_tracks - 1].first_key + clip->translation_tracks[clip->num_translation_tracks - 1].num_keys) : 0;
+    num_keys[TrackKind_SCALE]       = clip->num_scale_tracks?       (s32)(clip->scale_tracks      [clip->num_scale_tracks       - 1].first_key + clip->scale_tracks      [clip->num_scale_tracks       - 1].num_keys) : 0;
+}
+
+FUNCTION u64 get_compressed_clip_blob_size(Compressed_Clip *clip, s32 num_joints)
+{
+    // Upper bound of what write_compressed_clip() adds to the blobs.
+    
+    s32 num_keys[3];
+    get_compressed_clip_key_counts(clip, num_keys);
+    
+    u64 size = num_joints * (sizeof(Quaternion) + sizeof(V3) + sizeof(f32));
+    size    += (clip->num_rotation_tracks + clip->num_translation_tracks + clip->num_scale_tracks) * sizeof(Compressed_Track);
+    size    += clip->num_translation_tracks * 2*sizeof(V3) + clip->num_scale_tracks * 2*sizeof(f32);
+    size    += (num_keys[TrackKind_ROTATION] + num_keys[TrackKind_TRANSLATION] + num_keys[TrackKind_SCALE]) * sizeof(u16);
+    size    += num_keys[TrackKind_ROTATION]*sizeof(Quantized_Quaternion) + num_keys[TrackKind_TRANSLATION]*3*sizeof(u16) + num_keys[TrackKind_SCALE]*sizeof(u16);
+    
+    // 16 pointers in the clip, each aligned to a cache line at most.
+    size += 16*SAMPLE_STREAM_ALIGNMENT;
+    return size;
+}
+
+FUNCTION void write_compressed_clip(Cooked_File_Writer *writer, Compressed_Clip *c, Compressed_Clip *clip, s32 num_joints)
+{
+    // Copies clip to c, a Compressed_Clip inside the file, and its arrays to the blobs. Takes 16 fixups.
+    
+    s32 num_keys[3];
+    get_compressed_clip_key_counts(clip, num_keys);
+    
+    *c    = *clip;
+    u64 a = SAMPLE_STREAM_ALIGNMENT;
+    write_cooked_blob(writer, &c->constant_pose.rotations,    clip->constant_pose.rotations,    num_joints * sizeof(Quaternion), a);
+    write_cooked_blob(writer, &c->constant_pose.translations, clip->constant_pose.translations, num_joints * sizeof(V3),         a);
+    write_cooked_blob(writer, &c->constant_pose.scales,       clip->constant_pose.scales,       num_joints * sizeof(f32),        a);
+    
+    write_cooked_blob(writer, &c->rotation_tracks,    clip->rotation_tracks,    clip->num_rotation_tracks    * sizeof(Compressed_Track), alignof(Compressed_Track));
+    write_cooked_blob(writer, &c->translation_tracks, clip->translation_tracks, clip->num_translation_tracks * sizeof(Compressed_Track), alignof(Compressed_Track));
+    write_cooked_blob(writer, &c->scale_tracks,       clip->scale_tracks,       clip->num_scale_tracks       * sizeof(Compressed_Track), alignof(Compressed_Track));
+    
+    write_cooked_blob(writer, &c->translation_mins,    clip->translation_mins,    clip->num_translation_tracks * sizeof(V3),  alignof(V3));
+    write_cooked_blob(writer, &c->translation_extents, clip->translation_extents, clip->num_translation_tracks * sizeof(V3),  alignof(V3));
+    write_cooked_blob(writer, &c->scale_mins,          clip->scale_mins,          clip->num_scale_tracks       * sizeof(f32), alignof(f32));
+    write_cooked_blob(writer, &c->scale_extents,       clip->scale_extents,       clip->num_scale_tracks       * sizeof(f32), alignof(f32));
+    
+    write_cooked_blob(writer, &c->rotation_key_samples,    clip->rotation_key_samples,    num_keys[TrackKind_ROTATION]    * sizeof(u16), alignof(u16));
+    write_cooked_blob(writer, &c->translation_key_samples, clip->translation_key_samples, num_keys[TrackKind_TRANSLATION] * sizeof(u16), alignof(u16));
+    write_cooked_blob(writer, &c->scale_key_samples,       clip->scale_key_samples,       num_keys[TrackKind_SCALE]       * sizeof(u16), alignof(u16));
+    
+    write_cooked_blob(writer, &c->rotation_keys,    clip->rotation_keys,    num_keys[TrackKind_ROTATION]    * sizeof(Quantized_Quaternion), a);
+    write_cooked_blob(writer, &c->translation_keys, clip->translation_keys, num_keys[TrackKind_TRANSLATION] * 3*sizeof(u16),            a);
+    write_cooked_blob(writer, &c->scale_keys,       clip->scale_keys,       num_keys[TrackKind_SCALE]       * sizeof(u16),              a);
+}
+
+FUNCTION Cooked_File_Writer begin_cooked_animation(Arena *arena, Sampled_Animation *anim, s64 *counts, u64 max_blob_size, s64 max_fixups)
+{
+    // Starts a .cooked_animation and writes what every clip has: the info, joints and reference pose. 
+    // counts doesn't need the counts of those.
+    
+    s32 num_joints = (s32)anim->joints.count;
+    counts[AnimationSection_INFO]           = 1;
+    counts[AnimationSection_JOINTS]         = num_joints;
+    counts[AnimationSection_REFERENCE_POSE] = num_joints;
+    for (s32 i = 0; i < num_joints; i++)
+        max_blob_size += anim->joints[i].name.count + 1;
+    
+    Cooked_File_Writer writer = begin_cooked_file(arena, &ANIMATION_COOKED_FILE, counts, max_blob_size, max_fixups + num_joints);
+    
+    Animation_Cooked_Info *info = (Animation_Cooked_Info *) get_section_data(&writer, AnimationSection_INFO);
+    info->duration              = anim->duration;
+    info->num_samples           = anim->num_samples;
+    info->frame_rate            = anim->frame_rate;
+    
+    Pose_Joint_Info *joints = (Pose_Joint_Info *) get_section_data(&writer, AnimationSection_JOINTS);
+    for (s32 i = 0; i < num_joints; i++) {
+        joints[i] = anim->joints[i];
+        write_cooked_string(&writer, &joints[i].name);
+    }
+    
+    MEMORY_COPY(get_section_data(&writer, AnimationSection_REFERENCE_POSE), anim->reference_pose, num_joints * sizeof(SQT));
+    return writer;
+}
+
+FUNCTION String8 build_cooked_animation(Arena *arena, Sampled_Animation *anim, u64 source_date, u64 source_size, u64 source_hash)
+{
+    // Returns the .cooked_animation of a compressed clip (see load_and_cook_sampled_animation()).
+    
+    Compressed_Clip *clip = anim->compressed;
+    ASSERT(clip);
+    
+    s64 counts[AnimationSection_COUNT] = {};
+    counts[AnimationSection_ROOT_MOTION] = anim->root_motion? anim->num_samples : 0;
+    counts[AnimationSection_CLIP]        = 1;
+    
+    s32 num_joints            = (s32)anim->joints.count;
+    u64 max_blob_size         = get_compressed_clip_blob_size(clip, num_joints);
+    Cooked_File_Writer writer = begin_cooked_animation(arena, anim, counts, max_blob_size, 16);
+    
+    if (anim->root_motion)
+        MEMORY_COPY(get_section_data(&writer, AnimationSection_ROOT_MOTION), anim->root_motion, anim->num_samples * sizeof(Root_Motion_Sample));
+    
+    write_compressed_clip(&writer, (Compressed_Clip *) get_section_data(&writer, AnimationSection_CLIP), clip, num_joints);
+    
+    return end_cooked_file(&writer, source_date, source_size, source_hash);
+}
+
+FUNCTION String8 build_cooked_clip_block(Arena *arena, Compressed_Clip *clip, s32 num_joints, Root_Motion_Sample *root_motion, s32 num_samples)
+{
+    // Returns the cooked clip block of one block of a streamed clip; root_motion is the block's samples
+    // of the clip's root motion, or null.
+    
+    s64 counts[ClipBlockSection_COUNT] = {};
+    counts[ClipBlockSection_CLIP]        = 1;
+    counts[ClipBlockSection_ROOT_MOTION] = root_motion? num_samples : 0;
+    
+    Cooked_File_Writer writer = begin_cooked_file(arena, &CLIP_BLOCK_COOKED_FILE, counts, get_compressed_clip_blob_size(clip, num_joints), 16);
+    if (root_motion)
+        MEMORY_COPY(get_section_data(&writer, ClipBlockSection_ROOT_MOTION), root_motion, num_samples * sizeof(Root_Motion_Sample));
+    
+    write_compressed_clip(&writer, (Compressed_Clip *) get_section_data(&writer, ClipBlockSection_CLIP), clip, num_joints);
+    
+    return end_cooked_file(&writer, 0, 0, 0);
+}
+
+FUNCTION String8 cook_streamed_animation(Arena *arena, String8 file, String8 full_path, u64 source_date, u64 source_size, u64 source_hash)
+{
+    // @Note: Returns the .cooked_animation of a streamed clip from the contents of its .sampled_animation,
+    // or an empty string if the file is broken. Root motion and the reference pose come from the whole 
+    // clip like in load_and_cook_sampled_animation(), but every block is reduced and compressed on its own
+    // and goes in as a cooked clip block, so the game only has to read it (see Clip Streaming).
+    
+    if (!validate_sampled_animation_data(file, full_path)) return {};
+    
+    Arena_Temp scratch = get_scratch(&arena, 1);
+    defer(free_scratch(scratch));
+    
+    Sampled_Animation anim = {};
+    read_sampled_animation_header(scratch.arena, &anim, &file, full_path);
+    read_sample_streams(scratch.arena, &anim, &file);
+    set_reference_pose(scratch.arena, &anim);
+    if (anim.joints[0].parent_id < 0) {
+        anim.root_motion = PUSH_ARRAY(scratch.arena, Root_Motion_Sample, anim.num_samples);
+        build_root_motion(&anim, anim.translations[0], anim.rotations[0], anim.root_motion);
+    }
+    
+    s32 num_joints        = (s32)anim.joints.count;
+    s32 samples_per_block = get_samples_per_clip_block(anim.frame_rate);
+    s32 num_blocks        = get_clip_block_count(anim.frame_rate, anim.num_samples);
+    ASSERT(num_blocks > 0);
+    
+    // Blocks share their boundary sample (see Clip_Block). The sample streams are sample-major, so a 
+    // block's samples are a run of each stream.
+    String8 *blocks   = PUSH_ARRAY(scratch.arena, String8, num_blocks);
+    u64 max_blob_size = 0;
+    for (s32 b = 0; b < num_blocks; b++) {
+        s32 first_sample = b * samples_per_block;
+        s64 first        = (s64)first_sample * num_joints;
+        
+        Sampled_Animation part = {};
+        part.joints            = anim.joints;
+        part.num_samples       = MIN(samples_per_block + 1, anim.num_samples - first_sample);
+        part.frame_rate        = anim.frame_rate;
+        part.duration          = (part.num_samples - 1) / (f64)anim.frame_rate;
+        part.rotations         = anim.rotations    + first;
+        part.translations      = anim.translations + first;
+        part.scales            = anim.scales       + first;
+        compress_sampled_animation(scratch.arena, &part);
+        
+        Root_Motion_Sample *root_motion = anim.root_motion? anim.root_motion + first_sample : 0;
+        blocks[b]      = build_cooked_clip_block(scratch.arena, part.compressed, num_joints, root_motion, part.num_samples);
+        max_blob_size += blocks[b].count + COOKED_FILE_ALIGNMENT;
+    }
+    
+    s64 counts[AnimationSection_COUNT] = {};
+    counts[AnimationSection_STREAM] = 1;
+    counts[AnimationSection_BLOCKS] = num_blocks;
+    Cooked_File_Writer writer       = begin_cooked_animation(arena, &anim, counts, max_blob_size, num_blocks);
+    
+    Animation_Cooked_Stream *stream = (Animation_Cooked_Stream *) get_section_data(&writer, AnimationSection_STREAM);
+    stream->samples_per_block       = samples_per_block;
+    stream->num_blocks              = num_blocks;
+    stream->has_root_motion         = (anim.root_motion != 0);
+    if (anim.root_motion)
+        stream->loop_root_motion = anim.root_motion[anim.num_samples - 1];
+    
+    Cooked_Clip_Block *cooked_blocks = (Cooked_Clip_Block *) get_section_data(&writer, AnimationSection_BLOCKS);
+    for (s32 b = 0; b < num_blocks; b++) {
+        write_cooked_blob(&writer, &cooked_blocks[b].data, blocks[b].data, blocks[b].count, COOKED_FILE_ALIGNMENT);
+        cooked_blocks[b].size = blocks[b].count;
+    }
+    
+    return end_cooked_file(&writer, source_date, source_size, source_hash);
+}
+
+FUNCTION b32 load_cooked_animation(Arena *arena, Sampled_Animation *anim, String8 full_path, String8 cooked_path, File_Info *source)
+{
+    // @Note: anim is only touched if the cooked animation is usable.
+    
+    String8 file = map_cooked_file(cooked_path, &ANIMATION_COOKED_FILE, source);
+    if (!file.data) return FALSE;
+    
+    Cooked_Section *sections    = get_cooked_sections(file);
+    Animation_Cooked_Info *info = (Animation_Cooked_Info *) get_section_data(file, AnimationSection_INFO);
+    b32 streamed                = (sections[AnimationSection_STREAM].count == 1);
+    b32 valid = (sections[AnimationSection_INFO].count == 1) &&
+        (sections[AnimationSection_JOINTS].count > 0) && (sections[AnimationSection_JOINTS].count <= MAX_JOINTS) &&
+        (sections[AnimationSection_REFERENCE_POSE].count == sections[AnimationSection_JOINTS].count);
+    if (streamed) {
+        valid = valid && STREAM_ANIMATIONS && !sections[AnimationSection_CLIP].count && !sections[AnimationSection_ROOT_MOTION].count;
+    } else {
+        valid = valid && (sections[AnimationSection_CLIP].count == 1) && !sections[AnimationSection_STREAM].count && !sections[AnimationSection_BLOCKS].count &&
+            (!sections[AnimationSection_ROOT_MOTION].count || (sections[AnimationSection_ROOT_MOTION].count == info->num_samples));
+    }
+    
+    Clip_Stream *stream = 0;
+    if (valid && streamed) {
+        stream = load_clip_stream(arena, file, cooked_path);
+        valid  = (stream != 0);
+    }
+    
+    if (!valid) {
+        debug_print("Cooked animation %S is broken, cooking it again.\n", cooked_path);
+        os->unmap_file(file.data);
+        return FALSE;
+    }
+    
+    anim->name        = str8_copy(arena, extract_base_name(full_path));
+    anim->duration    = info->duration;
+    anim->num_samples = info->num_samples;
+    anim->frame_rate  = info->frame_rate;
+    point_array_at_section(&anim->joints, file, AnimationSection_JOINTS);
+    
+    anim->reference_pose = (SQT *) get_section_data(file, AnimationSection_REFERENCE_POSE);
+    anim->stream         = stream;
+    if (!streamed)
+        anim->compressed = (Compressed_Clip *) get_section_data(file, AnimationSection_CLIP);
+    if (sections[AnimationSection_ROOT_MOTION].count)
+        anim->root_motion = (Root_Motion_Sample *) get_section_data(file, AnimationSection_ROOT_MOTION);
+    
+    return TRUE;
+}
+
+#if !COOKER
+//~ Sampled Animation Loading
+//
+FUNCTION b32 load_sampled_animation(Arena *arena, Sampled_Animation *anim, String8 full_path)
+{
+    // @Note: Clips are mapped from their cooked animation if it's up to date (run the cooker to make sure
+    // of that), otherwise we load, compress and cook them here. Long clips (see should_stream_animation())
+    // stream their blocks from the cooked animation, so we map it after cooking them; if it can't be 
+    // written, they're loaded whole.
+    
+    Arena_Temp scratch = get_scratch(&arena, 1);
+    defer(free_scratch(scratch));
+    
+    File_Group source       = os->get_all_files_in_path(scratch.arena, full_path);
+    File_Info *source_info  = source.first_file_info;
+    String8 cooked_path     = get_cooked_animation_path(scratch.arena, full_path);
+    if (COMPRESS_ANIMATIONS && source_info && load_cooked_animation(arena, anim, full_path, cooked_path, source_info))
+        return true;
+    
+    String8 file = os->read_entire_file(full_path);
+    if (!file.data) {
+        debug_print("SAMPLED ANIMATION LOAD ERROR: Couldn't load animation at %S\n", full_path);
+        return false;
+    }
+    defer(os->free_file_memory(file.data));
+    
+    u64 source_hash = get_cooked_hash(file.data, file.count);
+    
+    // Version, frame rate, number of samples and number of joints.
+    s32 counts[4] = {};
+    if (file.count >= sizeof(counts))
+        MEMORY_COPY(counts, file.data, sizeof(counts));
+    
+    if (source_info && should_stream_animation(counts[1], counts[2], counts[3])) {
+        String8 cooked = cook_streamed_animation(scratch.arena, file, full_path, source_info->file_date, source_info->file_size, source_hash);
+        if (!cooked.data) return false;
+        
+        if (os->write_entire_file(cooked_path, cooked) && load_cooked_animation(arena, anim, full_path, cooked_path, source_info))
+            return true;
+        debug_print("SAMPLED ANIMATION COOK ERROR: Couldn't stream %S from %S, loading it whole\n", full_path, cooked_path);
+    }
+    
+    if (!load_and_cook_sampled_animation(arena, anim, file, full_path)) return false;
+    
+    if (COMPRESS_ANIMATIONS && source_info && !should_stream_animation(counts[1], counts[2], counts[3])) {
+        String8 cooked = build_cooked_animation(scratch.arena, anim, source_info->file_date, source_info->file_size, source_hash);
+        if (!os->write_entire_file(cooked_path, cooked))
+            debug_print("SAMPLED ANIMATION COOK ERROR: Couldn't write cooked animation %S\n", cooked_path);
+    }
+    
+    return true;
+}
+#endif
+
+//~ Joint Remap
+//
+GLOBAL Arena *joint_remap_arena;
+
+FUNCTION Joint_Remap* get_joint_remap(Sampled_Animation *anim, Skeleton *skeleton)
+{
+    // @Note: Returns the table that maps anim's joints to skeleton's, or null if they match one to one.
+    // The table is built the first time we see the pair and kept with the clip. Only call this from the 
+    // main thread (playing animations, set_mesh()); eval() only reads the tables.
+    
+    if (!anim || !skeleton) return 0;
+    
+    for (Joint_Remap *remap = anim->joint_remaps; remap; remap = remap->next) {
+        if (remap->skeleton == skeleton) return remap->identity? 0 : remap;
+    }
+    
+    if (!joint_remap_arena)
+        joint_remap_arena = arena_init();
+    Arena *arena = joint_remap_arena;
+    
+    s32 num_clip_joints     = (s32)anim->joints.count;
+    s32 num_skeleton_joints = (s32)skeleton->joint_info.count;
+    ASSERT(num_skeleton_joints <= S16_MAX);
+    
+    Joint_Remap *remap        = PUSH_STRUCT_ZERO(arena, Joint_Remap);
+    remap->skeleton           = skeleton;
+    remap->skeleton_from_clip = PUSH_ARRAY(arena, s16, num_clip_joints);
+    remap->next               = anim->joint_remaps;
+    anim->joint_remaps        = remap;
+    
+    Arena_Temp scratch = get_scratch(&arena, 1);
+    defer(free_scratch(scratch));
+    
+    b32 *driven      = PUSH_ARRAY_ZERO(scratch.arena, b32, num_skeleton_joints);
+    s32 num_unmatched = 0;
+    remap->identity  = (num_clip_joints == num_skeleton_joints);
+    
+    // Joints are usually in the same order, so try the same index before searching.
+    for (s32 c = 0; c < num_clip_joints; c++) {
+        String8 name = anim->joints[c].name;
+        
+        s32 s = -1;
+        if ((c < num_skeleton_joints) && (skeleton->joint_info[c].name == name)) {
+            s = c;
+        } else {
+            for (s32 i = 0; (i < num_skeleton_joints) && (s < 0); i++) {
+                if (skeleton->joint_info[i].name == name) s = i;
+            }
+        }
+        
+        if (s < 0)           num_unmatched++;
+        else if (driven[s])  s = -1; // Two clip joints with the same name, the first one wins.
+        if (s >= 0)          driven[s] = TRUE;
+        if (s != c)          remap->identity = FALSE;
+        
+        remap->skeleton_from_clip[c] = (s16)s;
+    }
+    
+    if (remap->identity) return 0;
+    
+    if (num_unmatched)
+        debug_print("Animation %S: %d joints aren't in the skeleton, ignoring them.\n", anim->name, num_unmatched);
+    
+    //
+    // Joints the clip doesn't drive stay in their rest pose; we get it from the inverse bind matrices. 
+    // The reference pose for additive blending is the clip's where it has one.
+    //
+    remap->unmapped_joints = PUSH_ARRAY(arena, s32, num_skeleton_joints);
+    remap->rest_pose       = PUSH_ARRAY(arena, SQT, num_skeleton_joints);
+    remap->reference_pose  = PUSH_ARRAY(arena, SQT, num_skeleton_joints);
+    for (s32 s = 0; s < num_skeleton_joints; s++) {
+        Skeleton_Joint_Info *joint = &skeleton->joint_info[s];
+        
+        M4x4 joint_to_object = m4x4_identity();
+        invert(m4x4(joint->object_to_joint_matrix), &joint_to_object);
+        
+        M4x4 local = joint_to_object;
+        if (joint->parent_id >= 0)
+            local = m4x4(skeleton->joint_info[joint->parent_id].object_to_joint_matrix) * joint_to_object;
+        
+        V3 scale = get_scale(local);
+        remap->rest_pose[s].rotation    = joint->rest_pose_rotation_relative;
+        remap->rest_pose[s].translation = get_translation(m3x4(local));
+        remap->rest_pose[s].scale       = (scale.x + scale.y + scale.z) / 3.0f;
+        remap->reference_pose[s]        = remap->rest_pose[s];
+        
+        if (!driven[s])
+            remap->unmapped_joints[remap->num_unmapped_joints++] = s;
+    }
+    for (s32 c = 0; c < num_clip_joints; c++) {
+        s32 s = remap->skeleton_from_clip[c];
+        if (s >= 0) remap->reference_pose[s] = anim->reference_pose[c];
+    }
+    
+    return remap;
+}
+
+FUNCTION void write_unmapped_joints(Joint_Remap *remap, SQT *out, u64 const *skip_joints)
+{
+    for (s32 i = 0; i < remap->num_unmapped_joints; i++) {
+        s32 s = remap->unmapped_joints[i];
+        if (skip_joints && ((skip_joints[s / 64] >> (s % 64)) & 1)) continue;
+        
+        out[s] = remap->rest_pose[s];
+    }
+}
+
+//~ Blend Space
+//
+FUNCTION Blend_Space* compile_blend_space(Arena *arena, Catalog<Sampled_Animation> *catalog, Blend_Space_Desc const *desc)
+{
+    ASSERT(desc->num_samples > 0);
+    
+    Blend_Space *space   = PUSH_STRUCT_ZERO(arena, Blend_Space);
+    space->samples       = PUSH_ARRAY_ZERO(arena, Blend_Space_Sample, desc->num_samples);
+    space->num_samples   = desc->num_samples;
+    space->triangles     = PUSH_ARRAY(arena, s32, 3*desc->num_triangles);
+    space->num_triangles = desc->num_triangles;
+    MEMORY_COPY(space->triangles, desc->triangles, 3*desc->num_triangles*sizeof(s32));
+    
+    // All clips that have markers must have the same number of them.
+    for (s32 i = 0; i < desc->num_samples; i++)
+        space->num_sync_markers = MAX(space->num_sync_markers, CLAMP(0, desc->samples[i].num_sync_markers, MAX_SYNC_MARKERS));
+    
+    for (s32 i = 0; i < desc->num_samples; i++) {
+        Blend_Space_Sample_Desc const *sample_desc = &desc->samples[i];
+        Blend_Space_Sample *sample = &space->samples[i];
+        
+        sample->animation = find(catalog, str8_cstring(sample_desc->clip));
+        sample->position  = sample_desc->position;
+        if (!sample->animation)
+            debug_print("Blend space: animation %s not found.\n", sample_desc->clip);
+        
+        s32 n = space->num_sync_markers;
+        if (sample_desc->num_sync_markers == n) {
+            MEMORY_COPY(sample->sync_markers, sample_desc->sync_markers, n*sizeof(f32));
+        } else {
+            if (sample_desc->num_sync_markers)
+                debug_print("Blend space: animation %s has %d sync markers, the others have %d. Ignoring them.\n", sample_desc->clip, sample_desc->num_sync_markers, n);
+            
+            for (s32 k = 0; k < n; k++)
+                sample->sync_markers[k] = (f32)k / (f32)n;
+        }
+    }
+    
+    // 1D spaces get searched in order. Triangles refer to samples by index, so 2D spaces stay as they are.
+    if (!space->num_triangles) {
+        for (s32 i = 1; i < space->num_samples; i++) {
+            for (s32 j = i; (j > 0) && (space->samples[j - 1].position.x > space->samples[j].position.x); j--)
+                SWAP(space->samples[j - 1], space->samples[j], Blend_Space_Sample);
+        }
+    }
+    
+    for (s32 i = 0; i < 3*space->num_triangles; i++)
+        ASSERT((space->triangles[i] >= 0) && (space->triangles[i] < space->num_samples));
+    
+    return space;
+}
+
+FUNCTION V3 get_barycentric_2d(V2 p, V2 a, V2 b, V2 c)
+{
+    V2 ab = b - a;
+    V2 ac = c - a;
+    V2 ap = p - a;
+    
+    f32 denom = ab.x*ac.y - ab.y*ac.x;
+    if (denom == 0.0f) return {1.0f, 0.0f, 0.0f};
+    
+    f32 v = (ap.x*ac.y - ap.y*ac.x) / denom;
+    f32 w = (ab.x*ap.y - ab.y*ap.x) / denom;
+    return {1.0f - v - w, v, w};
+}
+
+FUNCTION V2 closest_point_on_segment_2d(V2 p, V2 a, V2 b)
+{
+    V2 ab = b - a;
+    f32 t = CLAMP01(safe_div0(dot(p - a, ab), dot(ab, ab)));
+    return a + ab*t;
+}
+
+FUNCTION s32 get_blend_space_weights(Blend_Space *space, V2 position, s32 *samples_out, f32 *weights_out)
+{
+    // @Note: Fills up to MAX_BLEND_SPACE_WEIGHTS samples and their weights (summing to 1) and returns how many.
+    
+    Blend_Space_Sample *samples = space->samples;
+    s32 n                       = space->num_samples;
+    
+    if (!space->num_triangles) {
+        s32 i = 0;
+        while ((i + 1 < n) && (samples[i + 1].position.x <= position.x))
+            i++;
+        
+        f32 t = 0.0f;
+        if (i + 1 < n) 
+            t = CLAMP01(safe_div0(position.x - samples[i].position.x, samples[i + 1].position.x - samples[i].position.x));
+        
+        samples_out[0] = i;
+        weights_out[0] = 1.0f - t;
+        if (t <= 0.0f) return 1;
+        if (t >= 1.0f) {
+            samples_out[0] = i + 1;
+            weights_out[0] = 1.0f;
+            return 1;
+        }
+        
+        samples_out[1] = i + 1;
+        weights_out[1] = t;
+        return 2;
+    }
+    
+    // Take the triangle we're in, otherwise the closest point of the closest triangle.
+    s32 best_triangle  = 0;
+    V3  best_weights   = {1.0f, 0.0f, 0.0f};
+    f32 best_distance2 = F32_MAX;
+    for (s32 t = 0; t < space->num_triangles; t++) {
+        V2 a = samples[space->triangles[3*t + 0]].position;
+        V2 b = samples[space->triangles[3*t + 1]].position;
+        V2 c = samples[space->triangles[3*t + 2]].position;
+        
+        V3 weights = get_barycentric_2d(position, a, b, c);
+        if ((weights.x >= 0.0f) && (weights.y >= 0.0f) && (weights.z >= 0.0f)) {
+            best_triangle  = t;
+            best_weights   = weights;
+            best_distance2 = 0.0f;
+            break;
+        }
+        
+        V2 edge_points[] = {closest_point_on_segment_2d(position, a, b), closest_point_on_segment_2d(position, b, c), closest_point_on_segment_2d(position, c, a)};
+        for (s32 k = 0; k < 3; k++) {
+            f32 distance2 = length2(edge_points[k] - position);
+            if (distance2 < best_distance2) {
+                best_triangle  = t;
+                best_weights   = get_barycentric_2d(edge_points[k], a, b, c);
+                best_distance2 = distance2;
+            }
+        }
+    }
+    
+    // Points on an edge can come out a hair negative.
+    best_weights.x = MAX(best_weights.x, 0.0f);
+    best_weights.y = MAX(best_weights.y, 0.0f);
+    best_weights.z = MAX(best_weights.z, 0.0f);
+    f32 sum        = best_weights.x + best_weights.y + best_weights.z;
+    
+    s32 count = 0;
+    for (s32 k = 0; k < 3; k++) {
+        if (best_weights.I[k] <= 0.0f) continue;
+        
+        samples_out[count] = space->triangles[3*best_triangle + k];
+        weights_out[count] = best_weights.I[k] / sum;
+        count++;
+    }
+    
+    return count;
+}
+
+FUNCTION f64 get_blend_space_sample_time_unwrapped(Blend_Space *space, Blend_Space_Sample *sample, f64 phase)
+{
+    // Normalized time of the sample's clip at the shared phase, counting loops, so it only goes up as the
+    // phase does (a phase past 1 has looped once).
+    
+    s32 n = space->num_sync_markers;
+    if (!n) return phase;
+    
+    f64 u     = phase*n;
+    f64 k0    = floor(u);
+    f64 loops = floor(k0 / n);
+    s32 k     = (s32)(k0 - loops*n);
+    
+    f64 start = sample->sync_markers[k];
+    f64 end   = (k + 1 < n)? sample->sync_markers[k + 1] : sample->sync_markers[0] + 1.0;
+    return loops + start + (u - k0)*(end - start);
+}
+
+FUNCTION f64 get_blend_space_sample_time(Blend_Space *space, Blend_Space_Sample *sample, f64 phase)
+{
+    f64 result = get_blend_space_sample_time_unwrapped(space, sample, phase);
+    return result - floor(result);
+}
+
+//~ Root Motion
+//
+FUNCTION void get_root_motion(Sampled_Animation *anim, f64 time, V3 *translation_out, f32 *yaw_out)
+{
+    // @Note: Root motion from the start of the clip to time. Times past the end add the motion of a whole
+    // loop for every time the clip looped.
+    
+    V3  translation = {};
+    f32 yaw         = 0.0f;
+    
+    s32 num_samples     = anim->num_samples;
+    b32 has_root_motion = anim->stream? anim->stream->has_root_motion : (anim->root_motion != 0);
+    if (has_root_motion && num_samples && (anim->duration > 0.0)) {
+        Root_Motion_Sample loop = anim->stream? anim->stream->loop_root_motion : anim->root_motion[num_samples - 1];
+        
+        s32 num_loops = (s32)MAX(0.0, floor(time / anim->duration));
+        time         -= num_loops * anim->duration;
+        for (s32 i = 0; i < num_loops; i++) {
+            translation += quaternion_from_axis_angle(V3U, yaw) * loop.translation;
+            yaw         += loop.yaw;
+        }
+        
+        // Same samples as get_lerped_joints().
+        f64 fraction;
+        s32 base = get_clip_sample(anim, time, &fraction);
+        s32 next = MIN(base + 1, num_samples - 1);
+        f32 t    = (f32)fraction;
+        
+        Root_Motion_Sample const *samples = anim->root_motion;
+        s32 first_sample                  = 0;
+        s32 last_sample                   = num_samples - 1;
+        if (anim->stream) {
+            Clip_Block *block = find_resident_block(anim->stream, base);
+            samples           = block->root_motion;
+            first_sample      = block->first_sample;
+            last_sample       = block->first_sample + block->num_samples - 1;
+        }
+        
+        Root_Motion_Sample a = samples[CLAMP(first_sample, base, last_sample) - first_sample];
+        Root_Motion_Sample b = samples[CLAMP(first_sample, next, last_sample) - first_sample];
+        translation += quaternion_from_axis_angle(V3U, yaw) * lerp(a.translation, t, b.translation);
+        yaw         += lerp(a.yaw, t, b.yaw);
+    }
+    
+    *translation_out = translation;
+    *yaw_out         = yaw;
+}
+
+FUNCTION void remove_root_motion(Sampled_Animation *anim, f64 time, SQT *root)
+{
+    // Puts the root back where it started: root motion is the entity's job when we're extracting it.
+    
+    if (!anim->root_motion && !(anim->stream && anim->stream->has_root_motion)) return;
+    
+    V3  translation;
+    f32 yaw;
+    get_root_motion(anim, time, &translation, &yaw);
+    
+    Quaternion unyaw  = quaternion_from_axis_angle(V3U, -yaw);
+    root->translation = unyaw * (root->translation - translation);
+    root->rotation    = unyaw * root->rotation;
+}
+
+//~ Animation Channel
+//
+FUNCTION s32 get_max_tracks(Sampled_Animation *anim)
+{
+    // Number of key cursors the clip can use. Blocks of streamed clips each have their own tracks, at most 
+    // three per joint.
+    
+    if (anim->stream) return 3*(s32)anim->joints.count;
+    
+    Compressed_Clip *clip = anim->compressed;
+    return clip? (clip->num_rotation_tracks + clip->num_translation_tracks + clip->num_scale_tracks) : 0;
+}
+
+FUNCTION void set_animation(Animation_Channel *channel, Sampled_Animation *anim, f64 t0)
+{
+    if (anim) {
+        if (anim->num_samples == 0 || anim->joints.count == 0) {
+            debug_print("Animation %S has no samples or joints, can't set it for channel.\n", anim->name);
+            anim = 0;
+        }
+    }
+    
+    channel->animation_duration = 0.0;
+    channel->clock_duration     = 0;
+    
+    if (!anim) return;
+    
+    channel->animation          = anim;
+    channel->animation_duration = anim->duration;
+    channel->clock_duration     = get_clip_clock_duration(anim);
+    channel->remap              = get_joint_remap(anim, channel->skeleton);
+    
+    channel->time_multiplier = 1.0f;
+    channel->is_looping      = TRUE;
+    channel->is_completed    = FALSE;
+    channel->num_loops       = 0;
+    //channel->is_active       = TRUE;
+    set_channel_time(channel, t0);
+    channel->old_clock = channel->clock;
+    channel->old_time  = channel->current_time;
+    
+    // Start the key cursors from scratch; find_key() fixes them up on the first eval. Loading refuses clips
+    // with more joints than MAX_JOINTS, but if one gets here anyway it samples without cursors.
+    s32 num_tracks = get_max_tracks(anim);
+    channel->num_key_cursors = (num_tracks <= MAX_CHANNEL_KEY_CURSORS)? num_tracks : 0;
+    MEMORY_ZERO(channel->key_cursors, sizeof(channel->key_cursors));
+}
+
+FUNCTION void advance_time(Animation_Channel *channel, s64 dt)
+{
+    // @Note: Advances the clock by dt ticks, scaled by the time multiplier. Looping channels wrap as many 
+    // times as it takes (num_loops counts them), the others complete when they hit either end.
+    
+    if (!channel) return;
+    
+    channel->old_clock = channel->clock;
+    channel->old_time  = channel->current_time;
+    channel->num_loops = 0;
+    
+    s64 step = dt;
+    if (channel->time_multiplier != 1.0f)
+        step = (s64) floor((f64)dt * (f64)channel->time_multiplier + 0.5);
+    if (!step) return;
+    
+    s64 clock    = channel->clock + step;
+    s64 duration = channel->clock_duration;
+    if (channel->is_looping && (duration > 0)) {
+        s64 loops = clock / duration;
+        if (clock % duration < 0) loops--;
+        
+        channel->num_loops = (s32)loops;
+        clock             -= loops * duration;
+    } else if ((clock >= duration) || (clock <= 0)) {
+        channel->is_completed = TRUE;
+    }
+    
+    set_channel_clock(channel, clock);
+}
+
+FUNCTION void set_blend_space_position(Animation_Channel *channel, V2 position)
+{
+    // @Note: Moving the blend position changes the weighted duration; current_time is rescaled so the 
+    // shared phase stays where it was.
+    
+    Blend_Space *space = channel->blend_space;
+    if (!space) return;
+    
+    s64 old_duration = channel->clock_duration;
+    f64 phase        = (old_duration > 0)? (f64)channel->clock / (f64)old_duration : 0.0;
+    
+    channel->blend_position          = position;
+    channel->num_blend_space_weights = get_blend_space_weights(space, position, channel->blend_space_samples, channel->blend_space_weights);
+    
+    f64 duration  = 0.0;
+    f32 heaviest  = 0.0f;
+    channel->animation = 0;
+    channel->remap     = 0;
+    for (s32 i = 0; i < channel->num_blend_space_weights; i++) {
+        Sampled_Animation *anim = space->samples[channel->blend_space_samples[i]].animation;
+        f32 weight              = channel->blend_space_weights[i];
+        
+        channel->blend_space_remaps[i] = get_joint_remap(anim, channel->skeleton);
+        if (!anim) continue;
+        
+        duration += weight * anim->duration;
+        if (weight > heaviest) {
+            heaviest           = weight;
+            channel->animation = anim;
+            channel->remap     = channel->blend_space_remaps[i];
+        }
+    }
+    
+    channel->animation_duration = duration;
+    channel->clock_duration     = seconds_to_animation_clock(duration);
+    if (channel->clock_duration != old_duration)
+        set_channel_clock(channel, (s64) floor(phase * (f64)channel->clock_duration + 0.5));
+}
+
+FUNCTION void set_blend_space(Animation_Channel *channel, Blend_Space *space, V2 position, f64 t0)
+{
+    // @Note: Like set_animation(), but the channel plays the clips of space around position (see 
+    // set_blend_space_position()). t0 is in seconds of the weighted duration at position.
+    
+    channel->blend_space        = space;
+    channel->animation_duration = 0.0;
+    channel->clock_duration     = 0;
+    channel->clock              = 0;
+    set_blend_space_position(channel, position);
+    
+    channel->time_multiplier = 1.0f;
+    channel->is_looping      = TRUE;
+    channel->is_completed    = FALSE;
+    channel->num_loops       = 0;
+    set_channel_time(channel, t0);
+    channel->old_clock = channel->clock;
+    channel->old_time  = channel->current_time;
+    
+    // eval_blend_space() splits the key cursors between the clips it samples.
+    channel->num_key_cursors = 0;
+    MEMORY_ZERO(channel->key_cursors, sizeof(channel->key_cursors));
+}
+
+FUNCTION void get_root_motion_delta(Animation_Channel *channel, f64 t0, f64 t1, V3 *translation_out, f32 *yaw_out)
+{
+    // @Note: Root motion of the channel going from t0 to t1 (past the end if it looped in between), in the
+    // frame the root was in at t0. Yaws are wrapped to half a turn; streamed clips only know them up to 
+    // whole turns, and nothing turns that fast in a tick.
+    
+    V3  translation = {};
+    f32 yaw         = 0.0f;
+    
+    if (channel->blend_space) {
+        Blend_Space *space = channel->blend_space;
+        f64 duration       = channel->animation_duration;
+        f64 phase0         = (duration > 0.0)? t0 / duration : 0.0;
+        f64 phase1         = (duration > 0.0)? t1 / duration : 0.0;
+        
+        for (s32 i = 0; i < channel->num_blend_space_weights; i++) {
+            Blend_Space_Sample *sample = &space->samples[channel->blend_space_samples[i]];
+            if (!sample->animation) continue;
+            
+            f64 sample_duration = sample->animation->duration;
+            V3 translation0, translation1;
+            f32 yaw0, yaw1;
+            get_root_motion(sample->animation, get_blend_space_sample_time_unwrapped(space, sample, phase0) * sample_duration, &translation0, &yaw0);
+            get_root_motion(sample->animation, get_blend_space_sample_time_unwrapped(space, sample, phase1) * sample_duration, &translation1, &yaw1);
+            
+            f32 w        = channel->blend_space_weights[i];
+            translation += (quaternion_from_axis_angle(V3U, -yaw0) * (translation1 - translation0)) * w;
+            yaw         += normalize_axis(yaw1 - yaw0) * w;
+        }
+    } else if (channel->animation) {
+        V3 translation0, translation1;
+        f32 yaw0, yaw1;
+        get_root_motion(channel->animation, t0, &translation0, &yaw0);
+        get_root_motion(channel->animation, t1, &translation1, &yaw1);
+        
+        translation = quaternion_from_axis_angle(V3U, -yaw0) * (translation1 - translation0);
+        yaw         = normalize_axis(yaw1 - yaw0);
+    }
+    
+    *translation_out = translation;
+    *yaw_out         = yaw;
+}
+
+FUNCTION void lerp_pose_samples_scalar(Pose_Sample a, f32 t, Pose_Sample b, s32 first_joint, s32 num_joints, SQT *out, s16 const *remap = 0)
+{
+    for (s32 i = first_joint; i < num_joints; i++) {
+        s32 o = remap? remap[i] : i;
+        if (o < 0) continue;
+        
+        out[o].rotation    = nlerp_short_path(a.rotations[i], t, b.rotations[i]);
+        out[o].translation =  lerp(a.translations[i], t, b.translations[i]);
+        out[o].scale       =  lerp(a.scales[i],       t, b.scales[i]);
+    }
+}
+
+FUNCTION void lerp_pose_samples(Pose_Sample a, f32 t, Pose_Sample b, s32 num_joints, SQT *out, s16 const *remap = 0)
+{
+    // @Note: Batch version of lerp(SQT, f32, SQT). Interpolates 4 joints per iteration with SSE and does 
+    // the remaining joints with the scalar path. With a remap, joint i goes to out[remap[i]] (nowhere if -1).
+    
+    s32 i = 0;
+    
+#if POSE_SAMPLING_SIMD
+    SQT unmapped; // Where joints with no remap target go.
+    __m128 t4       = _mm_set1_ps(t);
+    __m128 one_t4   = _mm_set1_ps(1.0f - t);
+    __m128 zero     = _mm_setzero_ps();
+    __m128 half     = _mm_set1_ps(0.5f);
+    __m128 three    = _mm_set1_ps(3.0f);
+    __m128 one      = _mm_set1_ps(1.0f);
+    __m128 sign_bit = _mm_set1_ps(-0.0f);
+    
+    for (; i + 4 <= num_joints; i += 4) {
+        //
+        // Rotations: transpose 4 quaternions into x, y, z, w lanes.
+        //
+        __m128 ax = _mm_loadu_ps(a.rotations[i + 0].I);
+        __m128 ay = _mm_loadu_ps(a.rotations[i + 1].I);
+        __m128 az = _mm_loadu_ps(a.rotations[i + 2].I);
+        __m128 aw = _mm_loadu_ps(a.rotations[i + 3].I);
+        _MM_TRANSPOSE4_PS(ax, ay, az, aw);
+        
+        __m128 bx = _mm_loadu_ps(b.rotations[i + 0].I);
+        __m128 by = _mm_loadu_ps(b.rotations[i + 1].I);
+        __m128 bz = _mm_loadu_ps(b.rotations[i + 2].I);
+        __m128 bw = _mm_loadu_ps(b.rotations[i + 3].I);
+        _MM_TRANSPOSE4_PS(bx, by, bz, bw);
+        
+        // Neighborhood operator: negate b where dot(a, b) < 0 so we take the short route.
+        __m128 d    = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), 
+                                 _mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+        __m128 flip = _mm_and_ps(_mm_cmplt_ps(d, zero), sign_bit);
+        bx = _mm_xor_ps(bx, flip);
+        by = _mm_xor_ps(by, flip);
+        bz = _mm_xor_ps(bz, flip);
+        bw = _mm_xor_ps(bw, flip);
+        
+        __m128 rx = _mm_add_ps(_mm_mul_ps(ax, one_t4), _mm_mul_ps(bx, t4));
+        __m128 ry = _mm_add_ps(_mm_mul_ps(ay, one_t4), _mm_mul_ps(by, t4));
+        __m128 rz = _mm_add_ps(_mm_mul_ps(az, one_t4), _mm_mul_ps(bz, t4));
+        __m128 rw = _mm_add_ps(_mm_mul_ps(aw, one_t4), _mm_mul_ps(bw, t4));
+        
+        // Normalize with rsqrt + one Newton-Raphson step. Zero-length results become identity like normalize_or_identity().
+        __m128 len2    = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, rx), _mm_mul_ps(ry, ry)), 
+                                    _mm_add_ps(_mm_mul_ps(rz, rz), _mm_mul_ps(rw, rw)));
+        __m128 inv_len = _mm_rsqrt_ps(len2);
+        inv_len        = _mm_mul_ps(_mm_mul_ps(half, inv_len), _mm_sub_ps(three, _mm_mul_ps(len2, _mm_mul_ps(inv_len, inv_len))));
+        __m128 valid   = _mm_cmpgt_ps(len2, zero);
+        inv_len        = _mm_and_ps(inv_len, valid);
+        
+        rx = _mm_mul_ps(rx, inv_len);
+        ry = _mm_mul_ps(ry, inv_len);
+        rz = _mm_mul_ps(rz, inv_len);
+        rw = _mm_or_ps(_mm_mul_ps(rw, inv_len), _mm_andnot_ps(valid, one));
+        
+        SQT *dst[4];
+        for (s32 k = 0; k < 4; k++) {
+            s32 o  = remap? remap[i + k] : i + k;
+            dst[k] = (o >= 0)? &out[o] : &unmapped;
+        }
+        
+        _MM_TRANSPOSE4_PS(rx, ry, rz, rw);
+        _mm_storeu_ps(dst[0]->rotation.I, rx);
+        _mm_storeu_ps(dst[1]->rotation.I, ry);
+        _mm_storeu_ps(dst[2]->rotation.I, rz);
+        _mm_storeu_ps(dst[3]->rotation.I, rw);
+        
+        //
+        // Translations and scales: plain lerps over the flat floats of the streams (12 + 4 floats for 4 joints).
+        //
+        f32 *at = a.translations[i].I;
+        f32 *bt = b.translations[i].I;
+        f32 lerped_t[12];
+        f32 lerped_s[4];
+        for (s32 k = 0; k < 12; k += 4) {
+            __m128 va = _mm_loadu_ps(at + k);
+            __m128 vb = _mm_loadu_ps(bt + k);
+            _mm_storeu_ps(lerped_t + k, _mm_add_ps(_mm_mul_ps(va, one_t4), _mm_mul_ps(vb, t4)));
+        }
+        __m128 sa = _mm_loadu_ps(a.scales + i);
+        __m128 sb = _mm_loadu_ps(b.scales + i);
+        _mm_storeu_ps(lerped_s, _mm_add_ps(_mm_mul_ps(sa, one_t4), _mm_mul_ps(sb, t4)));
+        
+        for (s32 k = 0; k < 4; k++) {
+            dst[k]->translation = {lerped_t[k*3 + 0], lerped_t[k*3 + 1], lerped_t[k*3 + 2]};
+            dst[k]->scale       = lerped_s[k];
+        }
+    }
+#endif
+    
+    lerp_pose_samples_scalar(a, t, b, i, num_joints, out, remap);
+}
+
+FUNCTION void get_lerped_joints(Sampled_Animation *anim, f64 time, SQT *joints_out, u16 *key_cursors = 0, u64 const *skip_joints = 0, s16 const *remap = 0)
+{
+    // @Todo: max_index parameter? What is it for? To ignore some joint children?
+    
+    s32 num_joints = (s32)anim->joints.count;
+    if (!num_joints) return;
+    
+    s32 num_samples = anim->num_samples;
+    if (!num_samples) return;
+    
+    // Figure out which samples we lie between, and the fraction/t-value between them.
+    f64 fraction;
+    s32 base_index = get_clip_sample(anim, time, &fraction);
+    s32 next_index = MIN(base_index + 1, num_samples - 1);
+    if (DISABLE_LERPS) fraction = 0.0;
+    
+    // Streamed animations sample the block the base sample is in (or hold the last one we have).
+    if (anim->stream) {
+        Clip_Block *block   = find_resident_block(anim->stream, base_index);
+        f64 position        = (f64)(base_index - block->first_sample) + fraction;
+        f32 sample_position = (f32)CLAMP(0.0, position, (f64)(block->num_samples - 1));
+        sample_compressed_clip(block->clip, num_joints, sample_position, key_cursors, joints_out, skip_joints, remap);
+        return;
+    }
+    
+    // Compressed animations have variable-rate keys per track.
+    if (anim->compressed) {
+        f32 sample_position = (f32)((f64)base_index + fraction);
+        sample_compressed_clip(anim->compressed, num_joints, sample_position, key_cursors, joints_out, skip_joints, remap);
+        return;
+    }
+    
+    // Base and next sample are adjacent in each stream.
+    Pose_Sample a = get_pose_sample(anim, base_index);
+    Pose_Sample b = get_pose_sample(anim, next_index);
+    
+    // Calculate the lerped joint transforms.
+    if (DISABLE_LERPS) {
+        lerp_pose_samples_scalar(a, 0.0f, a, 0, num_joints, joints_out, remap);
+    } else {
+        lerp_pose_samples(a, (f32)fraction, b, num_joints, joints_out, remap);
+    }
+}
+
+FUNCTION void sample_clip_for_skeleton(Sampled_Animation *anim, Joint_Remap *remap, f64 time, SQT *joints_out, u16 *key_cursors, u64 const *skip_joints, b32 extract_root_motion)
+{
+    // @Note: get_lerped_joints() into the joint order of the skeleton the remap was built for (the clip's 
+    // own order if remap is null). Skeleton joints the clip doesn't have get the rest pose.
+    
+    s16 const *skeleton_from_clip = remap? remap->skeleton_from_clip : 0;
+    get_lerped_joints(anim, time, joints_out, key_cursors, skip_joints, skeleton_from_clip);
+    if (remap)
+        write_unmapped_joints(remap, joints_out, skip_joints);
+    
+    s32 root = skeleton_from_clip? skeleton_from_clip[0] : 0;
+    if (extract_root_motion && (root >= 0) && !(skip_joints && ((skip_joints[root / 64] >> (root % 64)) & 1)))
+        remove_root_motion(anim, time, &joints_out[root]);
+}
+
+FUNCTION void eval_blend_space(Animation_Channel *channel, f64 time, SQT *joints_out, u64 const *skip_joints = 0, b32 extract_root_motion = FALSE, Pose_Cache_Key_Channel const *snap_to = 0)
+{
+    // @Note: Samples each weighted clip of the blend space at the shared phase and accumulates it straight
+    // into the result, rotations in the neighborhood of the first clip's. Skipped joints are left alone.
+    // With snap_to, the weights and sample times come from the pose cache key instead (time is unused).
+    //
+    // The clips share the channel's key cursors, one run of them per clip as long as they fit. Cursors 
+    // left over from other clips (the blend position moved) are still safe, find_key() just searches.
+    
+    Blend_Space *space = channel->blend_space;
+    f64 phase          = (channel->animation_duration > 0.0)? time / channel->animation_duration : 0.0;
+    s32 num_joints     = channel->skeleton? (s32)channel->skeleton->joint_info.count : (s32)channel->animation->joints.count;
+    
+    // The key was made from this channel in this tick, so it has the same samples in the same order.
+    ASSERT(!snap_to || (snap_to->num_blend_space_weights == channel->num_blend_space_weights));
+    f32 snapped_weight_sum = 0.0f;
+    if (snap_to) {
+        for (s32 i = 0; i < snap_to->num_blend_space_weights; i++)
+            snapped_weight_sum += (f32)snap_to->blend_space_weights[i];
+    }
+    
+    if (channel->num_blend_space_weights == 1) {
+        Blend_Space_Sample *sample = &space->samples[channel->blend_space_samples[0]];
+        f64 sample_time            = get_blend_space_sample_time(space, sample, phase) * sample->animation->duration;
+        u16 *key_cursors           = (get_max_tracks(sample->animation) <= MAX_CHANNEL_KEY_CURSORS)? channel->key_cursors : 0;
+        if (snap_to)
+            sample_time = snap_to->blend_space_sample_times[0] * POSE_CACHE_TIME_STEP;
+        sample_clip_for_skeleton(sample->animation, channel->blend_space_remaps[0], sample_time, joints_out, key_cursors, skip_joints, extract_root_motion);
+        return;
+    }
+    
+    Arena_Temp scratch = get_scratch(0, 0);
+    defer(free_scratch(scratch));
+    
+    SQT *pose = PUSH_ARRAY(scratch.arena, SQT, num_joints);
+    SQT *sum  = PUSH_ARRAY_ZERO(scratch.arena, SQT, num_joints);
+    
+    s32 cursor_offset = 0;
+    for (s32 i = 0; i < channel->num_blend_space_weights; i++) {
+        Blend_Space_Sample *sample = &space->samples[channel->blend_space_samples[i]];
+        f32 w                      = channel->blend_space_weights[i];
+        if (!sample->animation) continue;
+        
+        s32 num_tracks        = get_max_tracks(sample->animation);
+        u16 *key_cursors      = (cursor_offset + num_tracks <= MAX_CHANNEL_KEY_CURSORS)? channel->key_cursors + cursor_offset : 0;
+        cursor_offset        += num_tracks;
+        
+        f64 sample_time = get_blend_space_sample_time(space, sample, phase) * sample->animation->duration;
+        if (snap_to) {
+            w           = safe_div0((f32)snap_to->blend_space_weights[i], snapped_weight_sum);
+            sample_time = snap_to->blend_space_sample_times[i] * POSE_CACHE_TIME_STEP;
+            if (w <= 0.0f) continue;
+        }
+        sample_clip_for_skeleton(sample->animation, channel->blend_space_remaps[i], sample_time, pose, key_cursors, skip_joints, extract_root_motion);
+        
+        for (s32 j = 0; j < num_joints; j++) {
+            if (skip_joints && ((skip_joints[j / 64] >> (j % 64)) & 1)) continue;
+            
+            Quaternion q = pose[j].rotation;
+            if (dot(q, sum[j].rotation) < 0.0f) q = -q;
+            
+            sum[j].rotation    += q * w;
+            sum[j].translation += pose[j].translation * w;
+            sum[j].scale       += pose[j].scale * w;
+        }
+    }
+    
+    for (s32 j = 0; j < num_joints; j++) {
+        if (skip_joints && ((skip_joints[j / 64] >> (j % 64)) & 1)) continue;
+        
+        joints_out[j]          = sum[j];
+        joints_out[j].rotation = normalize_or_identity(sum[j].rotation);
+    }
+}
+
+FUNCTION void eval(Animation_Channel *channel, f64 time, SQT *joints_out, u64 const *skip_joints = 0, b32 extract_root_motion = FALSE, Pose_Cache_Key_Channel const *snap_to = 0)
+{
+    // Figure out between which two samples of the animation we lie (based on time, usually the channel's
+    // current_time) and lerp the joint transforms into joints_out, one per joint of the animation.
+    
+    if (!channel->animation)
+        return;
+    
+    if (channel->blend_space) {
+        eval_blend_space(channel, time, joints_out, skip_joints, extract_root_motion, snap_to);
+        return;
+    }
+    
+    u16 *key_cursors = channel->num_key_cursors? channel->key_cursors : 0;
+    sample_clip_for_skeleton(channel->animation, channel->remap, time, joints_out, key_cursors, skip_joints, extract_root_motion);
+}
+
+FUNCTION f64 get_blend_factor(Animation_Channel *channel)
+{
+    // Weight of the channel when blending with the channels before it: the cross-fade times the layer
+    // weight. The joint mask comes on top of this.
+    f64 blend_factor = 1.0;
+    if (channel->blending_out)
+        blend_factor = 1.0 - (channel->blend_t / channel->blend_duration);
+    else if (channel->blending_in)
+        blend_factor = (channel->blend_t / channel->blend_duration);
+    
+    return CLAMP01(blend_factor) * CLAMP01(channel->weight);
+}
+
+//~ Pose Cache
+//
+FUNCTION void pose_cache_init(Arena *arena)
+{
+    pose_cache.pool      = (u8 *) arena_push(arena, POSE_CACHE_POOL_SIZE, 64);
+    pose_cache.pool_size = (s32) POSE_CACHE_POOL_SIZE;
+    pose_cache.enabled   = TRUE;
+}
+
+FUNCTION void pose_cache_begin_tick()
+{
+    // @Note: Throws away all entries. Call it before the players are evaluated, not while they are.
+    pose_cache.tick++;
+    pose_cache.pool_used  = 0;
+    pose_cache.num_hits   = 0;
+    pose_cache.num_misses = 0;
+}
+
+FUNCTION b32 make_pose_cache_key(Animation_Player *player, Pose_Cache_Key *key)
+{
+    if (player->channels.count > POSE_CACHE_MAX_CHANNELS) return FALSE;
+    
+    // Zeroed so unused parts of the key hash and compare the same.
+    MEMORY_ZERO(key, sizeof(*key));
+    key->mesh                = player->mesh;
+    key->skinning_mode       = player->skinning_mode;
+    key->extract_root_motion = player->extract_root_motion;
+    key->num_channels        = (s32)player->channels.count;
+    
+    for (s32 i = 0; i < player->channels.count; i++) {
+        Animation_Channel *channel = player->channels[i];
+        Pose_Cache_Key_Channel *k  = &key->channels[i];
+        if (!channel->animation) return FALSE;
+        
+        k->animation    = channel->animation;
+        k->joint_mask   = channel->joint_mask;
+        k->blend_mode   = channel->blend_mode;
+        k->blend_factor = (s32) (get_blend_factor(channel) * POSE_CACHE_BLEND_STEPS + 0.5);
+        
+        if (channel->blend_space) {
+            // Players at the same blend position and phase share a pose even if the channels got there
+            // differently (different durations, started at different times).
+            Blend_Space *space = channel->blend_space;
+            f64 phase          = (channel->animation_duration > 0.0)? channel->current_time / channel->animation_duration : 0.0;
+            
+            k->blend_space             = space;
+            k->num_blend_space_weights = channel->num_blend_space_weights;
+            for (s32 j = 0; j < channel->num_blend_space_weights; j++) {
+                Blend_Space_Sample *sample = &space->samples[channel->blend_space_samples[j]];
+                if (!sample->animation) continue;
+                
+                f64 sample_time = get_blend_space_sample_time(space, sample, phase) * sample->animation->duration;
+                if (!is_clip_time_resident(sample->animation, sample_time)) return FALSE;
+                
+                k->blend_space_samples[j]      = channel->blend_space_samples[j];
+                k->blend_space_weights[j]      = (s32) (channel->blend_space_weights[j] * POSE_CACHE_BLEND_STEPS + 0.5f);
+                k->blend_space_sample_times[j] = (s64) floor(sample_time / POSE_CACHE_TIME_STEP + 0.5);
+            }
+        } else {
+            // A streamed clip that's holding for its block would share a pose that isn't the one for its time.
+            if (!is_clip_time_resident(channel->animation, channel->current_time)) return FALSE;
+            
+            k->time = (channel->clock + POSE_CACHE_CLOCK_STEP/2) / POSE_CACHE_CLOCK_STEP;
+        }
+    }
+    
+    return TRUE;
+}
+
+FUNCTION u64 get_pose_cache_hash(Pose_Cache_Key const *key)
+{
+    // FNV-1a.
+    u8 const *bytes = (u8 const *) key;
+    u64 hash        = 14695981039346656037ULL;
+    for (s32 i = 0; i < (s32)sizeof(*key); i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    
+    return hash;
+}
+
+FUNCTION Pose_Cache_Entry* find_pose_cache_entry(Pose_Cache_Key const *key, u64 hash, b32 *claimed_out)
+{
+    // @Note: Returns the entry that holds the key, or an empty entry that we claimed for it (claimed_out
+    // is set and the caller has to call store_pose_in_cache_entry() or release_pose_cache_entry()). Returns 0 when the key is still 
+    // being written by another thread or the table is full around it; just eval without the cache then.
+    // Another thread could claim a second entry for the same key at the same time, that's fine.
+    
+    *claimed_out = FALSE;
+    
+    s64 tick    = pose_cache.tick;
+    s32 index   = (s32)(hash & (POSE_CACHE_SIZE - 1));
+    s32 probes  = 0;
+    while (probes < POSE_CACHE_SIZE) {
+        Pose_Cache_Entry *entry = &pose_cache.entries[index];
+        
+        s64 state  = entry->state;
+        s32 status = (s32)(state & 3);
+        if (((state >> 2) != tick) || (status == PoseCacheEntryState_EMPTY)) {
+            s64 writing = (tick << 2) | PoseCacheEntryState_WRITING;
+            if (atomic_compare_exchange_s64(&entry->state, writing, state) == state) {
+                entry->hash  = hash;
+                entry->key   = *key;
+                *claimed_out = TRUE;
+                return entry;
+            }
+            
+            // Somebody else claimed it, look at it again.
+            continue;
+        }
+        
+        if (status == PoseCacheEntryState_READY) {
+            if ((entry->hash == hash) && (memcmp(&entry->key, key, sizeof(*key)) == 0))
+                return entry;
+        }
+        
+        index = (index + 1) & (POSE_CACHE_SIZE - 1);
+        probes++;
+    }
+    
+    return 0;
+}
+
+FUNCTION void release_pose_cache_entry(Pose_Cache_Entry *entry)
+{
+    // Gives back an entry we claimed without storing a pose in it.
+    atomic_exchange_s64(&entry->state, (pose_cache.tick << 2) | PoseCacheEntryState_EMPTY);
+}
+
+FUNCTION void store_pose_in_cache_entry(Animation_Player *player, Pose_Cache_Entry *entry)
+{
+    s32 num_joints = (s32)player->skinning_matrices.count;
+    b32 dual       = player->skinning_mode == SkinningMode_DUAL_QUATERNION;
+    
+    s32 size = num_joints*(s32)(sizeof(SQT) + 2*sizeof(M3x4));
+    if (dual) size += num_joints*(s32)sizeof(Dual_Quaternion);
+    size = ALIGN_UP(size, 64);
+    
+    s32 end = atomic_add_s32(&pose_cache.pool_used, size);
+    if (end > pose_cache.pool_size) {
+        // Out of room this tick, give the entry back.
+        release_pose_cache_entry(entry);
+        return;
+    }
+    
+    u8 *data                         = pose_cache.pool + (end - size);
+    entry->blended_joints_relative   = (SQT *)  data; data += num_joints*sizeof(SQT);
+    entry->object_space_joints       = (M3x4 *) data; data += num_joints*sizeof(M3x4);
+    entry->skinning_matrices         = (M3x4 *) data; data += num_joints*sizeof(M3x4);
+    entry->skinning_dual_quaternions = dual? (Dual_Quaternion *) data : 0;
+    
+    MEMORY_COPY(entry->blended_joints_relative, player->blended_joints_relative.data, num_joints*sizeof(SQT));
+    MEMORY_COPY(entry->object_space_joints,     player->object_space_joints.data,     num_joints*sizeof(M3x4));
+    MEMORY_COPY(entry->skinning_matrices,       player->skinning_matrices.data,       num_joints*sizeof(M3x4));
+    if (dual)
+        MEMORY_COPY(entry->skinning_dual_quaternions, player->skinning_dual_quaternions.data, num_joints*sizeof(Dual_Quaternion));
+    
+    // Publish. The exchange is a full barrier, so the data above is visible before the state is.
+    atomic_exchange_s64(&entry->state, (pose_cache.tick << 2) | PoseCacheEntryState_READY);
+}
+
+FUNCTION void copy_pose_from_cache_entry(Animation_Player *player, Pose_Cache_Entry *entry)
+{
+    s32 num_joints = (s32)player->skinning_matrices.count;
+    
+    // The channels would have ended up with the same blend factors.
+    for (s32 i = 0; i < player->channels.count; i++)
+        player->channels[i]->last_blend_factor = (f64)entry->key.channels[i].blend_factor / (f64)POSE_CACHE_BLEND_STEPS;
+    
+    b32 any_dirty = FALSE;
+    for (s32 i = 0; i < player->dirty_joints.count; i++) {
+        if (player->dirty_joints[i]) any_dirty = TRUE;
+        player->dirty_joints[i] = 0;
+    }
+    
+    // The matrices only depend on the local pose, so they're the same too if that is.
+    if (!any_dirty && (memcmp(entry->blended_joints_relative, player->blended_joints_relative.data, num_joints*sizeof(SQT)) == 0)) {
+        player->num_dirty_joints_last_eval = 0;
+        return;
+    }
+    
+    MEMORY_COPY(player->blended_joints_relative.data, entry->blended_joints_relative, num_joints*sizeof(SQT));
+    MEMORY_COPY(player->object_space_joints.data,     entry->object_space_joints,     num_joints*sizeof(M3x4));
+    MEMORY_COPY(player->skinning_matrices.data,       entry->skinning_matrices,       num_joints*sizeof(M3x4));
+    if (entry->skinning_dual_quaternions)
+        MEMORY_COPY(player->skinning_dual_quaternions.data, entry->skinning_dual_quaternions, num_joints*sizeof(Dual_Quaternion));
+    
+    player->num_changed_channels_last_eval = (s32)player->channels.count;
+    player->num_dirty_joints_last_eval     = num_joints;
+    player->pose_version++;
+}
+
+//~ Animation Player
+//
+FUNCTION void init(Animation_Player *player)
+{
+    //table_init(&player->joint_name_to_index_map);
+    array_init(&player->skinning_matrices);
+    array_init(&player->object_space_joints);
+    array_init(&player->blended_joints_relative);
+    array_init(&player->dirty_joints);
+    array_init_and_reserve(&player->channels, MAX_CHANNELS_PER_PLAYER);
+    array_init(&player->skinning_dual_quaternions);
+    array_init(&player->skinned_vertices);
+    array_init(&player->skinned_tbns);
+    array_init(&player->skinned_regions);
+    array_init(&player->lod_from);
+    array_init(&player->lod_to);
+    array_init(&player->detail_joints);
+}
+
+FUNCTION void destroy(Animation_Player **player)
+{
+    if (!player || !*player)
+        return;
+    
+    Animation_Player *pl = *player;
+    
+    //table_free(&pl->joint_name_to_index_map);
+    array_free(&pl->skinning_matrices);
+    array_free(&pl->object_space_joints);
+    array_free(&pl->blended_joints_relative);
+    array_free(&pl->dirty_joints);
+    array_free(&pl->skinning_dual_quaternions);
+    array_free(&pl->skinned_vertices);
+    array_free(&pl->skinned_tbns);
+    array_free(&pl->skinned_regions);
+    array_free(&pl->lod_from);
+    array_free(&pl->lod_to);
+    array_free(&pl->detail_joints);
+    
+    array_free(&pl->channels);
+    
+    free(pl);
+    *player = 0;
+}
+
+FUNCTION void set_skinning_mode(Animation_Player *player, Skinning_Mode mode)
+{
+    player->skinning_mode = mode;
+    player->pose_version++;
+    
+    if (mode == SkinningMode_DUAL_QUATERNION) {
+        // eval() only updates the palette for joints that changed, so build all of it now.
+        array_resize(&player->skinning_dual_quaternions, player->skinning_matrices.count);
+        for (s32 i = 0; i < player->skinning_matrices.count; i++)
+            player->skinning_dual_quaternions[i] = dual_quaternion_from_affine(player->skinning_matrices[i]);
+    }
+}
+
+FUNCTION void set_mesh(Animation_Player *player, Triangle_Mesh *mesh)
+{
+    if (!mesh || ((mesh->flags & MeshFlags_ANIMATED) == 0)) return;
+    
+    Skeleton *skeleton = mesh->skeleton;
+    if (!skeleton) {
+        debug_print("Mesh %S doesn't have a skeleton, can't set it on animation player!\n", mesh->name);
+        return;
+    }
+    
+    // The hierarchy pass in eval() computes joints in order and expects parents to be done before their 
+    // children. Mesh validation refuses skeletons that aren't ordered that way; this only guards meshes 
+    // that didn't come through it.
+    s32 num_joints = (s32)skeleton->joint_info.count;
+    for (s32 i = 0; i < num_joints; i++) {
+        s32 parent_id = skeleton->joint_info[i].parent_id;
+        if (parent_id >= i) {
+            debug_print("Skeleton of mesh %S has joint %d before its parent %d, can't set it on animation player!\n", mesh->name, i, parent_id);
+            return;
+        }
+    }
+    
+    // Resize and initialize final skinning matrices to identity.
+    array_resize(&player->skinning_matrices,   num_joints);
+    array_resize(&player->object_space_joints, num_joints);
+    for (s32 i = 0; i < num_joints; i++) {
+        player->skinning_matrices[i]   = m3x4_identity();
+        player->object_space_joints[i] = m3x4_identity();
+    }
+    
+    // Everything is dirty until the first eval.
+    array_resize(&player->blended_joints_relative, num_joints);
+    array_resize(&player->dirty_joints, (num_joints + 63) / 64);
+    for (s32 i = 0; i < player->dirty_joints.count; i++)
+        player->dirty_joints[i] = U64_MAX;
+    
+    set_skinning_mode(player, player->skinning_mode);
+    
+    // The CPU skinning cache is rebuilt for the new mesh on first use.
+    array_reset(&player->skinned_vertices);
+    array_reset(&player->skinned_tbns);
+    
+    //
+    // Find the detail joints that LODs can freeze: small joints whose children are all small too.
+    // Children come after their parents, so walking backwards settles every subtree before its parent.
+    //
+    f32 detail_size = ANIMATION_LOD_DETAIL_JOINT_SIZE * length(get_size(mesh->bounding_box));
+    array_resize(&player->detail_joints, (num_joints + 63) / 64);
+    for (s32 i = 0; i < player->detail_joints.count; i++)
+        player->detail_joints[i] = 0;
+    for (s32 i = 0; i < num_joints; i++) {
+        Rect3 bounds = mesh->joint_influence_bounds[i];
+        f32 size     = (bounds.min.x <= bounds.max.x)? length(get_size(bounds)) : 0.0f;
+        if ((size < detail_size) && (skeleton->joint_info[i].parent_id >= 0))
+            player->detail_joints[i / 64] |= (1ULL << (i % 64));
+    }
+    for (s32 i = num_joints - 1; i >= 0; i--) {
+        s32 parent_id = skeleton->joint_info[i].parent_id;
+        b32 detail    = (player->detail_joints[i / 64] >> (i % 64)) & 1;
+        if (!detail && (parent_id >= 0))
+            player->detail_joints[parent_id / 64] &= ~(1ULL << (parent_id % 64));
+    }
+    
+    // Start a new LOD window on the next update.
+    array_resize(&player->lod_from, 2*num_joints);
+    array_resize(&player->lod_to,   2*num_joints);
+    player->lod_window_ticks = 0;
+    player->lod_window_step  = 0;
+    player->lod_pending_clock = 0;
+    
+    // Channels that are already playing sample through the remaps of the new skeleton from now on.
+    for (s32 i = 0; i < player->channels.count; i++) {
+        Animation_Channel *channel = player->channels[i];
+        channel->skeleton          = skeleton;
+        if (channel->blend_space) set_blend_space_position(channel, channel->blend_position);
+        else                      channel->remap = get_joint_remap(channel->animation, skeleton);
+    }
+    
+    player->mesh = mesh;
+}
+
+FUNCTION f32* make_joint_mask(Arena *arena, Skeleton *skeleton, String8 root_joint_name, f32 weight = 1.0f)
+{
+    // @Note: Joint mask (see Animation_Channel) with weight on root_joint_name and everything below it, and
+    // 0 everywhere else. E.g. the spine's mask lets a channel play over the upper body only.
+    
+    s32 num_joints = (s32)skeleton->joint_info.count;
+    f32 *mask      = PUSH_ARRAY_ZERO(arena, f32, num_joints);
+    
+    b32 found = FALSE;
+    for (s32 i = 0; i < num_joints; i++) {
+        Skeleton_Joint_Info *joint = &skeleton->joint_info[i];
+        
+        // Parents come before their children.
+        b32 inside = (joint->name == root_joint_name) || ((joint->parent_id >= 0) && (mask[joint->parent_id] != 0.0f));
+        if (inside) {
+            mask[i] = weight;
+            found   = TRUE;
+        }
+    }
+    
+    if (!found)
+        debug_print("Joint %S not found in skeleton, joint mask is empty.\n", root_joint_name);
+    
+    return mask;
+}
+
+FUNCTION void remove_animation_channel(Animation_Player *player, s32 index)
+{
+    Animation_Channel *channel = player->channels[index];
+    s32 slot                   = (s32)(channel - player->channel_pool);
+    player->used_channels     &= ~(1u << slot);
+    
+    array_ordered_remove_by_index(&player->channels, index);
+}
+
+FUNCTION Animation_Channel* add_animation_channel(Animation_Player *player, s32 layer = 0)
+{
+    // @Note: Channels come from the player's pool. If it's full (lots of cross-fades in a short time), we
+    // drop the oldest channel on the same layer to make room; it's the most faded out one. If the layer 
+    // has none, other layers keep theirs and we return 0. The new channel goes after all channels on its 
+    // layer and below.
+    if (player->channels.count == MAX_CHANNELS_PER_PLAYER) {
+        s32 oldest = -1;
+        for (s32 i = player->channels.count - 1; i >= 0; i--) {
+            if (player->channels[i]->layer == layer) oldest = i;
+        }
+        if (oldest < 0) {
+            debug_print("Animation player has no channel left for layer %d!\n", layer);
+            return 0;
+        }
+        remove_animation_channel(player, oldest);
+    }
+    
+    s32 slot = 0;
+    while (player->used_channels & (1u << slot))
+        slot++;
+    ASSERT(slot < MAX_CHANNELS_PER_PLAYER);
+    
+    Animation_Channel *channel = &player->channel_pool[slot];
+    MEMORY_ZERO(channel, sizeof(Animation_Channel));
+    channel->layer         = layer;
+    channel->weight        = 1.0f;
+    channel->skeleton      = player->mesh? player->mesh->skeleton : 0;
+    player->used_channels |= (1u << slot);
+    
+    array_add(&player->channels, channel);
+    for (s32 i = player->channels.count - 1; (i > 0) && (player->channels[i - 1]->layer > layer); i--) {
+        player->channels[i]     = player->channels[i - 1];
+        player->channels[i - 1] = channel;
+    }
+    
+    return channel;
+}
+
+FUNCTION void add_root_motion(Animation_Player *player, V3 translation, f32 yaw)
+{
+    // translation is in the frame of the root motion we have so far.
+    player->root_motion_translation += quaternion_from_axis_angle(V3U, player->root_motion_yaw) * translation;
+    player->root_motion_yaw         += yaw;
+}
+
+FUNCTION void consume_root_motion(Animation_Player *player, V3 *translation_out, f32 *yaw_out)
+{
+    // @Note: Returns the root motion since the last call, in the frame the entity was in back then. Move 
+    // the entity by orientation*translation and turn it by yaw around the up axis.
+    
+    *translation_out = player->root_motion_translation;
+    *yaw_out         = player->root_motion_yaw;
+    
+    player->root_motion_translation = {};
+    player->root_motion_yaw         = 0.0f;
+}
+
+FUNCTION void get_root_motion_weights(Animation_Player *player, f32 *weights_out)
+{
+    // How much each channel (by channel_pool slot) moves the root. Same top-down split as eval_pose() does 
+    // for the root joint; additive channels don't move it.
+    
+    s32 base = -1;
+    for (s32 i = 0; (i < player->channels.count) && (base < 0); i++) {
+        Animation_Channel *channel = player->channels[i];
+        if (channel->animation && (channel->blend_mode == AnimationBlendMode_OVERRIDE)) base = i;
+    }
+    if (base < 0) return;
+    
+    f32 remaining = 1.0f;
+    for (s32 i = player->channels.count - 1; i >= base; i--) {
+        Animation_Channel *channel = player->channels[i];
+        if (!channel->animation || (channel->blend_mode != AnimationBlendMode_OVERRIDE)) continue;
+        
+        f32 factor = (i == base)? 1.0f : (f32)get_blend_factor(channel);
+        if (channel->joint_mask && (i != base))
+            factor *= channel->joint_mask[0];
+        
+        weights_out[channel - player->channel_pool] = factor * remaining;
+        remaining *= 1.0f - factor;
+    }
+}
+
+FUNCTION void advance_time(Animation_Player *player, s64 dt)
+{
+    // dt is in ANIMATION_CLOCK_RATE ticks, like the channels' clocks.
+    
+    if (!player) return;
+    
+    f64 dt_seconds = animation_clock_to_seconds(dt);
+    
+    f32 root_motion_weights[MAX_CHANNELS_PER_PLAYER] = {};
+    if (player->extract_root_motion)
+        get_root_motion_weights(player, root_motion_weights);
+    
+    V3  root_motion_translation = {};
+    f32 root_motion_yaw         = 0.0f;
+    
+    for (s32 i = 0; i < player->channels.count; i++) {
+        Animation_Channel *channel = player->channels[i];
+        advance_time(channel, dt);
+        
+        f32 root_motion_weight = root_motion_weights[channel - player->channel_pool];
+        if (root_motion_weight > 0.0f) {
+            // advance_time() wraps looping channels back to the start, maybe more than once.
+            f64 t1 = channel->current_time + channel->num_loops * channel->animation_duration;
+            
+            V3  translation;
+            f32 yaw;
+            get_root_motion_delta(channel, channel->old_time, t1, &translation, &yaw);
+            root_motion_translation += translation * root_motion_weight;
+            root_motion_yaw         += yaw * root_motion_weight;
+        }
+        
+        if (channel->blending_in || channel->blending_out) {
+            channel->blend_t += dt_seconds;
+            
+            if ((channel->blend_t > channel->blend_duration) &&
+                (channel->blending_out)) {
+                remove_animation_channel(player, i);
+                
+                // The next channel moved into this slot, don't skip its advance.
+                i--;
+            }
+        }
+    }
+    
+    if (player->extract_root_motion)
+        add_root_motion(player, root_motion_translation, root_motion_yaw);
+    
+    player->clock        += dt;
+    player->current_time  = animation_clock_to_seconds(player->clock);
+    player->current_dt    = dt_seconds;
+}
+
+FUNCTION b32 eval_pose(Animation_Player *player, u64 const *frozen_joints, Pose_Cache_Key const *snap_to = 0)
+{
+    // @Note: Evaluates the channels, blends them and updates the matrices of the joints that changed.
+    // Detail joints in frozen_joints keep their last local pose. With snap_to, channels are evaluated at
+    // the time and blend factor of the pose cache key instead of their own. Returns FALSE if nothing was 
+    // evaluated and the player kept its last pose (which then isn't the pose of snap_to).
+    
+    Skeleton *skeleton = player->mesh->skeleton;
+    
+    // @Note: Channels sample straight into the order of the mesh skeleton joints. Clips whose joints don't 
+    // match it one to one go through the Joint_Remap picked when they were played (see get_joint_remap()),
+    // so joint names are only looked at when building those.
+    for (s32 i = 0; i < player->channels.count; i++) {
+        Animation_Channel *channel = player->channels[i];
+        ASSERT(!channel->animation || channel->blend_space || channel->remap || (player->skinning_matrices.count == channel->animation->joints.count));
+    }
+    
+    //
+    // Channels that are still playing get sampled at a new time. Calculate blending factor for 
+    // cross-fading with other channels.
+    //
+    s32 num_changed = 0;
+    for (s32 i = 0; i < player->channels.count; i++) {
+        Animation_Channel *channel = player->channels[i];
+        if (channel->animation && !channel->is_completed) num_changed++;
+    }
+    player->num_changed_channels_last_eval = num_changed;
+    
+    for (s32 i = 0; i < player->channels.count; i++) {
+        Animation_Channel *channel = player->channels[i];
+        
+        f64 blend_factor = get_blend_factor(channel);
+        if (snap_to)
+            blend_factor = (f64)snap_to->channels[i].blend_factor / (f64)POSE_CACHE_BLEND_STEPS;
+        
+        if (blend_factor != channel->last_blend_factor) num_changed++;
+        channel->last_blend_factor = blend_factor;
+    }
+    
+    if (!num_changed) {
+        player->num_dirty_joints_last_eval = 0;
+        return FALSE;
+    }
+    
+    //
+    // Figure out how much each channel contributes to each joint, then sample and accumulate the channels
+    // in one pass over the stack. Channel poses only live during the eval, in the thread's scratch arena.
+    //
+    // Channels blend strictly in stack order. An override channel takes its blend factor (times its joint
+    // mask) of the joint from whatever is below it, and the first one is the base that everything blends 
+    // over. An additive channel adds its difference from its animation's reference pose, scaled by its 
+    // factor, to whatever is below it. Going from the top of the stack down, a channel of either kind ends
+    // up with its own factor times what the override channels above it left over, so an override layer 
+    // masks the additive layers below it like any other. Tracks of joints a channel ends up with no weight
+    // on aren't sampled, so an upper body overlay at full weight leaves the base layer sampling only the 
+    // lower body.
+    //
+    // Override rotations are summed in the neighborhood of the rest pose (flipped to the rest pose's side 
+    // of the double cover) and normalized at the end. See Casey Muratori's "Quaternion Double-cover and 
+    // the Rest Pose Neighborhood". The override weights below a channel add up to what the channels above 
+    // it left over, so an additive channel normalizes the sum so far, adds to it and scales it back.
+    //
+    s32 num_joints   = (s32)player->skinning_matrices.count;
+    s32 num_channels = (s32)player->channels.count;
+    s32 num_words    = (num_joints + 63) / 64;
+    
+    Arena_Temp scratch = get_scratch(0, 0);
+    defer(free_scratch(scratch));
+    
+    // Dirty joints have no pose to keep yet (they all are after set_mesh()), so they're evaluated even
+    // when frozen.
+    if (frozen_joints) {
+        u64 *frozen = PUSH_ARRAY(scratch.arena, u64, num_words);
+        for (s32 w = 0; w < num_words; w++)
+            frozen[w] = frozen_joints[w] & ~player->dirty_joints[w];
+        frozen_joints = frozen;
+    }
+    
+    f32 *weights      = PUSH_ARRAY_ZERO(scratch.arena, f32, num_channels*num_joints);
+    u64 *skip_joints  = PUSH_ARRAY(scratch.arena, u64, num_channels*num_words);
+    s32 *num_weighted = PUSH_ARRAY_ZERO(scratch.arena, s32, num_channels);
+    
+    s32 base = -1;
+    for (s32 i = 0; (i < num_channels) && (base < 0); i++) {
+        Animation_Channel *channel = player->channels[i];
+        if (channel->animation && (channel->blend_mode == AnimationBlendMode_OVERRIDE)) base = i;
+    }
+    if (base < 0) {
+        // Nothing to blend over, keep the last pose.
+        player->num_dirty_joints_last_eval = 0;
+        return FALSE;
+    }
+    
+    for (s32 j = 0; j < num_joints; j++) {
+        f32 remaining = 1.0f;
+        for (s32 i = num_channels - 1; i >= base; i--) {
+            Animation_Channel *channel = player->channels[i];
+            if (!channel->animation) continue;
+            
+            f32 factor = (i == base)? 1.0f : (f32)channel->last_blend_factor;
+            if (channel->joint_mask && (i != base))
+                factor *= channel->joint_mask[j];
+            
+            f32 w = factor * remaining;
+            if (channel->blend_mode == AnimationBlendMode_OVERRIDE)
+                remaining *= 1.0f - factor;
+            
+            weights[i*num_joints + j] = w;
+            if (w > 0.0f) num_weighted[i]++;
+        }
+    }
+    
+    s32 num_contributing = 0;
+    s32 contributing     = base;
+    for (s32 i = 0; i < num_channels; i++) {
+        if (num_weighted[i]) {
+            num_contributing++;
+            contributing = i;
+        }
+        
+        u64 *skip = skip_joints + i*num_words;
+        for (s32 w = 0; w < num_words; w++)
+            skip[w] = frozen_joints? frozen_joints[w] : 0;
+        for (s32 j = 0; j < num_joints; j++) {
+            if (weights[i*num_joints + j] <= 0.0f) skip[j / 64] |= (1ULL << (j % 64));
+        }
+    }
+    
+    SQT *blended = PUSH_ARRAY_ZERO(scratch.arena, SQT, num_joints);
+    
+    // Usually one channel takes all the weight (nothing is fading), so it goes straight into the result.
+    if (num_contributing == 1) {
+        Animation_Channel *channel = player->channels[contributing];
+        f64 time = snap_to? snap_to->channels[contributing].time * POSE_CACHE_TIME_STEP : channel->current_time;
+        eval(channel, time, blended, frozen_joints, player->extract_root_motion, snap_to? &snap_to->channels[contributing] : 0);
+    } else {
+        SQT *pose                  = PUSH_ARRAY(scratch.arena, SQT, num_joints);
+        f32 *below                 = PUSH_ARRAY_ZERO(scratch.arena, f32, num_joints); // Override weight summed so far.
+        Skeleton_Joint_Info *rest  = skeleton->joint_info.data;
+        
+        for (s32 i = base; i < num_channels; i++) {
+            Animation_Channel *channel = player->channels[i];
+            if (!num_weighted[i]) continue;
+            
+            f64 time = snap_to? snap_to->channels[i].time * POSE_CACHE_TIME_STEP : channel->current_time;
+            eval(channel, time, pose, skip_joints + i*num_words, player->extract_root_motion, snap_to? &snap_to->channels[i] : 0);
+            
+            f32 const *w = weights + i*num_joints;
+            if (channel->blend_mode == AnimationBlendMode_OVERRIDE) {
+                for (s32 j = 0; j < num_joints; j++) {
+                    if (w[j] <= 0.0f) continue;
+                    
+                    Quaternion q = pose[j].rotation;
+                    if (dot(q, rest[j].rest_pose_rotation_relative) < 0.0f) q = -q;
+                    
+                    blended[j].rotation    += q * w[j];
+                    blended[j].translation += pose[j].translation * w[j];
+                    blended[j].scale       += pose[j].scale * w[j];
+                    below[j]               += w[j];
+                }
+            } else {
+                SQT const *reference = channel->remap? channel->remap->reference_pose : channel->animation->reference_pose;
+                for (s32 j = 0; j < num_joints; j++) {
+                    if (w[j] <= 0.0f) continue;
+                    
+                    // w[j] is factor*below[j], and the sums so far are below[j] times the pose below us.
+                    f32 factor = w[j] / below[j];
+                    
+                    // Local difference from the reference pose, taking the short way around.
+                    Quaternion delta = quaternion_conjugate(reference[j].rotation) * pose[j].rotation;
+                    if (delta.w < 0.0f) delta = -delta;
+                    
+                    Quaternion q = normalize_or_identity(blended[j].rotation) * nlerp(quaternion_identity(), factor, delta);
+                    if (dot(q, rest[j].rest_pose_rotation_relative) < 0.0f) q = -q;
+                    
+                    blended[j].rotation     = q * below[j];
+                    blended[j].translation += (pose[j].translation - reference[j].translation) * w[j];
+                    if (reference[j].scale != 0.0f)
+                        blended[j].scale *= lerp(1.0f, factor, pose[j].scale / reference[j].scale);
+                }
+            }
+        }
+        
+        // The override weights add up to 1, so only the rotations need normalizing.
+        for (s32 j = 0; j < num_joints; j++)
+            blended[j].rotation = normalize_or_identity(blended[j].rotation);
+    }
+    
+    //
+    // Mark joints whose local transform changed since the last eval as dirty.
+    //
+    ASSERT(player->blended_joints_relative.count == num_joints);
+    for (s32 i = 0; i < num_joints; i++) {
+        b32 frozen = frozen_joints && ((frozen_joints[i / 64] >> (i % 64)) & 1);
+        if (frozen) continue;
+        
+        if (memcmp(&blended[i], &player->blended_joints_relative[i], sizeof(SQT)) != 0) {
+            player->blended_joints_relative[i] = blended[i];
+            player->dirty_joints[i / 64]      |= (1ULL << (i % 64));
+        }
+    }
+    
+    //
+    // Calculate global matrices (object/mesh space) from local matrices (joint-space relative to parent),
+    // then the skinning matrices by including the "inverse rest pose matrix" from skeleton.
+    //
+    // Only dirty joints and their subtrees are recomputed. Parents come before their children (checked
+    // in set_mesh()), so a joint with a dirty parent is marked dirty before we get to its own children.
+    //
+    s32 num_dirty = 0;
+    for (s32 i = 0; i < num_joints; i++) {
+        s32 parent_index = skeleton->joint_info[i].parent_id;
+        
+        b32 dirty = (player->dirty_joints[i / 64] >> (i % 64)) & 1;
+        if (!dirty && (parent_index >= 0))
+            dirty = (player->dirty_joints[parent_index / 64] >> (parent_index % 64)) & 1;
+        if (!dirty) continue;
+        
+        player->dirty_joints[i / 64] |= (1ULL << (i % 64));
+        num_dirty++;
+        
+        M3x4 m = m3x4_from_sqt(player->blended_joints_relative[i]);
+        if (parent_index >= 0) {
+            M3x4 parent_matrix = player->object_space_joints[parent_index];
+            m = parent_matrix * m;
+        }
+        
+        player->object_space_joints[i] = m;
+        player->skinning_matrices[i]   = m * skeleton->joint_info[i].object_to_joint_matrix;
         
-        // Allocate memory for matrices
-        array_init_and_resize(&joint->matrices, anim->num_samples);
+        if (player->skinning_mode == SkinningMode_DUAL_QUATERNION)
+            player->skinning_dual_quaternions[i] = dual_quaternion_from_affine(player->skinning_matrices[i]);
     }
+    player->num_dirty_joints_last_eval = num_dirty;
+    if (num_dirty)
+        player->pose_version++;
     
+    for (s32 i = 0; i < player->dirty_joints.count; i++)
+        player->dirty_joints[i] = 0;
     
-    // Read joint matrices.
-    for (s32 sample_index = 0; sample_index < anim->num_samples; sample_index++) {
-        for (s32 joint_index = 0; joint_index < anim->joints.count; joint_index++) {
-            Pose_Joint_Info *joint = &anim->joints[joint_index];
-            
-            get(&file, &joint->matrices[sample_index]);
-        }
-    }
+    return TRUE;
+}
+
+FUNCTION void eval(Animation_Player *player)
+{
+    if (!player || !player->channels.count) return;
     
+    if (!player->mesh) return;
     
-    //-
+    ASSERT(player->mesh->skeleton);
     
-    ASSERT(file.count == 0);
+    // Detail joints keep their last local pose on LODs that cull them.
+    u64 const *frozen_joints = ANIMATION_LODS[player->lod].cull_detail_joints? player->detail_joints.data : 0;
     
-    os->free_file_memory(orig_file.data);
-    return true;
-}
-
-//~ Animation Channel
-//
-FUNCTION void init(Animation_Channel *channel)
-{
-    array_init(&channel->lerped_joints_relative);
-}
-
-FUNCTION void destroy(Animation_Channel **channel)
-{
-    if (!channel || !*channel)
+    Pose_Cache_Key key;
+    if (!pose_cache.enabled || frozen_joints || !make_pose_cache_key(player, &key)) {
+        eval_pose(player, frozen_joints);
         return;
+    }
     
-    Animation_Channel *ch = *channel;
-    array_free(&ch->lerped_joints_relative);
-    
-    free(ch);
-    *channel = 0;
-}
-
-FUNCTION void set_animation(Animation_Channel *channel, Sampled_Animation *anim, f64 t0)
-{
-    if (anim) {
-        if (anim->num_samples == 0 || anim->joints.count == 0) {
-            anim = 0;
-            debug_print("Animation %S has no samples or joints, can't set it for channel.\n", anim->name);
-        }
+    u64 hash      = get_pose_cache_hash(&key);
+    b32 claimed   = FALSE;
+    Pose_Cache_Entry *entry = find_pose_cache_entry(&key, hash, &claimed);
+    if (entry && !claimed) {
+        copy_pose_from_cache_entry(player, entry);
+        atomic_add_s32(&pose_cache.num_hits, 1);
+        return;
     }
     
-    channel->animation_duration = 0.0;
+    b32 evaluated = eval_pose(player, 0, &key);
+    atomic_add_s32(&pose_cache.num_misses, 1);
     
-    if (!anim) return;
+    if (!claimed) return;
     
-    channel->animation          = anim;
-    channel->animation_duration = anim->duration;
+    // A pose that was kept from an earlier eval isn't the pose of this key.
+    if (evaluated) store_pose_in_cache_entry(player, entry);
+    else           release_pose_cache_entry(entry);
+}
+
+FUNCTION void set_animation_lod_distance(Animation_Player *player, f32 distance)
+{
+    // @Note: distance is in multiples of the mesh bounds' radius (see Animation_LOD). The new LOD takes
+    // effect when the current LOD window ends.
     
-    channel->current_time    = t0;
-    channel->time_multiplier = 1.0f;
-    channel->is_looping      = TRUE;
-    channel->is_completed    = FALSE;
-    //channel->is_active       = TRUE;
+    if (!player) return;
     
-    array_resize(&channel->lerped_joints_relative, anim->joints.count);
+    s32 lod = 0;
+    for (s32 i = 1; i < (s32)ARRAY_COUNT(ANIMATION_LODS); i++) {
+        f32 min_distance = ANIMATION_LODS[i].min_distance;
+        if (i > player->lod) min_distance *= ANIMATION_LOD_HYSTERESIS;
+        if (distance >= min_distance) lod = i;
+    }
+    player->lod = lod;
 }
 
-FUNCTION void advance_time(Animation_Channel *channel, f64 dt)
+FUNCTION void lerp_lod_pose(Animation_Player *player, f32 t)
 {
-    if (!channel) return;
+    s32 num_joints = (s32)player->skinning_matrices.count;
     
-    // Advance current_time by dt.
-    channel->old_time      = channel->current_time;
-    channel->current_time += dt * channel->time_multiplier;
-    
-    if ((channel->old_time != channel->current_time) && (channel->current_time >= channel->animation_duration)) {
-        if (!channel->is_looping) {
-            channel->is_completed = TRUE;
-            channel->current_time = channel->animation_duration;
-            
-            return;
-        }
+    for (s32 i = 0; i < num_joints; i++) {
+        M3x4 *from = &player->lod_from[i];
+        M3x4 *to   = &player->lod_to  [i];
+        M3x4 *out  = &player->skinning_matrices[i];
+        for (s32 e = 0; e < 12; e++)
+            out->I[e] = from->I[e]*(1.0f - t) + to->I[e]*t;
+        
+        from = &player->lod_from[num_joints + i];
+        to   = &player->lod_to  [num_joints + i];
+        out  = &player->object_space_joints[i];
+        for (s32 e = 0; e < 12; e++)
+            out->I[e] = from->I[e]*(1.0f - t) + to->I[e]*t;
         
-        channel->current_time -= channel->animation_duration;
+        if (player->skinning_mode == SkinningMode_DUAL_QUATERNION)
+            player->skinning_dual_quaternions[i] = dual_quaternion_from_affine(player->skinning_matrices[i]);
     }
     
+    player->pose_version++;
 }
 
-FUNCTION void get_lerped_joints(Sampled_Animation *anim, f64 time, Array<SQT> *joints_out)
+FUNCTION void update_animation(Animation_Player *player, f64 dt)
 {
-    // @Todo: max_index parameter? What is it for? To ignore some joint children?
+    // @Note: Per tick advance_time() + eval() that follows the player's LOD. At the start of a window we 
+    // advance to the time of the window's last tick and evaluate, then lerp the matrices towards that 
+    // pose over the window. Windows end on ticks where (lod_tick + lod_phase) is a multiple of the update
+    // interval, so players with different phases are evaluated on different ticks. A window is never cut
+    // short, a LOD change waits for the current one to end.
     
-    s32 num_joints = (s32)anim->joints.count;
-    if (!num_joints) return;
+    if (!player || !player->mesh) return;
     
-    s32 num_samples = anim->num_samples;
-    if (!num_samples) return;
+    s64 dt_clock = seconds_to_animation_clock(dt);
     
-    // Figure out which samples we lie between.
-    f64 phase      = time / anim->duration;
-    s32 base_index = (s32)(phase * (f64)(num_samples - 1)); // Index of base sample.
-    base_index     = CLAMP(0, base_index, num_samples - 1);
+    player->lod_tick++;
+    player->lod_pending_clock += dt_clock;
     
-    // Calculate the fraction/t-value between the two samples.
-    f64 fraction = 0.0;
-    if (num_samples > 1){
-        // Make sure we at least have two samples.
+    // Inside a window.
+    if (player->lod_window_step < player->lod_window_ticks) {
+        player->lod_window_step++;
         
-        f64 time_per_sample = anim->duration / (f64)(num_samples - 1);
-        f64 base_time       = time_per_sample * base_index;
+        if (player->extract_root_motion)
+            add_root_motion(player, player->lod_root_motion_translation, player->lod_root_motion_yaw);
         
-        fraction = (time - base_time) / time_per_sample;
+        // On the last step t is 1, which gives back lod_to exactly.
+        lerp_lod_pose(player, (f32)player->lod_window_step / (f32)player->lod_window_ticks);
+        return;
     }
-    fraction = CLAMP(0.0, fraction, 1.0);
     
-    // Calculate the lerped joint transforms.
-    for (s32 i = 0; i < num_joints; i++) {
-        Pose_Joint_Info *joint = &anim->joints[i];
-        if (DISABLE_LERPS) {
-            joints_out->data[i] = joint->matrices[base_index];
-        } else {
-            SQT a = joint->matrices[base_index + 0];
-            SQT b = joint->matrices[base_index + 1];
-            
-            joints_out->data[i] = lerp(a, (f32)fraction, b);
-        }
+    // New window. At this point the matrices hold the exact pose we evaluated last.
+    s32 interval = ANIMATION_LODS[player->lod].update_interval;
+    s32 window   = interval - (s32)((player->lod_tick + player->lod_phase) % (u32)interval);
+    
+    // Nothing to interpolate from before the first eval after set_mesh().
+    if (!player->lod_window_ticks)
+        window = 1;
+    
+    s32 num_joints = (s32)player->skinning_matrices.count;
+    if (window > 1) {
+        MEMORY_COPY(player->lod_from.data,              player->skinning_matrices.data,   num_joints*sizeof(M3x4));
+        MEMORY_COPY(player->lod_from.data + num_joints, player->object_space_joints.data, num_joints*sizeof(M3x4));
+    }
+    
+    V3  root_motion_translation = player->root_motion_translation;
+    f32 root_motion_yaw         = player->root_motion_yaw;
+    
+    s64 clock_to_window_end = player->lod_pending_clock + (window - 1)*dt_clock;
+    advance_time(player, clock_to_window_end);
+    eval(player);
+    player->lod_pending_clock -= clock_to_window_end;
+    
+    // The root moves over the window like the pose does, in equal steps every tick.
+    if (player->extract_root_motion) {
+        V3  window_translation = quaternion_from_axis_angle(V3U, -root_motion_yaw) * (player->root_motion_translation - root_motion_translation);
+        f32 window_yaw         = player->root_motion_yaw - root_motion_yaw;
+        
+        player->root_motion_translation     = root_motion_translation;
+        player->root_motion_yaw             = root_motion_yaw;
+        player->lod_root_motion_translation = window_translation / (f32)window;
+        player->lod_root_motion_yaw         = window_yaw / (f32)window;
+        add_root_motion(player, player->lod_root_motion_translation, player->lod_root_motion_yaw);
     }
     
+    player->lod_window_ticks = window;
+    player->lod_window_step  = 1;
+    if (window > 1) {
+        MEMORY_COPY(player->lod_to.data,              player->skinning_matrices.data,   num_joints*sizeof(M3x4));
+        MEMORY_COPY(player->lod_to.data + num_joints, player->object_space_joints.data, num_joints*sizeof(M3x4));
+        lerp_lod_pose(player, 1.0f / (f32)window);
+    }
 }
 
-FUNCTION b32 eval(Animation_Channel *channel)
+FUNCTION void prefetch_animation_blocks(Animation_Player *player)
 {
-    // Figure out between which two samples of the animation we lie (based on current_time) and 
-    // lerp the joint transforms.
-    
-    if (!channel->animation)
-        return false;
-    
-    if (channel->is_completed)
-        return false;
+    // @Note: Main thread only, before the player's update_animation(). Requests the blocks of streamed 
+    // clips the channels play now and over the next ANIMATION_STREAM_PREFETCH_TIME (see Clip Streaming).
     
-    ASSERT(channel->lerped_joints_relative.count == channel->animation->joints.count);
-    get_lerped_joints(channel->animation, channel->current_time, &channel->lerped_joints_relative);
+    if (!player) return;
     
-    return true;
+    for (s32 i = 0; i < player->channels.count; i++) {
+        Animation_Channel *channel = player->channels[i];
+        if (!channel->animation) continue;
+        
+        f64 t0 = channel->current_time;
+        f64 t1 = channel->current_time + ANIMATION_STREAM_PREFETCH_TIME * channel->time_multiplier;
+        
+        if (channel->blend_space) {
+            Blend_Space *space = channel->blend_space;
+            f64 duration       = channel->animation_duration;
+            f64 phase0         = (duration > 0.0)? t0 / duration : 0.0;
+            f64 phase1         = (duration > 0.0)? t1 / duration : 0.0;
+            
+            for (s32 j = 0; j < channel->num_blend_space_weights; j++) {
+                Blend_Space_Sample *sample = &space->samples[channel->blend_space_samples[j]];
+                if (!sample->animation) continue;
+                
+                f64 sample_duration = sample->animation->duration;
+                request_clip_blocks(sample->animation, 
+                                    get_blend_space_sample_time_unwrapped(space, sample, phase0) * sample_duration,
+                                    get_blend_space_sample_time_unwrapped(space, sample, phase1) * sample_duration, TRUE);
+            }
+        } else {
+            request_clip_blocks(channel->animation, t0, t1, channel->is_looping);
+        }
+    }
 }
 
-//~ Animation Player
+//~ CPU Skinning
 //
-FUNCTION void init(Animation_Player *player)
+struct Skin_Bucket_Job
 {
-    //table_init(&player->joint_name_to_index_map);
-    array_init(&player->skinning_matrices);
-    array_init(&player->blended_joints_relative);
-    array_init(&player->channels);
-}
+    Skinning_Bucket *bucket;
+    M3x4            *palette;
+    Dual_Quaternion *dual_quaternion_palette; // Only for SkinningMode_DUAL_QUATERNION.
+    u32              flags;
+    V3              *positions_out;
+    TBN             *tbns_out;
+    s32              block_offset;            // parallel_for() ranges start at 0.
+};
 
-FUNCTION void destroy(Animation_Player **player)
+FUNCTION Rect3 transform_rect3(M3x4 const &m, Rect3 r)
 {
-    if (!player || !*player)
-        return;
-    
-    Animation_Player *pl = *player;
-    
-    //table_free(&pl->joint_name_to_index_map);
-    array_free(&pl->skinning_matrices);
-    array_free(&pl->blended_joints_relative);
-    
-    for (s32 i = 0; i < pl->channels.count; i++)
-        destroy(&pl->channels[i]);
-    
-    array_free(&pl->channels);
+    // Bounds of the transformed box.
+    V3 center = transform_point(m, get_center(r));
+    V3 extent = get_size(r) * 0.5f;
+    V3 half   = {};
+    for (s32 row = 0; row < 3; row++)
+        half.I[row] = ABS(m.II[row][0])*extent.x + ABS(m.II[row][1])*extent.y + ABS(m.II[row][2])*extent.z;
     
-    free(pl);
-    *player = 0;
+    Rect3 result = {center - half, center + half};
+    return result;
 }
 
-FUNCTION void set_mesh(Animation_Player *player, Triangle_Mesh *mesh)
+FUNCTION void skin_vertex_linear(Skin_Bucket_Job *job, s32 block, s32 lane)
 {
-    if (!mesh || ((mesh->flags & MeshFlags_ANIMATED) == 0)) return;
+    // Linear blend skinning of one lane of a block.
     
-    //table_reset(&player->joint_name_to_index_map);
+    Skinning_Bucket *bucket = job->bucket;
+    s32 k                   = bucket->num_influences;
+    f32 *p   = bucket->positions      + block*3*SKINNING_BLOCK_SIZE;
+    f32 *tbn = bucket->tbns           + block*9*SKINNING_BLOCK_SIZE;
+    s32 *ids = bucket->joint_ids      + block*k*SKINNING_BLOCK_SIZE;
+    f32 *w   = bucket->weights        + block*k*SKINNING_BLOCK_SIZE;
+    s32 *out = bucket->vertex_indices + block*SKINNING_BLOCK_SIZE;
     
-    Skeleton *skeleton = mesh->skeleton;
-    if (!skeleton) {
-        debug_print("Mesh %S doesn't have a skeleton, can't set it on animation player!\n", mesh->name);
-        return;
+    M3x4 m = {};
+    for (s32 s = 0; s < k; s++) {
+        M3x4 *joint = &job->palette[ids[s*SKINNING_BLOCK_SIZE + lane]];
+        f32 weight  = w[s*SKINNING_BLOCK_SIZE + lane];
+        for (s32 e = 0; e < 12; e++)
+            m.I[e] += joint->I[e] * weight;
     }
     
-    // Resize and initialize final skinning matrices to identity.
-    array_resize(&player->skinning_matrices, skeleton->joint_info.count);
-    for (s32 i = 0; i < player->skinning_matrices.count; i++)
-        player->skinning_matrices[i] = m4x4_identity();
+    V3 v = {p[0*SKINNING_BLOCK_SIZE + lane], p[1*SKINNING_BLOCK_SIZE + lane], p[2*SKINNING_BLOCK_SIZE + lane]};
+    job->positions_out[out[lane]] = transform_point(m, v);
     
-    player->mesh = mesh;
+    if (job->flags & SkinMeshFlags_TBNS) {
+        V3 vectors[3];
+        for (s32 c = 0; c < 3; c++) {
+            V3 d = {tbn[(3*c + 0)*SKINNING_BLOCK_SIZE + lane], tbn[(3*c + 1)*SKINNING_BLOCK_SIZE + lane], tbn[(3*c + 2)*SKINNING_BLOCK_SIZE + lane]};
+            vectors[c] = normalize_or_zero(transform_vector(m, d));
+        }
+        job->tbns_out[out[lane]] = {vectors[0], vectors[1], vectors[2]};
+    }
 }
 
-FUNCTION Animation_Channel* add_animation_channel(Animation_Player *player)
+FUNCTION void skin_bucket_scalar(Skin_Bucket_Job *job, s32 first_block, s32 one_past_last_block)
 {
-    Animation_Channel *channel = (Animation_Channel *) malloc(sizeof(Animation_Channel));
-    ASSERT(channel);
-    MEMORY_ZERO(channel, sizeof(Animation_Channel));
-    init(channel);
-    array_add(&player->channels, channel);
-    
-    return channel;
+    for (s32 block = first_block; block < one_past_last_block; block++) {
+        for (s32 lane = 0; lane < SKINNING_BLOCK_SIZE; lane++)
+            skin_vertex_linear(job, block, lane);
+    }
 }
 
-FUNCTION void advance_time(Animation_Player *player, f64 dt)
+#if SKINNING_SIMD
+FUNCTION void skin_bucket(Skin_Bucket_Job *job, s32 first_block, s32 one_past_last_block)
 {
-    if (!player) return;
+    // @Note: For each block, blend the 4 lanes' matrices one row per register, then transpose each row 
+    // so we get every matrix element across the 4 lanes. From there the transform is plain SoA math
+    // against the block's xxxx yyyy zzzz. Blocks where all lanes follow the same single joint skip the
+    // blend and transpose.
     
-    for (s32 i = 0; i < player->channels.count; i++) {
-        Animation_Channel *channel = player->channels[i];
-        advance_time(channel, dt);
+    Skinning_Bucket *bucket = job->bucket;
+    M3x4 *palette           = job->palette;
+    V3   *positions_out     = job->positions_out;
+    TBN  *tbns_out          = job->tbns_out;
+    u32   flags             = job->flags;
+    s32   k                 = bucket->num_influences;
+    
+    __m128 tiny = _mm_set1_ps(1e-20f);
+    
+    for (s32 block = first_block; block < one_past_last_block; block++) {
+        f32 *p   = bucket->positions      + block*3*SKINNING_BLOCK_SIZE;
+        f32 *tbn = bucket->tbns           + block*9*SKINNING_BLOCK_SIZE;
+        s32 *ids = bucket->joint_ids      + block*k*SKINNING_BLOCK_SIZE;
+        f32 *w   = bucket->weights        + block*k*SKINNING_BLOCK_SIZE;
+        s32 *out = bucket->vertex_indices + block*SKINNING_BLOCK_SIZE;
         
-        if (channel->blending_in || channel->blending_out) {
-            channel->blend_t += dt;
+        __m128 r[3][4];
+        if ((k == 1) && (ids[0] == ids[1]) && (ids[0] == ids[2]) && (ids[0] == ids[3])) {
+            // Common case: all lanes follow one joint with a weight of 1, just broadcast its matrix.
+            M3x4 *joint = &palette[ids[0]];
+            for (s32 row = 0; row < 3; row++) {
+                for (s32 column = 0; column < 4; column++)
+                    r[row][column] = _mm_set1_ps(joint->II[row][column]);
+            }
+        } else {
+            for (s32 lane = 0; lane < SKINNING_BLOCK_SIZE; lane++) {
+                M3x4  *joint  = &palette[ids[lane]];
+                __m128 weight = _mm_set1_ps(w[lane]);
+                __m128 r0     = _mm_mul_ps(_mm_loadu_ps(joint->II[0]), weight);
+                __m128 r1     = _mm_mul_ps(_mm_loadu_ps(joint->II[1]), weight);
+                __m128 r2     = _mm_mul_ps(_mm_loadu_ps(joint->II[2]), weight);
+                for (s32 s = 1; s < k; s++) {
+                    joint  = &palette[ids[s*SKINNING_BLOCK_SIZE + lane]];
+                    weight = _mm_set1_ps(w[s*SKINNING_BLOCK_SIZE + lane]);
+                    r0     = _mm_add_ps(r0, _mm_mul_ps(_mm_loadu_ps(joint->II[0]), weight));
+                    r1     = _mm_add_ps(r1, _mm_mul_ps(_mm_loadu_ps(joint->II[1]), weight));
+                    r2     = _mm_add_ps(r2, _mm_mul_ps(_mm_loadu_ps(joint->II[2]), weight));
+                }
+                r[0][lane] = r0;
+                r[1][lane] = r1;
+                r[2][lane] = r2;
+            }
             
-            if ((channel->blend_t > channel->blend_duration) &&
-                (channel->blending_out)) {
-                destroy(&player->channels[i]);
-                array_ordered_remove_by_index(&player->channels, i);
+            // After this, r[row][column] holds element (row, column) of all 4 lanes.
+            _MM_TRANSPOSE4_PS(r[0][0], r[0][1], r[0][2], r[0][3]);
+            _MM_TRANSPOSE4_PS(r[1][0], r[1][1], r[1][2], r[1][3]);
+            _MM_TRANSPOSE4_PS(r[2][0], r[2][1], r[2][2], r[2][3]);
+        }
+        
+        __m128 x = _mm_loadu_ps(p + 0*SKINNING_BLOCK_SIZE);
+        __m128 y = _mm_loadu_ps(p + 1*SKINNING_BLOCK_SIZE);
+        __m128 z = _mm_loadu_ps(p + 2*SKINNING_BLOCK_SIZE);
+        
+        __m128 o[3];
+        for (s32 row = 0; row < 3; row++) {
+            o[row] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r[row][0], x), _mm_mul_ps(r[row][1], y)),
+                                _mm_add_ps(_mm_mul_ps(r[row][2], z), r[row][3]));
+        }
+        
+        // Back to AoS. The 4th row of the transpose is garbage we don't store.
+        __m128 o3 = _mm_setzero_ps();
+        _MM_TRANSPOSE4_PS(o[0], o[1], o[2], o3);
+        f32 lanes[4][4];
+        _mm_storeu_ps(lanes[0], o[0]);
+        _mm_storeu_ps(lanes[1], o[1]);
+        _mm_storeu_ps(lanes[2], o[2]);
+        _mm_storeu_ps(lanes[3], o3);
+        for (s32 lane = 0; lane < SKINNING_BLOCK_SIZE; lane++)
+            positions_out[out[lane]] = {lanes[lane][0], lanes[lane][1], lanes[lane][2]};
+        
+        if (flags & SkinMeshFlags_TBNS) {
+            f32 vectors[9][4];
+            for (s32 c = 0; c < 3; c++) {
+                __m128 dx = _mm_loadu_ps(tbn + (3*c + 0)*SKINNING_BLOCK_SIZE);
+                __m128 dy = _mm_loadu_ps(tbn + (3*c + 1)*SKINNING_BLOCK_SIZE);
+                __m128 dz = _mm_loadu_ps(tbn + (3*c + 2)*SKINNING_BLOCK_SIZE);
+                
+                __m128 v[3];
+                for (s32 row = 0; row < 3; row++) {
+                    v[row] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r[row][0], dx), _mm_mul_ps(r[row][1], dy)),
+                                        _mm_mul_ps(r[row][2], dz));
+                }
+                
+                // Blended matrices aren't rigid, renormalize.
+                __m128 len2    = _mm_add_ps(_mm_add_ps(_mm_mul_ps(v[0], v[0]), _mm_mul_ps(v[1], v[1])), _mm_mul_ps(v[2], v[2]));
+                __m128 inv_len = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(_mm_max_ps(len2, tiny)));
+                _mm_storeu_ps(vectors[3*c + 0], _mm_mul_ps(v[0], inv_len));
+                _mm_storeu_ps(vectors[3*c + 1], _mm_mul_ps(v[1], inv_len));
+                _mm_storeu_ps(vectors[3*c + 2], _mm_mul_ps(v[2], inv_len));
+            }
+            
+            for (s32 lane = 0; lane < SKINNING_BLOCK_SIZE; lane++) {
+                TBN *dst = &tbns_out[out[lane]];
+                dst->tangent   = {vectors[0][lane], vectors[1][lane], vectors[2][lane]};
+                dst->bitangent = {vectors[3][lane], vectors[4][lane], vectors[5][lane]};
+                dst->normal    = {vectors[6][lane], vectors[7][lane], vectors[8][lane]};
             }
         }
     }
+}
+#endif
+
+FUNCTION void skin_bucket_dual_quaternion(Skin_Bucket_Job *job, s32 first_block, s32 one_past_last_block)
+{
+    Skinning_Bucket *bucket  = job->bucket;
+    Dual_Quaternion *palette = job->dual_quaternion_palette;
+    s32 k                    = bucket->num_influences;
     
-    player->current_time += dt;
-    player->current_dt    = dt;
+    for (s32 block = first_block; block < one_past_last_block; block++) {
+        f32 *p   = bucket->positions      + block*3*SKINNING_BLOCK_SIZE;
+        f32 *tbn = bucket->tbns           + block*9*SKINNING_BLOCK_SIZE;
+        s32 *ids = bucket->joint_ids      + block*k*SKINNING_BLOCK_SIZE;
+        f32 *w   = bucket->weights        + block*k*SKINNING_BLOCK_SIZE;
+        s32 *out = bucket->vertex_indices + block*SKINNING_BLOCK_SIZE;
+        
+        for (s32 lane = 0; lane < SKINNING_BLOCK_SIZE; lane++) {
+            // Blend in the hemisphere of the first piece's rotation so we take the short path.
+            Dual_Quaternion blended = {};
+            Quaternion pivot = palette[ids[lane]].real;
+            for (s32 s = 0; s < k; s++) {
+                Dual_Quaternion dq = palette[ids[s*SKINNING_BLOCK_SIZE + lane]];
+                
+                f32 weight = w[s*SKINNING_BLOCK_SIZE + lane];
+                if (dot(dq.real, pivot) < 0.0f) weight = -weight;
+                
+                blended.real += dq.real * weight;
+                blended.dual += dq.dual * weight;
+            }
+            
+            // The rotations cancelled out, there's nothing to normalize. Skin the vertex linearly instead 
+            // of leaving last frame's result in place.
+            f32 len = length(blended.real);
+            if (len <= 0.0f) {
+                skin_vertex_linear(job, block, lane);
+                continue;
+            }
+            
+            blended.real = blended.real * (1.0f / len);
+            blended.dual = blended.dual * (1.0f / len);
+            
+            V3 v = {p[0*SKINNING_BLOCK_SIZE + lane], p[1*SKINNING_BLOCK_SIZE + lane], p[2*SKINNING_BLOCK_SIZE + lane]};
+            job->positions_out[out[lane]] = transform_point(blended, v);
+            
+            if (job->flags & SkinMeshFlags_TBNS) {
+                V3 vectors[3];
+                for (s32 c = 0; c < 3; c++) {
+                    V3 d = {tbn[(3*c + 0)*SKINNING_BLOCK_SIZE + lane], tbn[(3*c + 1)*SKINNING_BLOCK_SIZE + lane], tbn[(3*c + 2)*SKINNING_BLOCK_SIZE + lane]};
+                    vectors[c] = blended.real * d;
+                }
+                job->tbns_out[out[lane]] = {vectors[0], vectors[1], vectors[2]};
+            }
+        }
+    }
 }
 
-FUNCTION void eval(Animation_Player *player)
+FUNCTION void skin_bucket_blocks(void *data, s32 first_block, s32 one_past_last_block)
 {
-    if (!player || !player->channels.count) return;
+    Skin_Bucket_Job *job = (Skin_Bucket_Job*)data;
+    first_block         += job->block_offset;
+    one_past_last_block += job->block_offset;
     
-    if (!player->mesh) return;
+    if (job->dual_quaternion_palette) {
+        skin_bucket_dual_quaternion(job, first_block, one_past_last_block);
+        return;
+    }
     
-    ASSERT(player->mesh->skeleton);
+#if SKINNING_SIMD
+    skin_bucket(job, first_block, one_past_last_block);
+#else
+    skin_bucket_scalar(job, first_block, one_past_last_block);
+#endif
+}
+
+FUNCTION void skin_regions(Animation_Player *player, u64 const *regions, u32 flags)
+{
+    // @Note: Brings the CPU skinning cache of the player up to date for the given regions (a bitset,
+    // see Skinning_Region). Regions already skinned for the current pose are skipped.
     
-    Skeleton *skeleton = player->mesh->skeleton;
+    Triangle_Mesh *mesh = player->mesh;
+    s32 words           = mesh->skinning_region_mask_words;
     
-    // @Sanity: @Todo: For now, assume that mesh skeleton joints match joints of every channel in
-    // terms of names and order/indices. Our mesh and animation exporters are synched when writing
-    // the joint data. If anything, we can make sure everything matched at load time.
-    // @Note: Because of this assumption. The animation player and channel doesn't hold any info about
-    // joint names, instead, we can rely on the mesh skeleton to get that info. But since the animation
-    // player allows you to add _any_ channel, and if we want to support some kind of "re-targeting",
-    // it would probably be best if we did store pose joint names somewhere and only apply transforms 
-    // to matching joints from the mesh skeleton.
-    for (s32 i = 0; i < player->channels.count; i++) {
-        ASSERT(player->skinning_matrices.count == player->channels[i]->lerped_joints_relative.count);
+    // Vertices no joint moves are never written, so start from the rest pose.
+    if (player->skinned_vertices.count != mesh->vertices.count) {
+        array_copy(&player->skinned_vertices, mesh->vertices);
+        array_resize(&player->skinned_regions, words);
+        player->skinned_pose_version = player->pose_version - 1;
     }
+    if ((flags & SkinMeshFlags_TBNS) && (player->skinned_tbns.count != mesh->tbns.count))
+        array_copy(&player->skinned_tbns, mesh->tbns);
     
-    //
-    // Evaluate all channels.
-    //
-    b32 num_changed = 0;
-    for (s32 i = 0; i < player->channels.count; i++) {
-        b32 changed = eval(player->channels[i]);
-        if (changed) num_changed++;
+    // New pose, or outputs the cache doesn't have: everything is stale.
+    if ((player->skinned_pose_version != player->pose_version) || (flags & ~player->skinned_flags)) {
+        for (s32 i = 0; i < words; i++)
+            player->skinned_regions[i] = 0;
+        player->skinned_pose_version = player->pose_version;
+        player->skinned_flags        = flags;
     }
-    player->num_changed_channels_last_eval = num_changed;
     
-    //
-    // Calculate blending factor for cross-fading with other channels.
-    //
-    for (s32 i = 0; i < player->channels.count; i++) {
-        Animation_Channel *channel = player->channels[i];
-        
-        f64 blend_factor = 1.0;
-        if (channel->blending_out)
-            blend_factor = 1.0 - (channel->blend_t / channel->blend_duration);
-        else if (channel->blending_in)
-            blend_factor = (channel->blend_t / channel->blend_duration);
-        
-        blend_factor = CLAMP01(blend_factor);
-        
-        if (blend_factor != channel->last_blend_factor) num_changed++;
-        channel->last_blend_factor = blend_factor;
+    Arena_Temp scratch = get_scratch(0, 0);
+    defer(free_scratch(scratch));
+    
+    u64 *todo = PUSH_ARRAY(scratch.arena, u64, words);
+    u64 any   = 0;
+    for (s32 i = 0; i < words; i++) {
+        todo[i] = regions[i] & ~player->skinned_regions[i];
+        any    |= todo[i];
     }
+    if (!any) return;
     
-    if (!num_changed)
-        return;
+    Skin_Bucket_Job job = {};
+    job.palette         = player->skinning_matrices.data;
+    job.flags           = player->skinned_flags;
+    job.positions_out   = player->skinned_vertices.data;
+    job.tbns_out        = player->skinned_tbns.data;
+    if (player->skinning_mode == SkinningMode_DUAL_QUATERNION) {
+        ASSERT(player->skinning_dual_quaternions.count == player->skinning_matrices.count);
+        job.dual_quaternion_palette = player->skinning_dual_quaternions.data;
+    }
     
-    //
-    // Blend with other animation channels (cross-fade).
-    //
-    array_resize(&player->blended_joints_relative, player->channels[0]->lerped_joints_relative.count);
-    b32 first = TRUE;
-    for (s32 i = 0; i < player->channels.count; i++) {
-        Animation_Channel *channel = player->channels[i];
-        ASSERT(channel->lerped_joints_relative.count == player->blended_joints_relative.count);
+    // Regions are in block order within each bucket, so merge neighbouring ones into bigger ranges. 
+    // Buckets write disjoint vertices, and a block never straddles two batches, so the blocks can go
+    // wide on the job threads.
+    s32 num_joints = (s32)mesh->skeleton->joint_info.count;
+    for (s32 b = 0; b < MAX_JOINTS_PER_VERTEX; b++) {
+        job.bucket = &mesh->skinning_buckets[b];
         
-        for (s32 joint_index = 0; joint_index < channel->lerped_joints_relative.count; joint_index++) {
-            SQT joint = channel->lerped_joints_relative[joint_index];
+        s32 first_block = 0, one_past_last_block = 0;
+        for (s32 r = 0; r <= num_joints; r++) {
+            Skinning_Region *region = &mesh->skinning_regions[r];
+            b32 wanted = (r < num_joints) && (todo[r / 64] & (1ULL << (r % 64))) && 
+                (region->first_block[b] < region->one_past_last_block[b]);
             
-            if (first) {
-                player->blended_joints_relative[joint_index] = joint;
+            if (wanted && (region->first_block[b] <= one_past_last_block) && (first_block < one_past_last_block)) {
+                one_past_last_block = MAX(one_past_last_block, region->one_past_last_block[b]);
+                continue;
             }
-            else {
-                // @Incomplete:
-                // @Incomplete:
-                // @Todo: We are not doing Casey's neighborhood thing, and we should!
-                // We should figure out which blend mode to use:
-                // neighborhood with rest pose vs. invert vs. direct.
-                // For now we will just do the dumb thing and lerp the old way.
-                //
-                f64 t = channel->last_blend_factor;
-                if (t != 1) {
-                    SQT lerped = lerp(player->blended_joints_relative[joint_index], (f32)t, joint);
-                    player->blended_joints_relative[joint_index] = lerped;
-                } else {
-                    player->blended_joints_relative[joint_index] = joint;
-                }
+            
+            if (first_block < one_past_last_block) {
+                job.block_offset = first_block;
+                parallel_for(one_past_last_block - first_block, SKINNING_JOB_BATCH_SIZE, skin_bucket_blocks, &job);
             }
+            
+            first_block         = wanted? region->first_block[b]         : 0;
+            one_past_last_block = wanted? region->one_past_last_block[b] : 0;
         }
-        
-        first = FALSE;
     }
     
+    for (s32 i = 0; i < words; i++)
+        player->skinned_regions[i] |= todo[i];
+}
+
+FUNCTION void skin_mesh(Animation_Player *player, u32 flags = SkinMeshFlags_POSITIONS)
+{
+    // @Note: We skin on CPU only for things like mouse-picking. Results go to player->skinned_vertices
+    // (and player->skinned_tbns with SkinMeshFlags_TBNS), and are reused until the pose changes.
+    
+    if (!player || !player->mesh || !player->mesh->skeleton) return;
+    
+    Arena_Temp scratch = get_scratch(0, 0);
+    defer(free_scratch(scratch));
+    
+    s32 words    = player->mesh->skinning_region_mask_words;
+    u64 *regions = PUSH_ARRAY(scratch.arena, u64, words);
+    for (s32 i = 0; i < words; i++)
+        regions[i] = U64_MAX;
+    
+    skin_regions(player, regions, flags);
+}
+
+FUNCTION b32 segment_skinned_mesh_intersect(Animation_Player *player, V3 const &a, V3 const &b, Hit_Result *hit_out, s32 lod = 0)
+{
+    // @Note: Like segment_mesh_intersect() on the current pose, but we only skin and test the regions
+    // whose posed bounds the segment hits. a and b are in object space, and we test the triangles of lod.
     //
-    // Calculate global matrices (object/mesh space) from local matrices (joint-space relative to parent).
-    // Could store global matrices in separate array, but we'll store them in skinning matrices for now.
-    //
-    for (s32 i = 0; i < player->blended_joints_relative.count; i++) {
-        s32 parent_index = skeleton->joint_info[i].parent_id;
+    // A region's triangles are inside the union of the posed influence bounds of the joints moving their
+    // vertices, because a linear blend skinned vertex is a weighted average of points inside those bounds.
+    // @Incomplete: That isn't strictly true for dual quaternion skinning, but it's close enough for picking.
+    
+    *hit_out = make_hit_result(a, b);
+    if (!player || !player->mesh || !player->mesh->skeleton) return FALSE;
+    
+    Triangle_Mesh *mesh = player->mesh;
+    s32 num_joints      = (s32)mesh->skeleton->joint_info.count;
+    s32 words           = mesh->skinning_region_mask_words;
+    
+    lod = CLAMP(0, lod, (s32)mesh->lods.count - 1);
+    Skinning_Region *regions = &mesh->skinning_regions[lod*(num_joints + 1)];
+    u64 *region_joints       = &mesh->skinning_region_joints      [lod*(num_joints + 1)*words];
+    u64 *region_dependencies = &mesh->skinning_region_dependencies[lod*(num_joints + 1)*words];
+    
+    Arena_Temp scratch = get_scratch(0, 0);
+    defer(free_scratch(scratch));
+    
+    Rect3 *posed_bounds = PUSH_ARRAY(scratch.arena, Rect3, num_joints);
+    for (s32 j = 0; j < num_joints; j++) {
+        Rect3 bounds = mesh->joint_influence_bounds[j];
+        if (bounds.min.x <= bounds.max.x)
+            posed_bounds[j] = transform_rect3(player->skinning_matrices[j], bounds);
+        else
+            posed_bounds[j] = bounds;
+    }
+    
+    u64 *hit_regions = PUSH_ARRAY_ZERO(scratch.arena, u64, words);
+    u64 *needed      = PUSH_ARRAY_ZERO(scratch.arena, u64, words);
+    for (s32 r = 0; r <= num_joints; r++) {
+        if (!regions[r].num_indices) continue;
         
-        M4x4 m = m4x4_from_sqt(player->blended_joints_relative[i]);
-        if (parent_index >= 0) {
-            M4x4 parent_matrix = player->skinning_matrices[parent_index];
-            m = parent_matrix * m;
+        // Triangles no joint moves are in the last region; always test those.
+        Rect3 box   = {v3(F32_MAX), v3(-F32_MAX)};
+        u64 *joints = &region_joints[r*words];
+        for (s32 j = 0; j < num_joints; j++) {
+            if (joints[j / 64] & (1ULL << (j % 64))) {
+                box.min = min_v3(box.min, posed_bounds[j].min);
+                box.max = max_v3(box.max, posed_bounds[j].max);
+            }
         }
         
-        player->skinning_matrices[i] = m;
+        if ((r == num_joints) || segment_aabb_intersect(a, b, box.min, box.max)) {
+            hit_regions[r / 64] |= 1ULL << (r % 64);
+            
+            u64 *dependencies = &region_dependencies[r*words];
+            for (s32 i = 0; i < words; i++)
+                needed[i] |= dependencies[i];
+        }
     }
     
-    //
-    // Calculate skinning matrices by including the "inverse rest pose matrix" from skeleton.
-    //
-    for (s32 i = 0; i < player->skinning_matrices.count; i++) {
-        M4x4 object_to_joint         = skeleton->joint_info[i].object_to_joint_matrix;
-        player->skinning_matrices[i] = player->skinning_matrices[i] * object_to_joint;
+    skin_regions(player, needed, SkinMeshFlags_POSITIONS);
+    
+    Hit_Result best_hit = *hit_out;
+    for (s32 r = 0; r <= num_joints; r++) {
+        if (!(hit_regions[r / 64] & (1ULL << (r % 64)))) continue;
+        
+        Skinning_Region *region = &regions[r];
+        Hit_Result hit;
+        segment_mesh_intersect(a, b, player->skinned_vertices.data, player->skinned_vertices.count, 
+                               &mesh->skinning_region_indices[region->first_index], region->num_indices, &hit);
+        if (hit.result && (!best_hit.result || (hit.percent < best_hit.percent)))
+            best_hit = hit;
     }
     
-    // @Todo: Remove locomotion?
+    *hit_out = best_hit;
+    return best_hit.result;
 }
 
-#if DEVELOPER
-FUNCTION void skin_mesh(Animation_Player *player)
+//~ Animation State Machine
+//
+FUNCTION s32 find_animation_state_desc(Animation_State_Desc const *state_descs, s32 num_states, char const *name)
 {
-    // @Note: We skin on CPU only for things like mouse-picking in editor.
+    for (s32 i = 0; i < num_states; i++) {
+        if (str8_cstring(state_descs[i].name) == str8_cstring(name))
+            return i;
+    }
     
-    if (!player || !player->mesh || !player->mesh->skeleton) return;
+    return -1;
+}
+
+FUNCTION Animation_State_Machine* compile_animation_state_machine(Arena *arena, Catalog<Sampled_Animation> *catalog, Animation_State_Desc const *state_descs, s32 num_states, Animation_Transition_Desc const *transition_descs, s32 num_transitions, s32 num_inputs)
+{
+    // @Note: Transitions are tried in order for every (state, inputs) pair and the first one that matches 
+    // wins, even if it goes to the same state, so put the specific ones first. This is the only place
+    // that deals with names.
     
-    Triangle_Mesh *mesh = player->mesh;
-    Skeleton *sk = mesh->skeleton;
-    for (s32 i = 0; i < mesh->vertices.count; i++) {
-        s32 canonical_vertex_index    = mesh->canonical_vertex_map[i];
-        Vertex_Blend_Info *blend_info = &sk->vertex_blend_info[canonical_vertex_index];
+    ASSERT((num_states > 0) && (num_states <= S16_MAX));
+    ASSERT((num_inputs >= 0) && (num_inputs <= MAX_ANIMATION_STATE_INPUTS));
+    
+    Animation_State_Machine *machine = PUSH_STRUCT_ZERO(arena, Animation_State_Machine);
+    machine->clips       = PUSH_ARRAY_ZERO(arena, Sampled_Animation*, num_states);
+    machine->states      = PUSH_ARRAY_ZERO(arena, Animation_State, num_states);
+    machine->num_states  = num_states;
+    machine->entry_state = 0;
+    
+    //
+    // States. States that play the same clip share its handle.
+    //
+    for (s32 s = 0; s < num_states; s++) {
+        Animation_State_Desc const *desc = &state_descs[s];
+        Animation_State *state           = &machine->states[s];
         
-        V4 p = {};
-        //V3 n = {};
+        Sampled_Animation *clip = desc->clip? find(catalog, str8_cstring(desc->clip)) : 0;
+        if (desc->clip && !clip)
+            debug_print("Animation state %s: animation %s not found.\n", desc->name, desc->clip);
         
-        for (s32 piece_index = 0; piece_index < blend_info->num_pieces; piece_index++) {
-            Vertex_Blend_Piece piece = blend_info->pieces[piece_index];
-            M4x4 m = player->skinning_matrices[piece.joint_id];
-            p     += transform(m, v4(mesh->vertices[i], 1.0f)) * piece.weight;
-            //n += w * transform(m, v4(mesh->tbns[i].normal, 0.0f)).xyz;
+        s32 handle = -1;
+        for (s32 c = 0; c < machine->num_clips; c++) {
+            if (machine->clips[c] == clip) handle = c;
         }
+        if (handle < 0) {
+            handle = machine->num_clips++;
+            machine->clips[handle] = clip;
+        }
+        
+        state->clip             = handle;
+        state->loop             = desc->loop;
+        state->num_sync_markers = CLAMP(0, desc->num_sync_markers, MAX_SYNC_MARKERS);
+        MEMORY_COPY(state->sync_markers, desc->sync_markers, sizeof(state->sync_markers));
         
-        if (p.w)
-            p.xyz /= p.w;
+        if (desc->blend_space) {
+            state->blend_space = compile_blend_space(arena, catalog, desc->blend_space);
+            
+            // The channel's phase goes through the blend space's markers in even steps.
+            if (!state->num_sync_markers) {
+                state->num_sync_markers = state->blend_space->num_sync_markers;
+                for (s32 k = 0; k < state->num_sync_markers; k++)
+                    state->sync_markers[k] = (f32)k / (f32)state->num_sync_markers;
+            }
+        }
+    }
+    
+    //
+    // Transition table.
+    //
+    Arena_Temp scratch = get_scratch(&arena, 1);
+    defer(free_scratch(scratch));
+    
+    s32 *from = PUSH_ARRAY(scratch.arena, s32, num_transitions);
+    s32 *to   = PUSH_ARRAY(scratch.arena, s32, num_transitions);
+    for (s32 t = 0; t < num_transitions; t++) {
+        Animation_Transition_Desc const *desc = &transition_descs[t];
+        from[t] = desc->from? find_animation_state_desc(state_descs, num_states, desc->from) : -1;
+        to[t]   = find_animation_state_desc(state_descs, num_states, desc->to);
         
-        mesh->skinned_vertices[i] = p.xyz;
+        if ((desc->from && (from[t] < 0)) || (to[t] < 0)) {
+            debug_print("Animation transition %s -> %s: state not found.\n", desc->from? desc->from : "any", desc->to);
+            ASSERT(!"Animation transition refers to a state that doesn't exist.");
+        }
+    }
+    
+    s32 num_combinations            = 1 << num_inputs;
+    machine->num_input_combinations = num_combinations;
+    machine->next_states            = PUSH_ARRAY(arena, s16, num_states*num_combinations);
+    machine->blend_durations        = PUSH_ARRAY(arena, f32, num_states*num_combinations);
+    
+    for (s32 s = 0; s < num_states; s++) {
+        for (s32 inputs = 0; inputs < num_combinations; inputs++) {
+            s32 index = s*num_combinations + inputs;
+            machine->next_states[index]     = (s16)s;
+            machine->blend_durations[index] = 0.0f;
+            
+            for (s32 t = 0; t < num_transitions; t++) {
+                Animation_Transition_Desc const *desc = &transition_descs[t];
+                if ((from[t] >= 0) && (from[t] != s))                  continue;
+                if (((u32)inputs & desc->input_mask) != desc->input_value) continue;
+                if (to[t] < 0)                                         break;
+                
+                machine->next_states[index]     = (s16)to[t];
+                machine->blend_durations[index] = (desc->blend_duration >= 0.0f)? desc->blend_duration : state_descs[to[t]].blend_duration;
+                break;
+            }
+        }
     }
+    
+    return machine;
 }
-#endif
\ No newline at end of file
@@ -24,23 +24,268 @@ inline SQT lerp(SQT a, f32 t, SQT b)
     return r;
 }
 
-inline M4x4 m4x4_from_sqt(SQT xform)
+inline M3x4 m3x4_from_sqt(SQT xform)
 {
-    M4x4 r = m4x4_from_translation_rotation_scale(xform.translation, xform.rotation, v3(xform.scale));
+    M3x4 r = m3x4_from_translation_rotation_scale(xform.translation, xform.rotation, v3(xform.scale));
     return r;
 }
 
+// Rigid transform (rotation + translation) as a unit dual quaternion. The real part is the rotation 
+// and dual = 0.5 * t * real, where t is the translation as a pure quaternion. 8 floats instead of 12.
+struct Dual_Quaternion
+{
+    Quaternion real;
+    Quaternion dual;
+};
+
+inline Dual_Quaternion dual_quaternion_from_rotation_translation(Quaternion r, V3 t)
+{
+    Dual_Quaternion result;
+    result.real = r;
+    result.dual = 0.5f * (quaternion(t, 0.0f) * r);
+    return result;
+}
+
+inline Dual_Quaternion dual_quaternion_from_affine(M3x4 const &affine)
+{
+    // @Note: Scale is thrown away. Our skinning matrices are rigid, dual quaternion skinning doesn't 
+    // support scaled joints anyway.
+    M3x3 upper = 
+    {
+        affine._11, affine._12, affine._13,
+        affine._21, affine._22, affine._23,
+        affine._31, affine._32, affine._33,
+    };
+    
+    Quaternion r = normalize_or_identity(quaternion_from_m3x3(upper));
+    return dual_quaternion_from_rotation_translation(r, get_translation(affine));
+}
+
+inline V3 transform_point(Dual_Quaternion const &dq, V3 p)
+{
+    // Rotate by the real part, then translate by the vector part of 2 * dual * conjugate(real).
+    V3 t = 2.0f * (dq.real.w*dq.dual.v - dq.dual.w*dq.real.v + cross(dq.real.v, dq.dual.v));
+    return dq.real*p + t;
+}
+
 struct Pose_Joint_Info
 {
-    // Joint-space matrices (relative to parent) for all keyframes (i.e. array.count == num_samples)
-    Array<SQT> matrices;
-    String8    name;
-    s32        parent_id;
+    String8 name;
+    s32     parent_id;
 };
 
+// Alignment of each sample stream in bytes (one cache line).
+#define SAMPLE_STREAM_ALIGNMENT 64
+
+// View of a single sample in the sample streams, i.e., num_joints transforms per stream.
+struct Pose_Sample
+{
+    Quaternion *rotations;
+    V3         *translations;
+    f32        *scales;
+};
+
+// If TRUE, animations are compressed at load time and the raw sample streams are thrown away.
+#define COMPRESS_ANIMATIONS TRUE
+
+// Threshold for deciding that a track never changes (constant-track elimination), in model units: how far
+// it moves the points around its joint (see KEYFRAME_REDUCTION_SHELL_DISTANCE) from the first sample.
+GLOBAL f32 const CONSTANT_TRACK_TOLERANCE = 1.e-5f;
+
+// If TRUE, compression also drops samples of animated tracks that can be linearly interpolated from 
+// their neighbours. The tolerance (KEYFRAME_REDUCTION_TOLERANCE unless compress_sampled_animation() is
+// given another, in model units) is on the model space positions of the joints: joints are reduced 
+// parents first, on top of their ancestors as they'll play back, and each chain splits the tolerance 
+// between its animated tracks.
+#define REDUCE_KEYFRAMES TRUE
+GLOBAL f32 const KEYFRAME_REDUCTION_TOLERANCE      = 0.0005f;
+// Rotation and scale errors are measured on points this far from the joint, plus the distance to the
+// farthest descendant, so that leaf joints (and skin attached to them) don't get a free pass.
+GLOBAL f32 const KEYFRAME_REDUCTION_SHELL_DISTANCE = 0.05f;
+
+// "Smallest three" quaternion: 2 bits for the index of the dropped (largest) component and 15 bits
+// for each of the other three, packed in 48 bits.
+struct Quantized_Quaternion
+{
+    u16 I[3];
+};
+
+enum Track_Kind
+{
+    TrackKind_ROTATION,
+    TrackKind_TRANSLATION,
+    TrackKind_SCALE,
+};
+
+// An animated track with the keys that survived keyframe reduction. The keys of all tracks of a kind
+// are stored back to back (track-major) in the clip; this track's keys start at first_key.
+struct Compressed_Track
+{
+    u16 joint_index;
+    u16 num_keys;
+    u32 first_key;
+};
+
+struct Compressed_Clip
+{
+    // Value of every track at the first sample. Constant tracks are only stored here.
+    Pose_Sample constant_pose;
+    
+    Compressed_Track *rotation_tracks;
+    Compressed_Track *translation_tracks;
+    Compressed_Track *scale_tracks;
+    s32               num_rotation_tracks;
+    s32               num_translation_tracks;
+    s32               num_scale_tracks;
+    
+    // Per track quantization ranges.
+    V3  *translation_mins;
+    V3  *translation_extents;
+    f32 *scale_mins;
+    f32 *scale_extents;
+    
+    // Sample index of each key. The first and last sample of the animation are always keys.
+    u16 *rotation_key_samples;
+    u16 *translation_key_samples;
+    u16 *scale_key_samples;
+    
+    // Quantized key values.
+    Quantized_Quaternion *rotation_keys;
+    u16                  *translation_keys; // 3 per key.
+    u16                  *scale_keys;
+    
+    u64 size_in_bytes;
+};
+
+// Horizontal translation and yaw of the root joint relative to the first sample of a clip.
+struct Root_Motion_Sample
+{
+    V3  translation; // In object space, y is always 0.
+    f32 yaw;         // Radians around the up axis, unwrapped so neighbors never differ by more than half a turn.
+};
+
+// Clips drive skeletons by joint name. The first time a clip is played on a skeleton we build the table
+// between the two (see get_joint_remap()) and keep it with the clip, so sampling just writes through it 
+// and one clip can drive any number of skeletons. Clips whose joints match the skeleton's one to one (the
+// usual case, our exporters write both in the same order) don't get a table and sample straight into the 
+// pose.
+struct Joint_Remap
+{
+    Skeleton    *skeleton;
+    Joint_Remap *next;                // Tables of the same clip for other skeletons.
+    b32          identity;
+    
+    s16 *skeleton_from_clip;          // Per clip joint: the skeleton joint it drives, -1 for none.
+    s32 *unmapped_joints;             // Skeleton joints no clip joint drives; they keep their rest pose.
+    s32  num_unmapped_joints;
+    SQT *rest_pose;                   // Per skeleton joint, relative to the parent.
+    SQT *reference_pose;              // The clip's reference pose per skeleton joint (rest pose where unmapped).
+};
+
+// If TRUE, clips whose samples take more than ANIMATION_STREAM_MIN_SIZE are streamed: the cook reduces
+// and compresses them a block at a time, loading only maps the header and the first block, later blocks
+// are read from the cooked animation on the background thread ahead of the channels that play them (see
+// prefetch_animation_blocks()), and the least recently used ones are evicted once the resident blocks 
+// go over the budget (see update_clip_streaming()). Needs COMPRESS_ANIMATIONS.
+#define STREAM_ANIMATIONS TRUE
+GLOBAL u64 const ANIMATION_STREAM_MIN_SIZE       = MEGABYTES(2); // Raw samples; about 25 seconds of 65 joints at 30 fps.
+GLOBAL f64 const ANIMATION_STREAM_BLOCK_DURATION = 4.0;          // In seconds.
+GLOBAL f64 const ANIMATION_STREAM_PREFETCH_TIME  = 0.5;          // How far ahead of the channels we read, in seconds.
+GLOBAL u64 const ANIMATION_STREAMING_BUDGET      = MEGABYTES(8); // Blocks past the first of each clip.
+
+enum Clip_Block_State
+{
+    ClipBlockState_EMPTY,
+    ClipBlockState_QUEUED,   // Waiting for or being loaded by the background thread.
+    ClipBlockState_RESIDENT,
+    ClipBlockState_FAILED,   // Couldn't read it; we sample the blocks before it instead.
+};
+
+struct Clip_Stream;
+
+// Samples first_sample to first_sample + num_samples - 1 of a streamed clip, compressed on their own. 
+// Neighboring blocks share their boundary sample, so lerping never needs two blocks.
+struct Clip_Block
+{
+    Clip_Stream *stream;
+    s32          first_sample;
+    s32          num_samples;
+    
+    // Owned by the background thread while QUEUED; everything below is only valid when RESIDENT.
+    s32 volatile state;
+    
+    // Where the block's cooked clip block (see CLIP_BLOCK_COOKED_FILE) is in the cooked animation.
+    u64 file_offset;
+    u64 file_size;
+    
+    Arena              *arena;       // Holds the cooked clip block that clip and root_motion point into; freed on eviction.
+    Compressed_Clip    *clip;
+    Root_Motion_Sample *root_motion; // The block's part of what Sampled_Animation::root_motion would be.
+    u64                 size_in_bytes;
+    
+    // Resident blocks except the first of each clip, most recently used first.
+    Clip_Block *lru_prev;
+    Clip_Block *lru_next;
+    s64         last_used_tick;
+};
+
+struct Clip_Stream
+{
+    String8 path;           // Of the cooked animation.
+    
+    Clip_Block *blocks;     // The first one is loaded with the clip and stays resident.
+    s32         num_blocks;
+    s32         samples_per_block;
+    
+    // Root motion of a whole loop (the last sample), for times past the end.
+    b32                has_root_motion;
+    Root_Motion_Sample loop_root_motion;
+};
+
+struct Clip_Streaming
+{
+    Clip_Block lru; // Sentinel of the LRU list.
+    s64        tick;
+    
+    // Stats, updated by update_clip_streaming().
+    u64          resident_bytes;
+    s32          num_resident_blocks;
+    s32          num_loads;
+    s32          num_evictions;
+    s32 volatile num_misses; // Samples that needed a block that wasn't resident yet.
+};
+
+GLOBAL Clip_Streaming clip_streaming;
+
 struct Sampled_Animation
 {
     Array<Pose_Joint_Info> joints; // array.count == num_joints
+    
+    // @Note: Joint-space transforms (relative to parent) for all samples, split into separate streams
+    // and stored sample-major, i.e., all joints of sample N are adjacent:
+    //     stream[sample_index*num_joints + joint_index]
+    // So lerping between two samples walks two contiguous runs per stream, instead of hopping across
+    // one allocation per joint.
+    // These are null if the animation is compressed.
+    Quaternion *rotations;
+    V3         *translations;
+    f32        *scales;
+    
+    Compressed_Clip *compressed;
+    
+    // Non-null if the clip is streamed; compressed and the sample streams are null then.
+    Clip_Stream *stream;
+    
+    // First sample, one per joint. Additive channels play the animation's difference from this.
+    SQT *reference_pose;
+    
+    // One per sample, precomputed at load (see get_root_motion()). Null if joint 0 isn't the root, or if
+    // the clip is streamed (its blocks have it).
+    Root_Motion_Sample *root_motion;
+    
+    // One per skeleton the clip has been played on, built on first use.
+    Joint_Remap *joint_remaps;
+    
     String8 name;
     
     f64 duration;    // In seconds.
@@ -48,18 +293,169 @@ struct Sampled_Animation
     s32 frame_rate;  // Frames/samples per second
 };
 
+// @Note: Cooked animations (.cooked_animation files next to the .sampled_animation ones, see cooked.h)
+// hold the compressed clip, reference pose and root motion of a clip. Streamed clips have no clip or 
+// root motion sections; they have the stream section and one cooked clip block per block instead, which
+// the game reads on its own when it needs the block.
+#define ANIMATION_COOKED_MAGIC  0x4D494E41 // "ANIM"
+#define CLIP_BLOCK_COOKED_MAGIC 0x4B434C42 // "BLCK"
+GLOBAL s32 const ANIMATION_COOKED_VERSION = 5;
+
+enum Animation_Section
+{
+    AnimationSection_INFO,           // Animation_Cooked_Info, one.
+    AnimationSection_JOINTS,         // Pose_Joint_Info
+    AnimationSection_REFERENCE_POSE, // SQT, one per joint.
+    AnimationSection_ROOT_MOTION,    // Root_Motion_Sample, one per sample or none.
+    AnimationSection_CLIP,           // Compressed_Clip, one or none (streamed).
+    AnimationSection_STREAM,         // Animation_Cooked_Stream, one (streamed) or none.
+    AnimationSection_BLOCKS,         // Cooked_Clip_Block, one per block of a streamed clip.
+    
+    AnimationSection_COUNT
+};
+
+struct Animation_Cooked_Info
+{
+    f64 duration;
+    s32 num_samples;
+    s32 frame_rate;
+};
+
+struct Animation_Cooked_Stream
+{
+    s32                samples_per_block;
+    s32                num_blocks;
+    b32                has_root_motion;
+    Root_Motion_Sample loop_root_motion;
+};
+
+struct Cooked_Clip_Block
+{
+    u8 *data; // A cooked clip block, in the blobs.
+    u64 size;
+};
+
+GLOBAL u32 const ANIMATION_SECTION_ELEMENT_SIZES[AnimationSection_COUNT] = 
+{
+    sizeof(Animation_Cooked_Info), sizeof(Pose_Joint_Info), sizeof(SQT), sizeof(Root_Motion_Sample), sizeof(Compressed_Clip),
+    sizeof(Animation_Cooked_Stream), sizeof(Cooked_Clip_Block),
+};
+
+GLOBAL Cooked_File_Kind const ANIMATION_COOKED_FILE = 
+{
+    ANIMATION_COOKED_MAGIC, ANIMATION_COOKED_VERSION, AnimationSection_COUNT, ANIMATION_SECTION_ELEMENT_SIZES, 
+    (u32)(sizeof(Quantized_Quaternion) << 8) | (u32)sizeof(Compressed_Track), "animation",
+};
+
+// A block of a streamed clip, laid out like a cooked file of its own so reading it in is one read and
+// relocating its pointers.
+enum Clip_Block_Section
+{
+    ClipBlockSection_CLIP,        // Compressed_Clip, one.
+    ClipBlockSection_ROOT_MOTION, // Root_Motion_Sample, one per sample of the block or none.
+    
+    ClipBlockSection_COUNT
+};
+
+GLOBAL u32 const CLIP_BLOCK_SECTION_ELEMENT_SIZES[ClipBlockSection_COUNT] = 
+{
+    sizeof(Compressed_Clip), sizeof(Root_Motion_Sample),
+};
+
+GLOBAL Cooked_File_Kind const CLIP_BLOCK_COOKED_FILE = 
+{
+    CLIP_BLOCK_COOKED_MAGIC, ANIMATION_COOKED_VERSION, ClipBlockSection_COUNT, CLIP_BLOCK_SECTION_ELEMENT_SIZES, 
+    (u32)(sizeof(Quantized_Quaternion) << 8) | (u32)sizeof(Compressed_Track), "clip block",
+};
+
+//~ Blend Space
+//
+// Clips placed at points of a 1D or 2D parameter space (speed, or speed and direction). A channel playing
+// a blend space samples the clips around its blend position (at most three) at one shared phase and blends
+// them while sampling (see set_blend_space_position() and eval_blend_space()), so a space costs one 
+// channel no matter how many clips it has.
+//
+// The shared phase walks the space's sync markers in even steps: with n markers, every clip is at its
+// marker k at phase k/n. Clips without markers get evenly spaced ones, so they just play at phase times
+// their duration.
+//
+#define MAX_SYNC_MARKERS        4
+#define MAX_BLEND_SPACE_WEIGHTS 3 // A point of a 2D space is inside a triangle of clips.
+
+struct Blend_Space_Sample_Desc
+{
+    char const *clip;             // Animation catalog name.
+    V2          position;
+    s32         num_sync_markers;
+    f32         sync_markers[MAX_SYNC_MARKERS]; // Normalized clip times, ascending.
+};
+
+struct Blend_Space_Desc
+{
+    Blend_Space_Sample_Desc const *samples;
+    s32                            num_samples;
+    
+    // 2D spaces only: triangles of sample indices covering the space. Positions outside of all of them are
+    // moved to the closest point of the closest one. Spaces without triangles only use position.x.
+    s32 const                    (*triangles)[3];
+    s32                            num_triangles;
+};
+
+struct Blend_Space_Sample
+{
+    Sampled_Animation *animation;
+    V2                 position;
+    f32                sync_markers[MAX_SYNC_MARKERS];
+};
+
+struct Blend_Space
+{
+    Blend_Space_Sample *samples;       // Sorted by position.x in 1D spaces.
+    s32                 num_samples;
+    s32                *triangles;     // Three sample indices per triangle.
+    s32                 num_triangles;
+    s32                 num_sync_markers;
+};
+
 //~ Animation Channel
 //
 
+// A compressed clip has at most a rotation, translation and scale track per joint.
+#define MAX_CHANNEL_KEY_CURSORS (3*MAX_JOINTS)
+
+// How a channel combines with the channels before it (see eval_pose()).
+enum Animation_Blend_Mode
+{
+    AnimationBlendMode_OVERRIDE, // Replaces what's below it by its weight.
+    AnimationBlendMode_ADDITIVE, // Adds its difference from its animation's reference pose on top.
+};
+
+// Animation clocks count flicks (1/705600000 of a second). Every common frame rate and our tick rate 
+// divide that, so clip lengths and ticks are whole numbers of them: looping wraps exactly, and clocks that 
+// were advanced by the same ticks agree to the bit no matter how long they've been running. A clip's 
+// sample index is clock / (ANIMATION_CLOCK_RATE / frame_rate), the remainder is the sub-sample fraction
+// (see get_clip_sample()), and a clip's clock runs from 0 to num_samples - 1 of those samples.
+#define ANIMATION_CLOCK_RATE 705600000LL
+
 struct Animation_Channel
 {
-    // In SQT form because the animation player could cross-fade/blend with other animation channels.
-    Array<SQT> lerped_joints_relative;
+    // One per track of a compressed animation (rotation tracks, then translation, then scale tracks). 
+    // Caches the key we were at last eval so finding the next key is usually a step or two forward.
+    u16 key_cursors[MAX_CHANNEL_KEY_CURSORS];
+    s32 num_key_cursors;
     
     Sampled_Animation *animation;
     
-    f64 animation_duration; // Copied from sampled animation.
-    f64 current_time;       // Local clock - will we run into synchronization issues?
+    // The channel's clock, in ANIMATION_CLOCK_RATE ticks. Looping channels stay in [0, clock_duration).
+    // current_time, old_time and animation_duration are the same in seconds, kept in step by 
+    // set_channel_time() and advance_time(); read them, don't write them.
+    s64 clock;
+    s64 old_clock;
+    s64 clock_duration;
+    s32 num_loops;          // Times the last advance_time() wrapped around the end (negative going backwards).
+    
+    f64 animation_duration;
+    f64 current_time;
     f64 old_time;
     
     // For blending with other channels. We set these from the outside (from some higher level thing) when playing animations.
@@ -73,28 +469,281 @@ struct Animation_Channel
     b32 is_looping;
     b32 is_completed;
     //b32 is_active;
+    
+    // Layering. Channels are kept sorted by layer, and play_animation() only cross-fades channels on
+    // the same layer. The weight scales the cross-fade, joint_mask (optional, one weight per joint, see
+    // make_joint_mask()) scales it per joint.
+    s32                  layer;
+    Animation_Blend_Mode blend_mode;
+    f32                  weight;
+    f32 const           *joint_mask;
+    
+    // Blend space channels (see set_blend_space()) blend these samples of the space. animation is the 
+    // heaviest one and animation_duration is their weighted duration, so current_time/animation_duration
+    // is the shared phase.
+    Blend_Space *blend_space;
+    V2           blend_position;
+    s32          blend_space_samples[MAX_BLEND_SPACE_WEIGHTS];
+    f32          blend_space_weights[MAX_BLEND_SPACE_WEIGHTS];
+    s32          num_blend_space_weights;
+    
+    // Skeleton of the player the channel belongs to, and the joint tables of animation and of the blend
+    // space clips for it. Null tables mean the clip matches the skeleton one to one.
+    Skeleton    *skeleton;
+    Joint_Remap *remap;
+    Joint_Remap *blend_space_remaps[MAX_BLEND_SPACE_WEIGHTS];
 };
 
 #define DISABLE_LERPS FALSE
 
+enum Skin_Mesh_Flags
+{
+    SkinMeshFlags_POSITIONS = 0x1,
+    SkinMeshFlags_TBNS      = 0x2, // Also skin tangents, bitangents and normals.
+};
+
+enum Skinning_Mode
+{
+    SkinningMode_LINEAR_BLEND,
+    SkinningMode_DUAL_QUATERNION, // CPU skinning only (skin_mesh()), the shader always does linear blend skinning.
+};
+
+// Animation LOD. Distance is from the camera to the center of the mesh bounds, in multiples of the bounds' 
+// radius, so small and big meshes switch at about the same size on screen. Players past min_distance are
+// evaluated every update_interval ticks and interpolated in between (see update_animation()).
+struct Animation_LOD
+{
+    f32 min_distance;
+    s32 update_interval;
+    b32 cull_detail_joints; // Freeze the local pose of detail joints (see set_mesh()).
+};
+
+GLOBAL Animation_LOD const ANIMATION_LODS[] =
+{
+    { 0.0f, 1, FALSE},
+    {10.0f, 2, FALSE},
+    {20.0f, 4, TRUE },
+    {40.0f, 8, TRUE },
+};
+
+// Switching to a coarser LOD needs this much more distance than switching back, so players sitting on
+// a threshold don't flicker between two rates.
+GLOBAL f32 const ANIMATION_LOD_HYSTERESIS = 1.1f;
+
+// Joints whose influenced vertices span less than this fraction of the mesh bounds' diagonal, along 
+// with all their children, are detail joints (fingers, end joints, etc).
+GLOBAL f32 const ANIMATION_LOD_DETAIL_JOINT_SIZE = 0.05f;
+
 // @Todo: Animation Player
 // @Todo: In set mesh function, decide the blend_mode for the anim player according to Casey's video?
 
+// Channels live inline in the player (see add_animation_channel()), so playing and blending out
+// animations doesn't allocate.
+#define MAX_CHANNELS_PER_PLAYER 8
+
 struct Animation_Player
 {
-    Array<M4x4>               skinning_matrices;
-    Array<SQT>                blended_joints_relative;
-    Array<Animation_Channel*> channels;
+    Array<M3x4>               skinning_matrices;
+    Array<M3x4>               object_space_joints;     // Joint-to-object matrices (skinning matrices without the inverse bind pose).
+    Array<SQT>                blended_joints_relative; // Pose from the last eval; we compare against it to find dirty joints.
+    Array<u64>                dirty_joints;            // One bit per joint. Joints whose object space matrix has to be recomputed.
+    Array<Animation_Channel*> channels;                // In blending order, pointing into channel_pool.
+    
+    Animation_Channel channel_pool[MAX_CHANNELS_PER_PLAYER];
+    u32               used_channels;                   // One bit per channel_pool slot.
+    
+    // Use set_skinning_mode() to change these. The dual quaternion palette is only kept up to date in
+    // SkinningMode_DUAL_QUATERNION.
+    Skinning_Mode          skinning_mode;
+    Array<Dual_Quaternion> skinning_dual_quaternions;
+    
+    // Bumped whenever the skinning palette changes.
+    u64 pose_version;
+    
+    // Animation LOD state. We evaluate at the start of a window of lod_window_ticks ticks, already at 
+    // the time of the window's last tick, and interpolate the matrices from the previous pose (lod_from)
+    // to that one (lod_to) over the window. Both hold the skinning matrices, then the object space joints.
+    s32        lod;
+    u32        lod_phase;       // Staggers the windows of players on the same LOD.
+    u32        lod_tick;
+    s32        lod_window_ticks;
+    s32        lod_window_step;
+    s64        lod_pending_clock; // Ticks passed that the channels haven't been advanced by yet. Negative within a window.
+    Array<M3x4> lod_from;
+    Array<M3x4> lod_to;
+    Array<u64> detail_joints;   // One bit per joint.
+    
+    // CPU skinning cache, filled lazily by skin_mesh() and segment_skinned_mesh_intersect(). Only the
+    // regions set in skinned_regions (see Skinning_Region) are valid, and only for skinned_pose_version.
+    Array<V3>  skinned_vertices;
+    Array<TBN> skinned_tbns;
+    Array<u64> skinned_regions;
+    u64        skinned_pose_version;
+    u32        skinned_flags;
     
     Triangle_Mesh *mesh;
     
-    f64 current_time;
+    s64 clock;        // Everything the player advanced by, in ANIMATION_CLOCK_RATE ticks.
+    f64 current_time; // Same in seconds.
     f64 current_dt;
     
     s32 num_changed_channels_last_eval;
+    s32 num_dirty_joints_last_eval;
+    
+    // Root motion. With extract_root_motion set, the root's horizontal motion and yaw are taken out of the
+    // pose, and advance_time() adds them up here instead for the game to move the entity by (see 
+    // consume_root_motion()). The translation is in the player's frame as of the last consume.
+    b32 extract_root_motion;
+    V3  root_motion_translation;
+    f32 root_motion_yaw;
+    V3  lod_root_motion_translation; // Handed out every tick of a LOD window, see update_animation().
+    f32 lod_root_motion_yaw;
     
     // @Todo: Different blend modes (neighborhood with rest pose / invert / direct)
-    // @Todo: remove locomotion
+};
+
+//~ Pose Cache
+//
+// Players that evaluate the same channels (animation or blend position, time and blend factor, all 
+// quantized) on the same mesh in the same tick end up with the same pose, so the first one to get there
+// stores its local pose and matrices and everybody else copies them. Crowds that play a few clips in lockstep cost one eval
+// per unique pose instead of one per player. Players that freeze detail joints (see Animation_LOD) 
+// depend on their own history and never use the cache.
+//
+// Entries only live for the tick they were made in; call pose_cache_begin_tick() before evaluating.
+//
+#define POSE_CACHE_MAX_CHANNELS 4
+#define POSE_CACHE_SIZE         256 // Power of 2.
+#define POSE_CACHE_POOL_SIZE    MEGABYTES(4)
+
+// Channel times are snapped to this grid and blend factors to 1/POSE_CACHE_BLEND_STEPS while the
+// cache is enabled, so a pose doesn't depend on which player computed it first.
+GLOBAL f64 const POSE_CACHE_TIME_STEP   = 1.0 / 960.0;
+GLOBAL s64 const POSE_CACHE_CLOCK_STEP  = ANIMATION_CLOCK_RATE / 960; // POSE_CACHE_TIME_STEP in clock ticks.
+GLOBAL s32 const POSE_CACHE_BLEND_STEPS = 256;
+
+struct Pose_Cache_Key_Channel
+{
+    Sampled_Animation *animation;
+    f32 const         *joint_mask;
+    s64                time;         // In POSE_CACHE_TIME_STEPs.
+    s32                blend_factor; // In 1/POSE_CACHE_BLEND_STEPS.
+    s32                blend_mode;
+    
+    // Blend space channels go in as where their blend position and phase put them: the samples around
+    // the position with their weights (in 1/POSE_CACHE_BLEND_STEPS) and the time of each sample's clip
+    // at the phase (in POSE_CACHE_TIME_STEPs). time is unused for them.
+    Blend_Space *blend_space;
+    s32          num_blend_space_weights;
+    s32          blend_space_samples[MAX_BLEND_SPACE_WEIGHTS];
+    s32          blend_space_weights[MAX_BLEND_SPACE_WEIGHTS];
+    s64          blend_space_sample_times[MAX_BLEND_SPACE_WEIGHTS];
+};
+
+struct Pose_Cache_Key
+{
+    Triangle_Mesh *mesh;
+    s32            skinning_mode;
+    b32            extract_root_motion;
+    s32            num_channels;
+    
+    Pose_Cache_Key_Channel channels[POSE_CACHE_MAX_CHANNELS];
+};
+
+enum Pose_Cache_Entry_State
+{
+    PoseCacheEntryState_EMPTY,
+    PoseCacheEntryState_WRITING,
+    PoseCacheEntryState_READY,
+};
+
+struct Pose_Cache_Entry
+{
+    // (tick << 2) | Pose_Cache_Entry_State. Entries from older ticks count as empty.
+    s64 volatile state;
+    
+    u64              hash;
+    Pose_Cache_Key   key;
+    SQT             *blended_joints_relative;
+    M3x4            *object_space_joints;
+    M3x4            *skinning_matrices;
+    Dual_Quaternion *skinning_dual_quaternions; // Only for SkinningMode_DUAL_QUATERNION.
+};
+
+struct Pose_Cache
+{
+    Pose_Cache_Entry entries[POSE_CACHE_SIZE];
+    
+    // Entry data is bump allocated from here and thrown away every tick.
+    u8          *pool;
+    s32          pool_size;
+    s32 volatile pool_used;
+    
+    s64 tick;
+    b32 enabled;
+    
+    // Stats for the current (or last finished) tick.
+    s32 volatile num_hits;
+    s32 volatile num_misses;
+};
+
+GLOBAL Pose_Cache pose_cache;
+
+//~ Animation State Machine
+//
+// Described with the tables below and compiled at load time (compile_animation_state_machine()) into 
+// clip handles and a transition table indexed by (state, inputs), where inputs is a bitset of conditions
+// the game sets every tick (grounded, moving, etc). Picking the next state is then one table lookup.
+//
+#define MAX_ANIMATION_STATE_INPUTS 8 // The table has (1 << num_inputs) entries per state.
+
+struct Animation_State_Desc
+{
+    char const *name;
+    char const *clip;           // Animation catalog name.
+    f32         blend_duration; // Cross-fade into this state.
+    b32         loop;
+    
+    // Normalized clip times of matching events (foot plants, etc), ascending. Going between two states
+    // that both have markers starts the new clip at the same place between markers as the old one.
+    s32 num_sync_markers;
+    f32 sync_markers[MAX_SYNC_MARKERS];
+    
+    // Played instead of the clip when set. Without markers of its own, the state gets the blend space's.
+    Blend_Space_Desc const *blend_space;
+};
+
+struct Animation_Transition_Desc
+{
+    char const *from;           // 0 for any state.
+    char const *to;
+    u32         input_mask;     // Taken when (inputs & input_mask) == input_value.
+    u32         input_value;
+    f32         blend_duration; // Negative to use the blend duration of the state we go to.
+};
+
+struct Animation_State
+{
+    s32          clip;          // Index into Animation_State_Machine::clips.
+    Blend_Space *blend_space;   // Played instead of the clip when set.
+    b32          loop;
+    s32          num_sync_markers;
+    f32          sync_markers[MAX_SYNC_MARKERS];
+};
+
+struct Animation_State_Machine
+{
+    Sampled_Animation **clips;
+    s32                 num_clips;
+    
+    Animation_State *states;
+    s32              num_states;
+    s32              entry_state;  // First state in the description.
+    
+    // [state*num_input_combinations + inputs]. Transitions that stay in the same state aren't taken.
+    s32  num_input_combinations;
+    s16 *next_states;
+    f32 *blend_durations;
 };
 
 #endif //ANIMATION_H
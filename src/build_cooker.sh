@@ -0,0 +1,20 @@
+#!/bin/sh
+
+# Builds the asset cooker (cooker_main.cpp) into ../build/cooker. Run it, then run the cooker, whenever
+# the exporter output in ../data changes; the game maps what the cooker writes next to it.
+
+# USED COMPILER OPTIONS:
+# -O2                  : Optimizations; cooking is the slow part of loading.
+# -ffast-math          : Like /fp:fast, so we compute the same data the game would.
+# -fno-strict-aliasing : orh.h type puns the way MSVC allows.
+# -fno-exceptions      : Like /EHa-.
+# -Wall                : Warnings, minus roughly the kinds build.bat disables.
+# -I                   : Additional include directories.
+
+CF="-std=c++17 -O2 -g -ffast-math -fno-strict-aliasing -fno-exceptions -pthread -Wall -Wno-comment -Wno-sign-compare -Wno-unused-function -Wno-unused-variable -Wno-unused-but-set-variable -Wno-missing-braces -Wno-class-memaccess -I../src/vendor"
+
+cd "$(dirname "$0")"
+mkdir -p ../build
+cd ../build
+
+c++ $CF -DDEVELOPER=1 -o cooker ../src/cooker_main.cpp
@@ -0,0 +1,277 @@
+//~ Cooked Files
+//
+
+FUNCTION u64 get_cooked_hash(void const *data, u64 size, u64 hash = 14695981039346656037ULL)
+{
+    // FNV-1a. Pass the previous result as hash to continue it.
+    u8 const *bytes = (u8 const *) data;
+    for (u64 i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    
+    return hash;
+}
+
+FUNCTION u32 get_cooked_layout_hash(Cooked_File_Kind const *kind)
+{
+    // Everything that decides where things are in a cooked file of this kind.
+    
+    u32 values[] = {(u32)sizeof(void *), (u32)sizeof(Cooked_File_Header), (u32)sizeof(Cooked_Section), kind->layout_constant};
+    u64 hash     = get_cooked_hash(kind->element_sizes, kind->num_sections * sizeof(u32));
+    hash         = get_cooked_hash(values, sizeof(values), hash);
+    
+    return (u32)(hash ^ (hash >> 32));
+}
+
+FUNCTION inline u32 get_cooked_element_size(Cooked_File_Kind const *kind, s32 section)
+{
+    if (section <  kind->num_sections) return kind->element_sizes[section];
+    if (section == kind->num_sections) return sizeof(u8); // Blobs.
+    return sizeof(u64);                                    // Fixups.
+}
+
+FUNCTION inline Cooked_Section* get_cooked_sections(String8 file)
+{
+    return (Cooked_Section *)(file.data + sizeof(Cooked_File_Header));
+}
+
+//~ Cooked File Writing
+//
+
+FUNCTION Cooked_File_Writer begin_cooked_file(Arena *arena, Cooked_File_Kind const *kind, s64 const *counts, u64 max_blob_size, s64 max_fixups)
+{
+    // @Note: counts has one per own section of the kind. The blobs go last since callers only know an
+    // upper bound of their size (including alignment padding).
+    
+    s32 num_sections = kind->num_sections + 2;
+    u64 first_offset = ALIGN_UP(sizeof(Cooked_File_Header) + num_sections*sizeof(Cooked_Section), COOKED_FILE_ALIGNMENT);
+    
+    u64 blobs_offset = first_offset;
+    for (s32 i = 0; i < kind->num_sections; i++)
+        blobs_offset = ALIGN_UP(blobs_offset + (u64)counts[i] * kind->element_sizes[i], COOKED_FILE_ALIGNMENT);
+    u64 fixups_offset = blobs_offset;
+    blobs_offset      = ALIGN_UP(blobs_offset + (u64)max_fixups * sizeof(u64), COOKED_FILE_ALIGNMENT);
+    
+    Cooked_File_Writer writer = {};
+    writer.kind        = kind;
+    writer.base        = PUSH_ARRAY_ZERO(arena, u8, blobs_offset + max_blob_size);
+    writer.sections    = get_cooked_sections(str8(writer.base, blobs_offset));
+    writer.blob_cursor = blobs_offset;
+    writer.fixups      = (u64 *)(writer.base + fixups_offset);
+    writer.max_fixups  = max_fixups;
+    
+    u64 cursor = first_offset;
+    for (s32 i = 0; i < kind->num_sections; i++) {
+        Cooked_Section *section = &writer.sections[i];
+        section->offset = cursor;
+        section->count  = counts[i];
+        section->size   = (u64)counts[i] * kind->element_sizes[i];
+        cursor          = ALIGN_UP(cursor + section->size, COOKED_FILE_ALIGNMENT);
+    }
+    writer.sections[kind->num_sections].offset     = blobs_offset;
+    writer.sections[kind->num_sections + 1].offset = fixups_offset;
+    
+    return writer;
+}
+
+FUNCTION inline void* get_section_data(Cooked_File_Writer *writer, s32 section)
+{
+    return writer->base + writer->sections[section].offset;
+}
+
+FUNCTION void write_cooked_blob(Cooked_File_Writer *writer, void *pointer, void const *data, u64 size, u64 alignment)
+{
+    // Copies data to the blobs and stores its offset in pointer, a pointer field inside the file.
+    
+    u64 offset = 0;
+    if (size) {
+        ASSERT(writer->num_fixups < writer->max_fixups);
+        
+        writer->blob_cursor = ALIGN_UP(writer->blob_cursor, alignment);
+        offset              = writer->blob_cursor;
+        MEMORY_COPY(writer->base + offset, data, size);
+        writer->blob_cursor += size;
+        
+        writer->fixups[writer->num_fixups++] = (u64)((u8 *)pointer - writer->base);
+    }
+    
+    MEMORY_COPY(pointer, &offset, sizeof(offset));
+}
+
+FUNCTION void write_cooked_string(Cooked_File_Writer *writer, String8 *s)
+{
+    // Zero terminated like str8_copy() strings; the blobs start out zeroed.
+    write_cooked_blob(writer, &s->data, s->data, s->count, 1);
+    if (s->count) writer->blob_cursor++;
+}
+
+FUNCTION String8 end_cooked_file(Cooked_File_Writer *writer, u64 source_date, u64 source_size, u64 source_hash)
+{
+    // Returns the whole file, ready to be written.
+    
+    Cooked_File_Kind const *kind = writer->kind;
+    Cooked_Section *blobs        = &writer->sections[kind->num_sections];
+    Cooked_Section *fixups       = &writer->sections[kind->num_sections + 1];
+    
+    blobs->size   = writer->blob_cursor - blobs->offset;
+    blobs->count  = (s64)blobs->size;
+    fixups->count = writer->num_fixups;
+    fixups->size  = writer->num_fixups * sizeof(u64);
+    
+    Cooked_File_Header header = {};
+    header.magic        = kind->magic;
+    header.version      = kind->version;
+    header.layout_hash  = get_cooked_layout_hash(kind);
+    header.num_sections = kind->num_sections + 2;
+    header.source_date  = source_date;
+    header.source_size  = source_size;
+    header.source_hash  = source_hash;
+    header.file_size    = writer->blob_cursor;
+    header.content_hash = get_cooked_hash(writer->base + sizeof(header), header.file_size - sizeof(header));
+    MEMORY_COPY(writer->base, &header, sizeof(header));
+    
+    return str8(writer->base, header.file_size);
+}
+
+//~ Cooked File Loading
+//
+
+FUNCTION b32 is_valid_cooked_file(String8 file, Cooked_File_Kind const *kind)
+{
+    // Checks that everything is where the header says it is, not whether the file is up to date.
+    
+    if (file.count < sizeof(Cooked_File_Header)) return FALSE;
+    
+    Cooked_File_Header *header = (Cooked_File_Header *) file.data;
+    s32 num_sections           = kind->num_sections + 2;
+    if ((header->magic        != kind->magic)   ||
+        (header->version      != kind->version) ||
+        (header->layout_hash  != get_cooked_layout_hash(kind)) ||
+        (header->num_sections != num_sections)  ||
+        (header->file_size    != file.count)    ||
+        (file.count < sizeof(Cooked_File_Header) + num_sections*sizeof(Cooked_Section)))
+        return FALSE;
+    
+    Cooked_Section *sections = get_cooked_sections(file);
+    for (s32 i = 0; i < num_sections; i++) {
+        Cooked_Section *section = &sections[i];
+        if ((section->offset % COOKED_FILE_ALIGNMENT) || (section->offset > file.count) || (section->count < 0) ||
+            (section->size > file.count - section->offset) || (section->size != (u64)section->count * get_cooked_element_size(kind, i)))
+            return FALSE;
+    }
+    
+    // The pointers have to be in the file and point into it.
+    Cooked_Section *fixups_section = &sections[kind->num_sections + 1];
+    u64 const *fixups              = (u64 const *)(file.data + fixups_section->offset);
+    for (s64 i = 0; i < fixups_section->count; i++) {
+        if ((fixups[i] % sizeof(u64)) || (fixups[i] > file.count - sizeof(u64))) return FALSE;
+        if (*(u64 const *)(file.data + fixups[i]) >= file.count)                 return FALSE;
+    }
+    
+    return TRUE;
+}
+
+FUNCTION b32 is_cooked_content_intact(String8 file)
+{
+    Cooked_File_Header *header = (Cooked_File_Header *) file.data;
+    return header->content_hash == get_cooked_hash(file.data + sizeof(Cooked_File_Header), file.count - sizeof(Cooked_File_Header));
+}
+
+FUNCTION b32 is_cooked_file_up_to_date(String8 file, File_Info *source)
+{
+    Cooked_File_Header *header = (Cooked_File_Header *) file.data;
+    if (header->source_size != source->file_size) return FALSE;
+    if (header->source_date == source->file_date) return TRUE;
+    
+    // Same size but another date: the data was probably copied or checked out again. Reading the source
+    // to hash it is still a lot cheaper than cooking it.
+    String8 source_file = os->read_entire_file(source->full_path);
+    if (!source_file.data) return FALSE;
+    
+    b32 result = (get_cooked_hash(source_file.data, source_file.count) == header->source_hash);
+    os->free_file_memory(source_file.data);
+    
+    return result;
+}
+
+FUNCTION void relocate_cooked_file(String8 file, Cooked_File_Kind const *kind)
+{
+    // Turns the pointers of a valid cooked file from offsets into addresses; file has to be writable.
+    
+    Cooked_Section *fixups_section = &get_cooked_sections(file)[kind->num_sections + 1];
+    u64 const *fixups              = (u64 const *)(file.data + fixups_section->offset);
+    for (s64 i = 0; i < fixups_section->count; i++) {
+        u64 *pointer = (u64 *)(file.data + fixups[i]);
+        *pointer    += (u64)file.data;
+    }
+}
+
+FUNCTION String8 map_cooked_file(String8 full_path, Cooked_File_Kind const *kind, File_Info *source)
+{
+    // @Note: No parsing or copying; past validating the header and relocating the pointers, the cost is
+    // whatever page faults the asset's users take. Returns an empty string if there's no usable file.
+    
+    String8 file = os->map_file(full_path);
+    if (!file.data) return file;
+    
+    if (!is_valid_cooked_file(file, kind) || !is_cooked_file_up_to_date(file, source)) {
+        debug_print("Cooked %s %S is stale or broken, cooking it again.\n", kind->name, full_path);
+        os->unmap_file(file.data);
+        return {};
+    }
+    
+    relocate_cooked_file(file, kind);
+    return file;
+}
+
+FUNCTION inline void* get_section_data(String8 file, s32 section)
+{
+    return file.data + get_cooked_sections(file)[section].offset;
+}
+
+template<typename T>
+void point_array_at_section(Array<T> *array, String8 file, s32 section)
+{
+    array->arena    = 0;
+    array->data     = (T *) get_section_data(file, section);
+    array->count    = get_cooked_sections(file)[section].count;
+    array->capacity = array->count;
+}
+
+//~ Source Validation
+//
+// Helpers for validating exporter output before we trust its counts and indices.
+//
+
+FUNCTION b32 validation_error(String8 full_path, char const *message)
+{
+    debug_print("VALIDATION ERROR: %S: %s\n", full_path, message);
+    return FALSE;
+}
+
+FUNCTION b32 get_checked(String8 *file, void *data, u64 size)
+{
+    if (file->count < size) return FALSE;
+    
+    get(file, data, size);
+    return TRUE;
+}
+
+template<typename T>
+b32 get_checked(String8 *file, T *data)
+{
+    return get_checked(file, data, sizeof(T));
+}
+
+FUNCTION b32 are_finite(f32 const *values, u64 count)
+{
+    // @Note: Checks the exponent bits; with fast math the compiler may assume comparisons never see NaNs.
+    for (u64 i = 0; i < count; i++) {
+        u32 bits;
+        MEMORY_COPY(&bits, &values[i], sizeof(bits));
+        if ((bits & 0x7F800000) == 0x7F800000) return FALSE;
+    }
+    
+    return TRUE;
+}
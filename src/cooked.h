@@ -0,0 +1,68 @@
+#ifndef COOKED_H
+#define COOKED_H
+
+// @Note: Cooked files hold assets laid out the way we use them at runtime. They're written by the asset
+// cooker (cooker_main.cpp), or by the game when it has to load an asset from its exporter output because
+// nobody cooked it. A cooked file is a Cooked_File_Header, the section table, then the sections, each
+// aligned to COOKED_FILE_ALIGNMENT. Every kind of cooked file (see Cooked_File_Kind) has its own sections,
+// followed by two sections every kind has:
+// - The blobs: whatever the pointers inside the other sections point to (names, per bucket arrays, ...).
+//   Pointers are stored as offsets from the start of the file.
+// - The fixups: file offsets of those pointers, so the loader only has to add the base address to them.
+// Loading a cooked file is a copy-on-write mapping of it; arrays point straight into the mapping.
+//
+// The header remembers the date, size and hash of the source file. A cooked file is up to date when the
+// date and size still match, or when only the date changed (the data was copied or checked out again) and
+// the hash still matches. The content hash covers everything after the header; the cooker checks it
+// before trusting a file it didn't write, the game doesn't since that would touch every page.
+#define COOKED_FILE_ALIGNMENT 64
+
+// The cooker defines this to 1; it builds the asset code without the renderer.
+#ifndef COOKER
+#define COOKER 0
+#endif
+
+struct Cooked_File_Kind
+{
+    u32         magic;
+    s32         version;         // Bump it whenever the sections or what we compute for them change.
+    s32         num_sections;    // The kind's own sections.
+    u32 const  *element_sizes;   // One per own section.
+    u32         layout_constant; // Anything else the layout depends on, e.g. fixed array sizes.
+    char const *name;            // For messages.
+};
+
+struct Cooked_Section
+{
+    u64 offset;
+    u64 size;
+    s64 count;
+};
+
+struct Cooked_File_Header
+{
+    u32 magic;
+    s32 version;
+    u32 layout_hash;  // See get_cooked_layout_hash().
+    s32 num_sections; // Including the blobs and fixups. The section table follows the header.
+    
+    u64 source_date;  // Of the exporter output we cooked this from.
+    u64 source_size;
+    u64 source_hash;  // See get_cooked_hash().
+    u64 content_hash; // Of everything after the header.
+    u64 file_size;
+};
+
+struct Cooked_File_Writer
+{
+    Cooked_File_Kind const *kind;
+    Cooked_Section         *sections;
+    
+    u8  *base;
+    u64  blob_cursor; // From base, like everything else.
+    u64 *fixups;
+    s64  num_fixups;
+    s64  max_fixups;
+};
+
+#endif //COOKED_H
@@ -0,0 +1,256 @@
+/* cooker_main.cpp - the asset cooker.
+
+Turns the exporter output in the data folder (.mesh and .sampled_animation files from the Blender
+exporters) into the cooked files the game maps at startup (.cooked_mesh and .cooked_animation, see
+cooked.h). It's built from the same mesh.cpp and animation.cpp as the game, so a cooked file is exactly
+what the game would have computed at load time. Build it with build_cooker.sh.
+
+Usage: cooker [--force] [data_folder]
+
+Every source is validated before it's cooked; broken ones are reported and make the cooker exit with 1.
+Sources whose cooked file is up to date are skipped without being read. Sources that only got a new date
+(copied or checked out again) are hashed, and if the hash still matches we only refresh the date in the
+cooked file. Long clips are cooked a block at a time, for the game to stream (see Clip Streaming in 
+animation.cpp). --force cooks everything again.
+
+*/
+
+#define COOKER 1
+#include "linux_base.cpp"
+
+#define ORH_STATIC
+#define ORH_IMPLEMENTATION
+#include "orh.h"
+#include "orh_collision.cpp"
+#include "orh_jobs.cpp"
+
+// The asset code keeps pointers to these; the cooker never makes any.
+struct Texture;
+struct ID3D11Buffer;
+
+// World base vectors, same as game.h.
+GLOBAL V3 V3ZERO = V3_ZERO;
+GLOBAL V3 V3F    = V3_FORWARD;
+GLOBAL V3 V3U    = V3_UP;
+GLOBAL V3 V3R    = V3_RIGHT;
+
+#include "shaders/skeletal_mesh_pbr.h"
+#include "cooked.h"
+#include "mesh.h"
+#include "animation.h"
+#include "catalog.h"
+
+#include "cooked.cpp"
+#include "mesh.cpp"
+#include "animation.cpp"
+
+enum Cook_Result
+{
+    CookResult_UP_TO_DATE, // Skipped.
+    CookResult_REFRESHED,  // Same contents, only the source date changed.
+    CookResult_COOKED,
+    CookResult_STREAMED,   // Long clips, cooked a block at a time for the game to stream.
+    CookResult_FAILED,
+    
+    CookResult_COUNT
+};
+
+// Padded since debug_print() has no field widths.
+GLOBAL char const *COOK_RESULT_NAMES[CookResult_COUNT] = {"up to date", "refreshed ", "cooked    ", "streamed  ", "FAILED    "};
+
+struct Cooker
+{
+    String8    data_folder;
+    File_Group textures;
+    b32        force;
+    
+    s32 num_results[CookResult_COUNT];
+    u64 bytes_written;
+};
+GLOBAL Cooker cooker;
+
+FUNCTION Cook_Result check_cooked_file(Arena *arena, String8 cooked_path, Cooked_File_Kind const *kind, File_Info *source, String8 *source_file_out)
+{
+    // @Note: Returns CookResult_COOKED if the source has to be cooked, with its contents in source_file_out.
+    // Up to date files are told apart from their header alone. Only when the source's date changed do 
+    // we hash it, and read the whole cooked file to check it before keeping it.
+    
+    File_Info *cooked_info = os->get_all_files_in_path(arena, cooked_path).first_file_info;
+    
+    Cooked_File_Header header = {};
+    b32 header_valid = cooked_info && !cooker.force &&
+        (os->read_file_range(cooked_path, 0, &header, sizeof(header)) == sizeof(header)) &&
+        (header.magic       == kind->magic)   &&
+        (header.version     == kind->version) &&
+        (header.layout_hash == get_cooked_layout_hash(kind)) &&
+        (header.file_size   == cooked_info->file_size);
+    
+    if (header_valid && (header.source_date == source->file_date) && (header.source_size == source->file_size))
+        return CookResult_UP_TO_DATE;
+    
+    String8 source_file = os->read_entire_file(source->full_path);
+    if (!source_file.data) return CookResult_FAILED;
+    
+    if (header_valid && (header.source_size == source_file.count) &&
+        (header.source_hash == get_cooked_hash(source_file.data, source_file.count))) {
+        String8 cooked = os->read_entire_file(cooked_path);
+        b32 cooked_valid = cooked.data && is_valid_cooked_file(cooked, kind) && is_cooked_content_intact(cooked);
+        os->free_file_memory(cooked.data);
+        
+        if (cooked_valid) {
+            os->free_file_memory(source_file.data);
+            
+            // Only the date changed, so only the header is rewritten.
+            header.source_date = source->file_date;
+            if (!os->write_file_range(cooked_path, 0, str8((u8 *) &header, sizeof(header)))) return CookResult_FAILED;
+            
+            cooker.bytes_written += sizeof(header);
+            return CookResult_REFRESHED;
+        }
+    }
+    
+    *source_file_out = source_file;
+    return CookResult_COOKED;
+}
+
+FUNCTION void check_mesh_textures(Triangle_Mesh *mesh)
+{
+    // The game looks textures up by base name in the texture catalog.
+    
+    for (s32 i = 0; i < mesh->material_info.count; i++) {
+        for (s32 map_index = 0; map_index < MaterialTextureMapType_COUNT; map_index++) {
+            String8 map_name = mesh->material_info[i].texture_map_names[map_index];
+            if (str8_empty(map_name)) continue;
+            
+            b32 found = FALSE;
+            for (File_Info *info = cooker.textures.first_file_info; info && !found; info = info->next)
+                found = (info->base_name == map_name);
+            if (!found)
+                debug_print("WARNING: %S: texture %S isn't in the textures folder\n", mesh->full_path, map_name);
+        }
+    }
+}
+
+FUNCTION Cook_Result cook_mesh_file(File_Info *source)
+{
+    Arena_Temp scratch = get_scratch(0, 0);
+    defer(free_scratch(scratch));
+    
+    String8 cooked_path = get_cooked_mesh_path(scratch.arena, source->full_path);
+    String8 source_file = {};
+    Cook_Result result  = check_cooked_file(scratch.arena, cooked_path, &MESH_COOKED_FILE, source, &source_file);
+    if (result != CookResult_COOKED) return result;
+    defer(os->free_file_memory(source_file.data));
+    
+    Triangle_Mesh mesh = {};
+    mesh.full_path     = source->full_path;
+    if (!load_and_cook_mesh(scratch.arena, &mesh, source_file, source->full_path))
+        return CookResult_FAILED;
+    check_mesh_textures(&mesh);
+    
+    u64 source_hash = get_cooked_hash(source_file.data, source_file.count);
+    String8 cooked  = build_cooked_mesh(scratch.arena, &mesh, source->file_date, source->file_size, source_hash);
+    if (!os->write_entire_file(cooked_path, cooked)) return CookResult_FAILED;
+    
+    cooker.bytes_written += cooked.count;
+    return CookResult_COOKED;
+}
+
+FUNCTION Cook_Result cook_animation_file(File_Info *source)
+{
+    Arena_Temp scratch = get_scratch(0, 0);
+    defer(free_scratch(scratch));
+    
+    String8 cooked_path = get_cooked_animation_path(scratch.arena, source->full_path);
+    String8 source_file = {};
+    Cook_Result result  = check_cooked_file(scratch.arena, cooked_path, &ANIMATION_COOKED_FILE, source, &source_file);
+    if (result != CookResult_COOKED) return result;
+    defer(os->free_file_memory(source_file.data));
+    
+    u64 source_hash = get_cooked_hash(source_file.data, source_file.count);
+    
+    // Version, frame rate, number of samples and number of joints.
+    s32 counts[4] = {};
+    if (source_file.count >= sizeof(counts))
+        MEMORY_COPY(counts, source_file.data, sizeof(counts));
+    
+    String8 cooked = {};
+    if (should_stream_animation(counts[1], counts[2], counts[3])) {
+        cooked = cook_streamed_animation(scratch.arena, source_file, source->full_path, source->file_date, source->file_size, source_hash);
+        if (!cooked.data) return CookResult_FAILED;
+        result = CookResult_STREAMED;
+    } else {
+        Sampled_Animation anim = {};
+        if (!load_and_cook_sampled_animation(scratch.arena, &anim, source_file, source->full_path))
+            return CookResult_FAILED;
+        cooked = build_cooked_animation(scratch.arena, &anim, source->file_date, source->file_size, source_hash);
+    }
+    if (!os->write_entire_file(cooked_path, cooked)) return CookResult_FAILED;
+    
+    cooker.bytes_written += cooked.count;
+    return result;
+}
+
+FUNCTION s32 cook_files(char const *wildcard, Cook_Result (*cook_file)(File_Info *source))
+{
+    // Returns the number of sources.
+    
+    Arena_Temp scratch = get_scratch(0, 0);
+    defer(free_scratch(scratch));
+    
+    String8 path_wild = sprint(scratch.arena, "%S%s", cooker.data_folder, wildcard);
+    File_Group group  = os->get_all_files_in_path(scratch.arena, path_wild);
+    for (File_Info *info = group.first_file_info; info; info = info->next) {
+        Cook_Result result = cook_file(info);
+        cooker.num_results[result]++;
+        debug_print("%s %S\n", COOK_RESULT_NAMES[result], info->full_path);
+    }
+    
+    return (s32)group.file_count;
+}
+
+int main(int argc, char **argv)
+{
+    linux_os_state_init();
+    
+    for (s32 i = 1; i < argc; i++) {
+        String8 arg = str8_cstring(argv[i]);
+        if (arg == S8LIT("--force")) {
+            cooker.force = TRUE;
+        } else if (arg.count && (arg.data[0] != '-')) {
+            // Paths from the command line are used as prefixes, so make sure there's a slash.
+            b32 slash        = (arg.data[arg.count - 1] == '/');
+            cooker.data_folder = sprint(os->permanent_arena, slash? "%S" : "%S/", arg);
+        } else {
+            debug_print("Usage: %s [--force] [data_folder]\n", argv[0]);
+            return 1;
+        }
+    }
+    
+    // Same place the game looks for it (see win32_build_paths()).
+    if (!cooker.data_folder.count)
+        cooker.data_folder = sprint(os->permanent_arena, "%S../data/", os->exe_parent_folder);
+    os->data_folder = cooker.data_folder;
+    
+    String8 textures_wild = sprint(os->permanent_arena, "%Stextures/*.*", cooker.data_folder);
+    cooker.textures       = os->get_all_files_in_path(os->permanent_arena, textures_wild);
+    
+    s32 num_sources = 0;
+    num_sources    += cook_files("meshes/*.mesh",                  cook_mesh_file);
+    num_sources    += cook_files("animations/*.sampled_animation", cook_animation_file);
+    if (!num_sources) {
+        debug_print("No exporter output in %S\n", cooker.data_folder);
+        return 1;
+    }
+    
+    Arena_Temp scratch = get_scratch(0, 0);
+    defer(free_scratch(scratch));
+    
+    String8 written = cooker.bytes_written? sprint(scratch.arena, "wrote %m", cooker.bytes_written) : S8LIT("nothing to write");
+    debug_print("\n%d cooked, %d streamed, %d refreshed, %d up to date, %d failed; %S.\n",
+                cooker.num_results[CookResult_COOKED], cooker.num_results[CookResult_STREAMED],
+                cooker.num_results[CookResult_REFRESHED], cooker.num_results[CookResult_UP_TO_DATE],
+                cooker.num_results[CookResult_FAILED], written);
+    
+    return cooker.num_results[CookResult_FAILED]? 1 : 0;
+}
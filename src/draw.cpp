@@ -22,7 +22,7 @@ FUNCTION void draw_entity(Entity *e)
         
         vs_constants.flags |= VSConstantsFlags_SHOULD_SKIN;
         
-        MEMORY_COPY(vs_constants.skinning_matrices, e->animation_player->skinning_matrices.data, matrix_count * sizeof(M4x4));
+        MEMORY_COPY(vs_constants.skinning_matrices, e->animation_player->skinning_matrices.data, matrix_count * sizeof(M3x4));
     }
     skeletal_mesh_pbr_upload_vertex_constants(vs_constants);
     
@@ -70,7 +70,8 @@ FUNCTION void draw_entity(Entity *e)
         skeletal_mesh_pbr_upload_pixel_constants(ps_constants);
         
         // Draw.
-        device_context->DrawIndexed(list->num_indices, list->first_index, 0);
+        Mesh_LOD_List *lod_list = get_lod_list(mesh, e->mesh_lod, list_index);
+        device_context->DrawIndexed(lod_list->num_indices, lod_list->first_index, 0);
     }
 }
 
@@ -98,7 +99,7 @@ FUNCTION void draw_entity_wireframe(Entity *e)
         
         vs_constants.flags |= VSConstantsFlags_SHOULD_SKIN;
         
-        MEMORY_COPY(vs_constants.skinning_matrices, e->animation_player->skinning_matrices.data, matrix_count * sizeof(M4x4));
+        MEMORY_COPY(vs_constants.skinning_matrices, e->animation_player->skinning_matrices.data, matrix_count * sizeof(M3x4));
     }
     skeletal_mesh_pbr_upload_vertex_constants(vs_constants);
     
@@ -117,8 +118,8 @@ FUNCTION void draw_entity_wireframe(Entity *e)
     
     // Draw triangle lists.
     for (s32 list_index = 0; list_index < mesh->triangle_list_info.count; list_index++) {
-        Triangle_List_Info *list = &mesh->triangle_list_info[list_index];
-        device_context->DrawIndexed(list->num_indices, list->first_index, 0);
+        Mesh_LOD_List *lod_list = get_lod_list(mesh, e->mesh_lod, list_index);
+        device_context->DrawIndexed(lod_list->num_indices, lod_list->first_index, 0);
     }
 }
 
@@ -142,17 +143,11 @@ FUNCTION void draw_skeleton(Entity *e)
         for (s32 i = 0; i < player->skinning_matrices.count; i++) {
             s32 parent_index = skeleton->joint_info[i].parent_id;
             
-            // @Note: The skinning matrices contain the global joint matrices + the inverse bind pose.
-            // We want to get rid of the inverse bind pose part, so we'll just multiply with its inverse
-            // to get the identity matrix.
             // @Note: points are in object space.
-            M4x4 inv;
-            invert(skeleton->joint_info[i].object_to_joint_matrix, &inv);
-            V3 p0 = get_translation(player->skinning_matrices[i] * inv);
+            V3 p0 = get_translation(player->object_space_joints[i]);
             
             if (parent_index >= 0) {
-                invert(skeleton->joint_info[parent_index].object_to_joint_matrix, &inv);
-                V3 p1 = get_translation(player->skinning_matrices[parent_index] * inv);
+                V3 p1 = get_translation(player->object_space_joints[parent_index]);
                 
                 immediate_begin();
                 d3d11_clear_depth();
@@ -173,9 +168,7 @@ FUNCTION void draw_skeleton(Entity *e)
     if (DRAW_JOINT_NAMES) {
         // Draw skeleton names.
         for (s32 i = 0; i < player->skinning_matrices.count; i++) {
-            M4x4 inv;
-            invert(skeleton->joint_info[i].object_to_joint_matrix, &inv);
-            V3 p = get_translation(player->skinning_matrices[i] * inv);
+            V3 p = get_translation(player->object_space_joints[i]);
             
             V3 p_pixel = world_to_pixel(transform_point(e->object_to_world.forward, p));
             String8 joint_name = skeleton->joint_info[i].name;
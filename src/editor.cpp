@@ -20,6 +20,9 @@ FUNCTION void draw_main_editor_window()
             //
             ImGui::Checkbox("Draw Joint Lines", (bool*) &DRAW_JOINT_LINES);
             ImGui::Checkbox("Draw Joint Names", (bool*) &DRAW_JOINT_NAMES);
+            ImGui::Checkbox("Share Poses", (bool*) &pose_cache.enabled);
+            ImGui::Text("Pose cache: %d hits, %d misses", pose_cache.num_hits, pose_cache.num_misses);
+            ImGui::Text("Clip streaming: %d blocks (%.2f MB), %d loads, %d evictions, %d misses", clip_streaming.num_resident_blocks, clip_streaming.resident_bytes / (f64)MEGABYTES(1), clip_streaming.num_loads, clip_streaming.num_evictions, clip_streaming.num_misses);
             
             ImGui::Separator();
             
@@ -68,6 +71,24 @@ FUNCTION void draw_main_editor_window()
                 if (ImGui::DragFloat3("Scale", e->scale.I, 0.005f, 1.0f, F32_MAX, "%.3f")) {
                 }
                 
+                //
+                // Skinning mode (only affects CPU skinning, e.g. mouse picking).
+                //
+                if (e->animation_player) {
+                    const char *skinning_modes[] = {"Linear Blend", "Dual Quaternion"};
+                    s32 skinning_mode = (s32) e->animation_player->skinning_mode;
+                    if (ImGui::Combo("Skinning", &skinning_mode, skinning_modes, ARRAY_COUNT(skinning_modes)))
+                        set_skinning_mode(e->animation_player, (Skinning_Mode) skinning_mode);
+                    
+                    Animation_LOD lod = ANIMATION_LODS[e->animation_player->lod];
+                    ImGui::Text("Animation LOD: %d (every %d ticks%s)", e->animation_player->lod, lod.update_interval, lod.cull_detail_joints? ", detail joints frozen" : "");
+                }
+                
+                if (e->mesh) {
+                    Mesh_LOD *lod = &e->mesh->lods[e->mesh_lod];
+                    ImGui::Text("Mesh LOD: %d (%d triangles)", e->mesh_lod, lod->num_indices / 3);
+                }
+                
                 //
                 // Mesh
                 //
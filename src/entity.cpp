@@ -34,6 +34,9 @@ FUNCTION Animation_Player* create_animation_player_for_entity(Entity *e)
     init(new_player);
     set_mesh(new_player, e->mesh);
     
+    // Consecutive ids land on different ticks of the LOD update windows.
+    new_player->lod_phase = e->id;
+    
     e->animation_player = new_player;
     return new_player;
 }
@@ -43,7 +46,8 @@ FUNCTION void set_mesh_on_entity(Entity *entity, Triangle_Mesh *mesh)
     if (!mesh) return;
     
     Triangle_Mesh *old_mesh = entity->mesh;
-    entity->mesh = mesh;
+    entity->mesh     = mesh;
+    entity->mesh_lod = 0;
     
     if (mesh->flags & MeshFlags_ANIMATED) {
         // If first time setting mesh, then create animation player.
@@ -103,8 +107,42 @@ FUNCTION void entity_manager_init(Entity_Manager *manager, Triangle_Mesh *player
 #endif
 }
 
-FUNCTION Animation_Channel* play_animation(Entity *e, Sampled_Animation *anim, b32 loop = TRUE, f64 blend_duration = 0.2)
+FUNCTION Animation_Channel* cross_fade_to_new_channel(Animation_Player *player, f64 blend_duration, s32 layer)
 {
+    // Blends out everything on the layer and adds a channel that blends in. Its blend_t is how far in
+    // the cross-fade starts, which is also the time the new animation should start at.
+    
+    // Players on a coarse LOD have already advanced their channels to the end of the current window
+    // (see update_animation()), so start the cross-fade that far in to stay in sync with them.
+    f64 time_ahead = animation_clock_to_seconds(MAX(0, -player->lod_pending_clock));
+    
+    // Blend out current animations.
+    for (s32 i = 0; i < player->channels.count; i++) {
+        Animation_Channel *channel = player->channels[i];
+        if (channel->layer != layer) continue;
+        
+        channel->blend_duration = blend_duration;
+        channel->blending_out   = TRUE;
+        channel->blend_t        = time_ahead;
+    }
+    
+    // Blend in new animation.
+    // Only fails when the layer had no channels to blend out, so nothing changed.
+    Animation_Channel *new_channel = add_animation_channel(player, layer);
+    if (!new_channel) return 0;
+    
+    new_channel->blend_duration = blend_duration;
+    new_channel->blending_in    = TRUE;
+    new_channel->blend_t        = time_ahead;
+    
+    return new_channel;
+}
+
+FUNCTION Animation_Channel* play_animation(Entity *e, Sampled_Animation *anim, b32 loop = TRUE, f64 blend_duration = 0.2, s32 layer = 0)
+{
+    // @Note: Cross-fades from whatever plays on the layer to anim. Set blend_mode, weight and joint_mask
+    // on the returned channel to play it over the layers below it.
+    
     ASSERT(e);
     
     Animation_Player *player = e->animation_player;
@@ -112,32 +150,144 @@ FUNCTION Animation_Channel* play_animation(Entity *e, Sampled_Animation *anim, b
     if (!anim)   return 0;
     
     for (s32 i = 0; i < player->channels.count; i++) {
-        if (player->channels[i]->animation == anim) {
+        if (player->channels[i]->layer != layer) continue;
+        if (player->channels[i]->blending_out)    continue;
+        if ((player->channels[i]->animation == anim) && !player->channels[i]->blend_space) {
             // The passed animation is already playing.
             //debug_print("Animation %S already playing on Entity %S\n", anim->name, e->name);
             return 0;
         }
     }
     
-    // Blend out current animations.
+    Animation_Channel *new_channel = cross_fade_to_new_channel(player, blend_duration, layer);
+    if (!new_channel) return 0;
+    
+    set_animation(new_channel, anim, new_channel->blend_t);
+    new_channel->is_looping = loop;
+    
+    return new_channel;
+}
+
+FUNCTION Animation_Channel* play_blend_space(Entity *e, Blend_Space *space, V2 position, b32 loop = TRUE, f64 blend_duration = 0.2, s32 layer = 0)
+{
+    // @Note: Like play_animation(). If the blend space is already playing on the layer, this just moves
+    // its blend position, so call it every tick with the new position.
+    
+    ASSERT(e);
+    
+    Animation_Player *player = e->animation_player;
+    if (!player) return 0;
+    if (!space)  return 0;
+    
     for (s32 i = 0; i < player->channels.count; i++) {
         Animation_Channel *channel = player->channels[i];
-        channel->blend_duration = blend_duration;
-        channel->blending_out   = TRUE;
-        channel->blend_t        = 0;
+        if (channel->layer != layer) continue;
+        if (channel->blending_out)    continue;
+        if (channel->blend_space == space) {
+            set_blend_space_position(channel, position);
+            return 0;
+        }
     }
     
-    // Blend in new animation.
-    Animation_Channel *new_channel = add_animation_channel(player);
-    set_animation(new_channel, anim, 0);
-    new_channel->blend_duration = blend_duration;
-    new_channel->blending_in    = TRUE;
-    new_channel->blend_t        = 0;
-    new_channel->is_looping     = loop;
+    Animation_Channel *new_channel = cross_fade_to_new_channel(player, blend_duration, layer);
+    if (!new_channel) return 0;
+    
+    set_blend_space(new_channel, space, position, new_channel->blend_t);
+    new_channel->is_looping = loop;
     
     return new_channel;
 }
 
+FUNCTION f64 get_synced_start_time(Animation_State *from, f64 from_phase, Animation_State *to)
+{
+    // @Note: Phases are normalized clip times. Returns the phase that is as far between two of to's sync
+    // markers as from_phase is between two of from's; 0 unless both states have markers.
+    
+    if (!from->num_sync_markers || !to->num_sync_markers) return 0.0;
+    
+    // Find the marker we're past; before the first one we're still past the last one (it wraps).
+    s32 n = from->num_sync_markers;
+    s32 k = n - 1;
+    for (s32 i = 0; i < n; i++) {
+        if (from_phase >= from->sync_markers[i]) k = i;
+    }
+    
+    f64 start  = from->sync_markers[k];
+    f64 end    = from->sync_markers[(k + 1) % n] + ((k + 1 >= n)? 1.0 : 0.0);
+    f64 phase  = (from_phase < start)? from_phase + 1.0 : from_phase;
+    f64 t      = (end > start)? (phase - start) / (end - start) : 0.0;
+    
+    s32 m      = to->num_sync_markers;
+    s32 to_k   = k % m;
+    f64 to_start = to->sync_markers[to_k];
+    f64 to_end   = to->sync_markers[(to_k + 1) % m] + ((to_k + 1 >= m)? 1.0 : 0.0);
+    
+    f64 result = to_start + t*(to_end - to_start);
+    return result - floor(result);
+}
+
+FUNCTION Animation_Channel* play_animation_state(Entity *e, Animation_State *state, V2 blend_position, f64 blend_duration = 0.2)
+{
+    Animation_State_Machine *machine = e->animation_state_machine;
+    if (state->blend_space)
+        return play_blend_space(e, state->blend_space, blend_position, state->loop, blend_duration);
+    
+    return play_animation(e, machine->clips[state->clip], state->loop, blend_duration);
+}
+
+FUNCTION void set_animation_state(Entity *e, s32 state_index, V2 blend_position, f64 blend_duration)
+{
+    Animation_State_Machine *machine = e->animation_state_machine;
+    Animation_Player *player         = e->animation_player;
+    Animation_State *from            = &machine->states[e->animation_state];
+    Animation_State *to              = &machine->states[state_index];
+    
+    // The newest channel on the base layer is the one the current state plays.
+    f64 from_phase = 0.0;
+    for (s32 i = player->channels.count - 1; i >= 0; i--) {
+        Animation_Channel *channel = player->channels[i];
+        if (channel->layer != 0) continue;
+        
+        if (channel->animation_duration > 0.0) from_phase = channel->current_time / channel->animation_duration;
+        break;
+    }
+    
+    e->animation_state = state_index;
+    
+    Animation_Channel *channel = play_animation_state(e, to, blend_position, blend_duration);
+    if (channel) {
+        // play_animation() might have started the channel ahead already (LOD windows).
+        set_channel_clock(channel, channel->clock + seconds_to_animation_clock(get_synced_start_time(from, from_phase, to) * channel->animation_duration));
+    }
+}
+
+FUNCTION void set_animation_state_machine(Entity *e, Animation_State_Machine *machine)
+{
+    if (!e || !e->animation_player) return;
+    
+    e->animation_state_machine = machine;
+    e->animation_state         = machine->entry_state;
+    
+    play_animation_state(e, &machine->states[machine->entry_state], {});
+}
+
+FUNCTION void update_animation_state(Entity *e, u32 inputs, V2 blend_position = {})
+{
+    // @Note: inputs is a bitset of the conditions the state machine was compiled with. blend_position
+    // goes to the blend space of the state we end up in, if it has one.
+    
+    Animation_State_Machine *machine = e->animation_state_machine;
+    if (!machine) return;
+    
+    s32 index = e->animation_state*machine->num_input_combinations + (s32)(inputs & (u32)(machine->num_input_combinations - 1));
+    s32 next  = machine->next_states[index];
+    if (next != e->animation_state) {
+        set_animation_state(e, next, blend_position, machine->blend_durations[index]);
+    } else if (machine->states[next].blend_space) {
+        play_blend_space(e, machine->states[next].blend_space, blend_position);
+    }
+}
+
 FUNCTION inline b32 is_grounded(Entity *e)
 {
     // @Hack:
@@ -145,6 +295,48 @@ FUNCTION inline b32 is_grounded(Entity *e)
     return result;
 }
 
+FUNCTION void select_animation_lod(Entity *e, V3 camera_position)
+{
+    // Distance from the camera to the center of the mesh bounds, in multiples of the bounds' world space radius.
+    Rect3 bounds = e->mesh->bounding_box;
+    V3 center    = transform_point(e->object_to_world.forward, get_center(bounds));
+    f32 scale    = MAX(MAX(ABS(e->scale.x), ABS(e->scale.y)), ABS(e->scale.z));
+    f32 radius   = 0.5f * length(get_size(bounds)) * scale;
+    
+    set_animation_lod_distance(e->animation_player, safe_div0(length(center - camera_position), radius));
+}
+
+FUNCTION void select_mesh_lod(Entity *e, V3 camera_position)
+{
+    // @Note: The coarsest LOD whose error, at the distance of the mesh bounds, projects to less than 
+    // MESH_LOD_MAX_SCREEN_ERROR pixels. LOD errors are fractions of the bounds' radius, so that's the 
+    // projected size of the bounds times the error.
+    
+    Triangle_Mesh *mesh = e->mesh;
+    Rect3 bounds = mesh->bounding_box;
+    V3 center    = transform_point(e->object_to_world.forward, get_center(bounds));
+    f32 scale    = MAX(MAX(ABS(e->scale.x), ABS(e->scale.y)), ABS(e->scale.z));
+    f32 radius   = 0.5f * length(get_size(bounds)) * scale;
+    f32 distance = length(center - camera_position);
+    
+    // Inside the bounds, the closest triangles could be right in front of the camera.
+    if (distance <= radius) {
+        e->mesh_lod = 0;
+        return;
+    }
+    
+    // The projection maps [-1, 1] to the render height.
+    f32 projected_radius = radius * view_to_proj_matrix.forward._22 / distance * 0.5f * (f32)os->render_size.h;
+    
+    s32 lod = 0;
+    for (s32 i = 1; i < (s32)mesh->lods.count; i++) {
+        f32 max_error = MESH_LOD_MAX_SCREEN_ERROR;
+        if (i > e->mesh_lod) max_error /= MESH_LOD_HYSTERESIS;
+        if (mesh->lods[i].error * projected_radius <= max_error) lod = i;
+    }
+    e->mesh_lod = lod;
+}
+
 FUNCTION void update_entity(Entity *e)
 {
     Input_State *input = &os->tick_input;
@@ -207,20 +399,44 @@ FUNCTION void update_entity(Entity *e)
             
             //~ Animation.
             
-            Sampled_Animation *anim_to_play = find(&game->animation_catalog, S8LIT("bot_fall"));
-            if (is_grounded(e)) {
-                anim_to_play = find(&game->animation_catalog, S8LIT("bot_idle"));
-                if (move.x || move.y)
-                    anim_to_play = find(&game->animation_catalog, S8LIT("bot_run"));
-            }
-            play_animation(e, anim_to_play);
+            u32 inputs = 0;
+            if (is_grounded(e)) inputs |= BotAnimationInput_GROUNDED;
+            
+            V2 ground_velocity = {e->velocity.x, e->velocity.z};
+            update_animation_state(e, inputs, {length(ground_velocity), 0.0f});
         } break;
     }
     
+    // Players that extract root motion move their entity (it's from the last tick's animate_entities()).
+    if (e->animation_player && e->animation_player->extract_root_motion) {
+        V3  translation;
+        f32 yaw;
+        consume_root_motion(e->animation_player, &translation, &yaw);
+        
+        e->position   += e->orientation * hadamard_mul(translation, e->scale);
+        e->orientation = e->orientation * quaternion_from_axis_angle(V3U, yaw);
+    }
+    
     update_entity_transform(e);
     
-    advance_time(e->animation_player, os->tick_dt);
-    eval(e->animation_player);
+    if (e->mesh)
+        select_mesh_lod(e, game->camera.position);
+    if (e->animation_player) {
+        select_animation_lod(e, game->camera.position);
+        prefetch_animation_blocks(e->animation_player);
+    }
+}
+
+FUNCTION void animate_entities(void *data, s32 first, s32 one_past_last)
+{
+    // @Note: Runs on the job system (see parallel_for()), so this can't touch anything but the entities'
+    // own animation players. Gameplay code that decides what to play runs before this in update_entity().
+    
+    Entity_Manager *manager = (Entity_Manager *) data;
+    for (s32 i = first; i < one_past_last; i++) {
+        Entity *e = find_entity(manager, manager->all_entities[i]);
+        update_animation(e->animation_player, os->tick_dt);
+    }
 }
 
 #if DEVELOPER
@@ -4,6 +4,44 @@
 // @Todo: We are using poor man's id generation.
 GLOBAL u32 entity_id_counter;
 
+// Number of entities a job system thread animates before going back for more (see animate_entities()).
+#define ANIMATION_JOB_BATCH_SIZE 8
+
+// Inputs of the bot animation state machine, set by update_entity() every tick.
+enum Bot_Animation_Input
+{
+    BotAnimationInput_GROUNDED = 0x1,
+    
+    BotAnimationInput_COUNT    = 1,
+};
+
+// By ground speed. The player tops out at 4 units per second (acceleration over friction, see update_entity()).
+// Run markers are the left and right foot plants.
+GLOBAL Blend_Space_Sample_Desc const BOT_LOCOMOTION_SAMPLES[] =
+{
+    {"bot_idle", {0.0f, 0.0f}},
+    {"bot_run",  {4.0f, 0.0f}, 2, {0.32f, 0.81f}},
+};
+
+GLOBAL Blend_Space_Desc const BOT_LOCOMOTION = {BOT_LOCOMOTION_SAMPLES, (s32)ARRAY_COUNT(BOT_LOCOMOTION_SAMPLES)};
+
+// Falling and running both swing the arms. The markers are where the left hand, then the right hand, is
+// highest over the other one, so landing picks up the arm swing where the fall left it and the other way
+// around. Locomotion markers are phases of the blend space; bot_run's are 0.58 and 0.10 of the clip.
+GLOBAL Animation_State_Desc const BOT_ANIMATION_STATES[] =
+{
+    // Entry state first.
+    {"locomotion", 0,          0.2f, TRUE, 2, {0.265f, 0.784f}, &BOT_LOCOMOTION},
+    {"fall",       "bot_fall", 0.2f, TRUE, 2, {0.03f,  0.53f}},
+};
+
+GLOBAL Animation_Transition_Desc const BOT_ANIMATION_TRANSITIONS[] =
+{
+    // From any state: mask the inputs, compare against value, first match wins.
+    {0, "fall",       BotAnimationInput_GROUNDED, 0,                          -1.0f},
+    {0, "locomotion", BotAnimationInput_GROUNDED, BotAnimationInput_GROUNDED, -1.0f},
+};
+
 enum Entity_Type
 {
     EntityType_NONE,
@@ -18,10 +56,15 @@ struct Entity
     M4x4_Inverse object_to_world;
     String8 name;
     Triangle_Mesh *mesh;
+    s32 mesh_lod; // Drawn and picked; see select_mesh_lod().
     
     // @Note: Every entity with an animated mesh must have an animation player.
     Animation_Player *animation_player;
     
+    // Optional, drives what the animation player plays (see update_animation_state()).
+    Animation_State_Machine *animation_state_machine;
+    s32                      animation_state;
+    
     Quaternion orientation;
     V3         position;
     V3         scale;
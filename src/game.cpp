@@ -1,4 +1,5 @@
 
+#include "cooked.cpp"
 #include "mesh.cpp"
 #include "animation.cpp"
 #include "entity.cpp"
@@ -191,10 +192,18 @@ FUNCTION void game_init()
     load_meshes(os->permanent_arena, &game->mesh_catalog);
     load_animations(os->permanent_arena, &game->animation_catalog);
     
+    pose_cache_init(os->permanent_arena);
+    
+    game->bot_state_machine = compile_animation_state_machine(os->permanent_arena, &game->animation_catalog, 
+                                                              BOT_ANIMATION_STATES,      ARRAY_COUNT(BOT_ANIMATION_STATES),
+                                                              BOT_ANIMATION_TRANSITIONS, ARRAY_COUNT(BOT_ANIMATION_TRANSITIONS),
+                                                              BotAnimationInput_COUNT);
+    
     game->rng = random_seed(123);
     
     Triangle_Mesh *bot_mesh = find(&game->mesh_catalog, S8LIT("bot"));
     entity_manager_init(&game->entity_manager, bot_mesh);
+    set_animation_state_machine(get_player(&game->entity_manager), game->bot_state_machine);
     
 #if 0
     // @Temporary: Spawn floor.
@@ -276,13 +285,23 @@ FUNCTION void game_tick_update()
     Entity_Manager *manager = &game->entity_manager;
     
     //
-    // Update all entities.
+    // Update all entities (gameplay). Serial, because this is free to touch the camera, catalogs, etc.
     //
     for (s32 i = 0; i < manager->all_entities.count; i++) {
         Entity *e = find_entity(manager, manager->all_entities[i]);
         update_entity(e);
     }
     
+    //
+    // Advance and evaluate all animation players in parallel. Players that end up with the same pose 
+    // share it through the pose cache.
+    //
+    pose_cache_begin_tick();
+    parallel_for((s32)manager->all_entities.count, ANIMATION_JOB_BATCH_SIZE, animate_entities, manager);
+    
+    // Nobody is sampling clips now, so this is where streamed blocks get evicted.
+    update_clip_streaming();
+    
 #if DEVELOPER
     if (game->mode == GameMode_DEBUG) {
         V3 camera_position = game->camera.position;
@@ -358,14 +377,14 @@ FUNCTION void game_tick_update()
                 if (segment_aabb_intersect(a, b, mesh->bounding_box.min, mesh->bounding_box.max) == FALSE)
                     continue;
                 
-                V3 *vertices = mesh->vertices.data;
-                if (mesh->flags & MeshFlags_ANIMATED) {
-                    skin_mesh(e->animation_player);
-                    vertices = mesh->skinned_vertices.data;
-                }
-                
+                // Animated meshes only skin the parts the segment can hit, and reuse them until the pose changes.
+                // Either way we test the LOD we draw.
+                Mesh_LOD *lod = &mesh->lods[e->mesh_lod];
                 Hit_Result hit;
-                segment_mesh_intersect(a, b, vertices, mesh->vertices.count, mesh->indices.data, mesh->indices.count, &hit);
+                if (mesh->flags & MeshFlags_ANIMATED)
+                    segment_skinned_mesh_intersect(e->animation_player, a, b, &hit, e->mesh_lod);
+                else
+                    segment_mesh_intersect(a, b, mesh->vertices.data, mesh->vertices.count, mesh->indices.data + lod->first_index, lod->num_indices, &hit);
                 if (hit.result && (hit.percent < sort_index)) {
                     sort_index     = hit.percent;
                     best_entity_id = manager->all_entities[i];
@@ -7,6 +7,7 @@ GLOBAL V3 V3F    = V3_FORWARD;
 GLOBAL V3 V3U    = V3_UP;
 GLOBAL V3 V3R    = V3_RIGHT;
 
+#include "cooked.h"
 #include "mesh.h"
 #include "animation.h"
 #include "entity.h"
@@ -56,6 +57,8 @@ struct Game_State
     Catalog<Triangle_Mesh>     mesh_catalog;
     Catalog<Sampled_Animation> animation_catalog;
     
+    Animation_State_Machine *bot_state_machine;
+    
     Random_PCG rng;
     Entity_Manager entity_manager;
     
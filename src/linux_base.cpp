@@ -0,0 +1,315 @@
+/* linux_base.cpp - v0.01 - base functionality for command line tools (the asset cooker) on Linux.
+
+Only the parts of OS_State that don't need a window: memory, file IO and printing.
+
+*/
+
+////////////////////////////////
+//~ Includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fnmatch.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "orh.h"
+
+////////////////////////////////
+//~ Globals
+#define LINUX_MAX_MAPPED_FILES 256
+struct Linux
+{
+    OS_State state;
+    
+    // munmap() needs the size of the mapping.
+    void *mapped_files    [LINUX_MAX_MAPPED_FILES];
+    u64   mapped_file_sizes[LINUX_MAX_MAPPED_FILES];
+    
+    char  exe_full_path    [256];
+    char  exe_parent_folder[256];
+};
+GLOBAL Linux _linux;
+
+////////////////////////////////
+//~ OS State API
+
+//~ Misc
+FUNCTION void linux_print_to_debug_output(String8 text)
+{
+    fwrite(text.data, 1, text.count, stdout);
+    fflush(stdout);
+}
+
+//~ Memory
+FUNCTION void* linux_reserve(u64 size)
+{
+    void *memory = mmap(0, size, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    return (memory == MAP_FAILED)? 0 : memory;
+}
+
+FUNCTION void  linux_release(void *memory)
+{
+    // @Incomplete: munmap() needs the size; arenas are only released at exit in the tools.
+}
+
+FUNCTION b32  linux_commit(void *memory, u64 size)
+{
+    b32 result = (mprotect(memory, size, PROT_READ|PROT_WRITE) == 0);
+    return result;
+}
+
+FUNCTION void  linux_decommit(void *memory, u64 size)
+{
+    madvise(memory, size, MADV_DONTNEED);
+    mprotect(memory, size, PROT_NONE);
+}
+
+//~ File IO
+FUNCTION void linux_free_file_memory(void *memory)
+{
+    free(memory);
+}
+
+FUNCTION String8 linux_read_entire_file(String8 full_path)
+{
+    String8 result = {};
+    
+    int fd = open((char*)full_path.data, O_RDONLY);
+    if (fd < 0) {
+        linux_print_to_debug_output(S8LIT("OS Error: read_entire_file() open() failed!\n"));
+        return result;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        u64 file_size = (u64)st.st_size;
+        result.data   = (u8 *) malloc(file_size + 1);
+        
+        u64 bytes_read = 0;
+        while (result.data && (bytes_read < file_size)) {
+            ssize_t n = read(fd, result.data + bytes_read, file_size - bytes_read);
+            if (n <= 0) break;
+            bytes_read += (u64)n;
+        }
+        
+        if (result.data && (bytes_read == file_size)) {
+            result.count = file_size;
+        } else {
+            linux_print_to_debug_output(S8LIT("OS Error: read_entire_file() read() failed!\n"));
+            
+            free(result.data);
+            result.data = 0;
+        }
+    } else {
+        linux_print_to_debug_output(S8LIT("OS Error: read_entire_file() fstat() failed!\n"));
+    }
+    
+    close(fd);
+    
+    return result;
+}
+
+FUNCTION u64 linux_read_file_range(String8 full_path, u64 offset, void *dest, u64 size)
+{
+    int fd = open((char*)full_path.data, O_RDONLY);
+    if (fd < 0) {
+        linux_print_to_debug_output(S8LIT("OS Error: read_file_range() open() failed!\n"));
+        return 0;
+    }
+    
+    u64 result = 0;
+    while (result < size) {
+        ssize_t n = pread(fd, (u8 *)dest + result, size - result, (off_t)(offset + result));
+        if (n <= 0) break;
+        result += (u64)n;
+    }
+    
+    close(fd);
+    
+    return result;
+}
+
+FUNCTION String8 linux_map_file(String8 full_path)
+{
+    String8 result = {};
+    
+    int fd = open((char*)full_path.data, O_RDONLY);
+    if (fd < 0) {
+        // Not an error, callers check whether files they might have written are there.
+        return result;
+    }
+    
+    struct stat st;
+    if ((fstat(fd, &st) == 0) && st.st_size) {
+        s32 slot = -1;
+        for (s32 i = 0; i < LINUX_MAX_MAPPED_FILES; i++) {
+            if (!_linux.mapped_files[i]) { slot = i; break; }
+        }
+        
+        void *memory = (slot >= 0)? mmap(0, (u64)st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+        if (memory != MAP_FAILED) {
+            _linux.mapped_files[slot]      = memory;
+            _linux.mapped_file_sizes[slot] = (u64)st.st_size;
+            
+            result.data  = (u8 *) memory;
+            result.count = (u64)st.st_size;
+        } else {
+            linux_print_to_debug_output(S8LIT("OS Error: map_file() mmap() failed!\n"));
+        }
+    }
+    
+    close(fd);
+    
+    return result;
+}
+
+FUNCTION void linux_unmap_file(void *memory)
+{
+    if (!memory) return;
+    
+    for (s32 i = 0; i < LINUX_MAX_MAPPED_FILES; i++) {
+        if (_linux.mapped_files[i] == memory) {
+            munmap(memory, _linux.mapped_file_sizes[i]);
+            _linux.mapped_files[i] = 0;
+            break;
+        }
+    }
+}
+
+FUNCTION b32 linux_write_entire_file(String8 full_path, String8 data)
+{
+    b32 result = FALSE;
+    
+    int fd = open((char*)full_path.data, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    if (fd < 0) {
+        linux_print_to_debug_output(S8LIT("OS Error: write_entire_file() open() failed!\n"));
+        return result;
+    }
+    
+    u64 bytes_written = 0;
+    while (bytes_written < data.count) {
+        ssize_t n = write(fd, data.data + bytes_written, data.count - bytes_written);
+        if (n <= 0) break;
+        bytes_written += (u64)n;
+    }
+    
+    if (bytes_written == data.count) {
+        result = TRUE;
+    } else {
+        linux_print_to_debug_output(S8LIT("OS Error: write_entire_file() write() failed!\n"));
+    }
+    
+    close(fd);
+    
+    return result;
+}
+
+FUNCTION b32 linux_write_file_range(String8 full_path, u64 offset, String8 data)
+{
+    b32 result = FALSE;
+    
+    int fd = open((char*)full_path.data, O_WRONLY);
+    if (fd < 0) {
+        linux_print_to_debug_output(S8LIT("OS Error: write_file_range() open() failed!\n"));
+        return result;
+    }
+    
+    u64 bytes_written = 0;
+    while (bytes_written < data.count) {
+        ssize_t n = pwrite(fd, data.data + bytes_written, data.count - bytes_written, (off_t)(offset + bytes_written));
+        if (n <= 0) break;
+        bytes_written += (u64)n;
+    }
+    
+    if (bytes_written == data.count) {
+        result = TRUE;
+    } else {
+        linux_print_to_debug_output(S8LIT("OS Error: write_file_range() pwrite() failed!\n"));
+    }
+    
+    close(fd);
+    
+    return result;
+}
+
+FUNCTION File_Group linux_get_all_files_in_path(Arena *arena, String8 path_wildcard)
+{
+    // Like FindFirstFile(), the wildcard can only be in the file name. Dates are in the same unit as
+    // Windows' (100ns since 1601) so cooked files remember the same kind of date on both.
+    
+    File_Group result = {};
+    
+    Arena_Temp scratch = get_scratch(&arena, 1);
+    defer(free_scratch(scratch));
+    
+    String8 directory = extract_parent_folder(path_wildcard);
+    String8 pattern   = str8_copy(scratch.arena, extract_file_name(path_wildcard));
+    String8 dir_path  = str8_copy(scratch.arena, directory.count? directory : S8LIT("./"));
+    
+    DIR *dir = opendir((char*)dir_path.data);
+    if (!dir) return result;
+    
+    for (struct dirent *entry = readdir(dir); entry; entry = readdir(dir)) {
+        if (fnmatch((char*)pattern.data, entry->d_name, FNM_PERIOD) != 0) continue;
+        
+        String8 file_name = str8_cstring(entry->d_name); // Includes extension.
+        String8 full_path = str8_cat(arena, directory, file_name);
+        
+        struct stat st;
+        if ((stat((char*)full_path.data, &st) != 0) || !S_ISREG(st.st_mode)) continue;
+        
+        File_Info *info = PUSH_STRUCT_ZERO(arena, File_Info);
+        
+        info->next      = result.first_file_info;
+        info->file_date = ((u64)st.st_mtim.tv_sec + 11644473600ULL)*10000000ULL + (u64)st.st_mtim.tv_nsec/100;
+        info->file_size = (u64)st.st_size;
+        info->full_path = full_path;
+        info->base_name = str8_copy(arena, extract_base_name(file_name));
+        
+        result.first_file_info = info;
+        result.file_count++;
+    }
+    
+    closedir(dir);
+    
+    return result;
+}
+
+////////////////////////////////
+//~ OS_State init
+FUNCTION void linux_os_state_init()
+{
+    os = &_linux.state;
+    
+    // Meta-data.
+    ssize_t length = readlink("/proc/self/exe", _linux.exe_full_path, sizeof(_linux.exe_full_path) - 1);
+    if (length > 0) {
+        _linux.exe_full_path[length] = 0;
+        String8 parent = extract_parent_folder(str8_cstring(_linux.exe_full_path));
+        MEMORY_COPY(_linux.exe_parent_folder, parent.data, parent.count);
+    }
+    _linux.state.exe_full_path     = str8_cstring(_linux.exe_full_path);
+    _linux.state.exe_parent_folder = str8_cstring(_linux.exe_parent_folder);
+    
+    // Functions.
+    _linux.state.print_to_debug_output = linux_print_to_debug_output;
+    _linux.state.reserve               = linux_reserve;
+    _linux.state.release               = linux_release;
+    _linux.state.commit                = linux_commit;
+    _linux.state.decommit              = linux_decommit;
+    _linux.state.read_entire_file      = linux_read_entire_file;
+    _linux.state.read_file_range       = linux_read_file_range;
+    _linux.state.write_entire_file     = linux_write_entire_file;
+    _linux.state.write_file_range      = linux_write_file_range;
+    _linux.state.map_file              = linux_map_file;
+    _linux.state.unmap_file            = linux_unmap_file;
+    _linux.state.free_file_memory      = linux_free_file_memory;
+    _linux.state.get_all_files_in_path = linux_get_all_files_in_path;
+    
+    // Arenas.
+    _linux.state.permanent_arena = arena_init();
+}
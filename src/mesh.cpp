@@ -74,8 +74,10 @@ FUNCTION void load_mesh_data(Arena *arena, Triangle_Mesh *mesh, String8 file)
         for (s32 i = 0; i < header.num_skeleton_joints; i++) {
             Skeleton_Joint_Info *joint = &skeleton->joint_info[i];
             
-            // Read 4x4 matrix.
-            get(&file, &joint->object_to_joint_matrix);
+            // Read 4x4 matrix. It's affine, so we only keep the top 3 rows.
+            M4x4 object_to_joint_matrix;
+            get(&file, &object_to_joint_matrix);
+            joint->object_to_joint_matrix = m3x4(object_to_joint_matrix);
             
             // Read the joint's rest pose rotation relative to its parent.
             get(&file, &joint->rest_pose_rotation_relative);
@@ -107,16 +109,12 @@ FUNCTION void load_mesh_data(Arena *arena, Triangle_Mesh *mesh, String8 file)
             }
         }
         
-#if DEVELOPER
-        // @Note: We keep those for mouse-picking.
-        array_init_and_resize(&mesh->skinned_vertices, header.num_vertices);
-        array_copy(&mesh->skinned_vertices, mesh->vertices);
-#endif
     }
     
     ASSERT(file.count == 0);
 }
 
+#if !COOKER
 FUNCTION void load_mesh_textures(Triangle_Mesh *mesh)
 {
     for (s32 list_index = 0; list_index < mesh->triangle_list_info.count; list_index++) {
@@ -141,44 +139,217 @@ FUNCTION void load_mesh_textures(Triangle_Mesh *mesh)
         }
     }
 }
+#endif
 
-FUNCTION void generate_buffers_for_mesh(Triangle_Mesh *mesh)
+//~ Vertex Packing
+//
+// Encoders and CPU decoders of the packed Vertex_XTBNUCJW. The CPU skinning data is built from decoded
+// vertices, so what we skin and pick on the CPU is what the GPU draws.
+//
+
+FUNCTION u16 f32_to_f16(f32 value)
 {
-    s64 num_vertices = mesh->vertices.count;
+    // Rounds to nearest even. Values too big for a half clamp to the biggest one; UVs don't need infinities.
     
-    Arena_Temp scratch = get_scratch(0, 0);
-    Vertex_XTBNUCJW *vertex_buffer = PUSH_ARRAY_ZERO(scratch.arena, Vertex_XTBNUCJW, num_vertices);
+    u32 bits;
+    MEMORY_COPY(&bits, &value, sizeof(bits));
+    u32 sign      = (bits >> 16) & 0x8000;
+    u32 magnitude = bits & 0x7FFFFFFF;
+    
+    if (magnitude >= 0x477FF000) return (u16)(sign | 0x7BFF);
+    if (magnitude <  0x38800000) {
+        // Subnormal half, in units of 2^-24.
+        f32 abs_value;
+        MEMORY_COPY(&abs_value, &magnitude, sizeof(abs_value));
+        return (u16)(sign | (u32)(abs_value * 16777216.0f + 0.5f));
+    }
+    
+    u32 result = (magnitude - 0x38000000) >> 13; // Rebias the exponent from 127 to 15.
+    u32 rest   = magnitude & 0x1FFF;
+    if ((rest > 0x1000) || ((rest == 0x1000) && (result & 1)))
+        result++;
+    return (u16)(sign | result);
+}
+
+FUNCTION f32 f16_to_f32(u16 half)
+{
+    u32 sign     = (u32)(half & 0x8000) << 16;
+    u32 exponent = (half >> 10) & 0x1F;
+    u32 mantissa = half & 0x3FF;
+    
+    u32 bits;
+    if (exponent == 0) {
+        f32 result = (f32)mantissa / 16777216.0f;
+        return sign? -result : result;
+    } else if (exponent == 31) {
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    
+    f32 result;
+    MEMORY_COPY(&result, &bits, sizeof(result));
+    return result;
+}
+
+FUNCTION inline u8 pack_unorm8(f32 value)
+{
+    return (u8)(CLAMP01(value) * U8_MAX + 0.5f);
+}
+
+FUNCTION void pack_vertex_tbn(TBN tbn, s16 *out)
+{
+    // Orthonormalize around the normal, keeping the handedness of the bitangent, and store the rotation
+    // from the X, Y and Z axes to the frame.
+    
+    V3 n = normalize_or_zero(tbn.normal);
+    if (n == V3ZERO) n = {0.0f, 0.0f, 1.0f};
+    
+    V3 t = normalize_or_zero(tbn.tangent - n*dot(n, tbn.tangent));
+    if (t == V3ZERO) t = normalize(cross((ABS(n.x) < 0.9f)? V3{1.0f, 0.0f, 0.0f} : V3{0.0f, 1.0f, 0.0f}, n));
+    
+    V3 b = cross(n, t);
+    
+    M3x3 m = {};
+    for (s32 i = 0; i < 3; i++) {
+        m.II[i][0] = t.I[i];
+        m.II[i][1] = b.I[i];
+        m.II[i][2] = n.I[i];
+    }
+    Quaternion q = normalize(quaternion_from_m3x3(m));
+    
+    // q and -q are the same rotation, so the sign of w is free to hold the handedness. It can't be 0 then.
+    f32 const min_w = 1.0f / S16_MAX;
+    if (q.w < 0.0f) q = -q;
+    if (q.w < min_w) {
+        q.xyz *= _sqrt(1.0f - SQUARE(min_w));
+        q.w    = min_w;
+    }
+    if (dot(b, tbn.bitangent) < 0.0f) q = -q;
+    
+    for (s32 i = 0; i < 4; i++)
+        out[i] = (s16)_round(CLAMP(-1.0f, q.I[i], 1.0f) * S16_MAX);
+}
+
+FUNCTION TBN unpack_vertex_tbn(Vertex_XTBNUCJW const *vertex)
+{
+    Quaternion q;
+    for (s32 i = 0; i < 4; i++)
+        q.I[i] = MAX(-1.0f, (f32)vertex->tbn[i] / S16_MAX);
+    q = normalize(q);
+    
+    TBN result;
+    result.tangent   = q * V3{1.0f, 0.0f, 0.0f};
+    result.bitangent = q * V3{0.0f, 1.0f, 0.0f};
+    result.normal    = q * V3{0.0f, 0.0f, 1.0f};
+    if (q.w < 0.0f)
+        result.bitangent = -result.bitangent;
+    return result;
+}
+
+FUNCTION void pack_vertex_blend(Vertex_Blend_Info const *blend_info, u8 *joint_ids, u8 *weights)
+{
+    // Weights are normalized and rounded so that they add up to exactly 255; the rounding remainder goes 
+    // to the pieces that lost the most.
+    
+    for (s32 i = 0; i < MAX_JOINTS_PER_VERTEX; i++) {
+        joint_ids[i] = VERTEX_NO_JOINT;
+        weights[i]   = 0;
+    }
+    if (!blend_info || !blend_info->num_pieces) return;
+    
+    s32 num_pieces = blend_info->num_pieces;
+    f32 weight_sum = 0.0f;
+    for (s32 i = 0; i < num_pieces; i++)
+        weight_sum += blend_info->pieces[i].weight;
+    
+    f32 remainders[MAX_JOINTS_PER_VERTEX];
+    u32 total = 0;
+    for (s32 i = 0; i < num_pieces; i++) {
+        f32 weight    = weight_sum? blend_info->pieces[i].weight / weight_sum : 1.0f / num_pieces;
+        f32 scaled    = CLAMP01(weight) * U8_MAX;
+        joint_ids[i]  = (u8)blend_info->pieces[i].joint_id;
+        weights[i]    = (u8)scaled;
+        remainders[i] = scaled - weights[i];
+        total        += weights[i];
+    }
+    
+    while (total < U8_MAX) {
+        s32 biggest = 0;
+        for (s32 i = 1; i < num_pieces; i++) {
+            if (remainders[i] > remainders[biggest])
+                biggest = i;
+        }
+        weights[biggest]++;
+        remainders[biggest] -= 1.0f;
+        total++;
+    }
+}
+
+FUNCTION f32 unpack_vertex_weight(Vertex_XTBNUCJW const *vertex, s32 piece_index)
+{
+    return (f32)vertex->weights[piece_index] / U8_MAX;
+}
+
+FUNCTION V2 unpack_vertex_uv(Vertex_XTBNUCJW const *vertex)
+{
+#if VERTEX_HALF_UVS
+    return {f16_to_f32(vertex->uv[0]), f16_to_f32(vertex->uv[1])};
+#else
+    return vertex->uv;
+#endif
+}
+
+FUNCTION V4 unpack_vertex_color(Vertex_XTBNUCJW const *vertex)
+{
+    V4 result;
+    for (s32 i = 0; i < 4; i++)
+        result.I[i] = (f32)vertex->color[i] / U8_MAX;
+    return result;
+}
+
+FUNCTION void pack_vertices(Triangle_Mesh *mesh, Vertex_XTBNUCJW *vertex_buffer)
+{
+    s64 num_vertices        = mesh->vertices.count;
     Vertex_XTBNUCJW *vertex = vertex_buffer;
     
     for (s32 vindex = 0; vindex < num_vertices; vindex++, vertex++) {
-        if (mesh->vertices.count) vertex->position = mesh->vertices[vindex];
-        else                      vertex->position = {};
-        
-        if (mesh->tbns.count)     vertex->tangent = mesh->tbns[vindex].tangent;
-        else                      vertex->tangent = {1.0f, 0.0f, 0.0f};
+        vertex->position = mesh->vertices[vindex];
         
-        if (mesh->tbns.count)     vertex->bitangent = mesh->tbns[vindex].bitangent;
-        else                      vertex->bitangent = {0.0f, 1.0f, 0.0f};
+        TBN tbn = {{1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}};
+        if (mesh->tbns.count) tbn = mesh->tbns[vindex];
+        pack_vertex_tbn(tbn, vertex->tbn);
         
-        if (mesh->tbns.count)     vertex->normal = mesh->tbns[vindex].normal;
-        else                      vertex->normal = {0.0f, 0.0f, 1.0f};
-        
-        if (mesh->uvs.count)      vertex->uv = mesh->uvs[vindex];
-        else                      vertex->uv = {};
+        V2 uv = mesh->uvs.count? mesh->uvs[vindex] : V2{};
+#if VERTEX_HALF_UVS
+        vertex->uv[0] = f32_to_f16(uv.x);
+        vertex->uv[1] = f32_to_f16(uv.y);
+#else
+        vertex->uv    = uv;
+#endif
         
-        if (mesh->colors.count)   vertex->color = mesh->colors[vindex];
-        else                      vertex->color = {1.0f, 1.0f, 1.0f, 1.0f};
+        V4 color = mesh->colors.count? mesh->colors[vindex] : V4{1.0f, 1.0f, 1.0f, 1.0f};
+        for (s32 i = 0; i < 4; i++)
+            vertex->color[i] = pack_unorm8(color.I[i]);
         
-        vertex->joint_ids = v4s(-1);
-        vertex->weights   = {};
-        if (mesh->skeleton) {
-            s32 canonical_vertex_index    = mesh->canonical_vertex_map[vindex];
-            Vertex_Blend_Info *blend_info = &mesh->skeleton->vertex_blend_info[canonical_vertex_index];
-            for (s32 piece_index = 0; piece_index < blend_info->num_pieces; piece_index++) {
-                vertex->joint_ids.I[piece_index] = blend_info->pieces[piece_index].joint_id;
-                vertex->weights.I  [piece_index] = blend_info->pieces[piece_index].weight;
-            }
-        }
+        Vertex_Blend_Info *blend_info = 0;
+        if (mesh->skeleton)
+            blend_info = &mesh->skeleton->vertex_blend_info[mesh->canonical_vertex_map[vindex]];
+        pack_vertex_blend(blend_info, vertex->joint_ids, vertex->weights);
+    }
+}
+
+#if !COOKER
+FUNCTION void generate_buffers_for_mesh(Triangle_Mesh *mesh)
+{
+    s64 num_vertices = mesh->vertices.count;
+    
+    // cook_mesh() packed the vertex buffer, or it's in the cooked mesh.
+    Arena_Temp scratch = get_scratch(0, 0);
+    Vertex_XTBNUCJW *vertex_buffer = mesh->packed_vertices;
+    if (!vertex_buffer) {
+        vertex_buffer = PUSH_ARRAY_ZERO(scratch.arena, Vertex_XTBNUCJW, num_vertices);
+        pack_vertices(mesh, vertex_buffer);
     }
     
     D3D11_BUFFER_DESC desc = {};
@@ -197,6 +368,7 @@ FUNCTION void generate_buffers_for_mesh(Triangle_Mesh *mesh)
     
     free_scratch(scratch);
 }
+#endif
 
 FUNCTION void generate_bounding_box_for_mesh(Triangle_Mesh *mesh)
 {
@@ -219,22 +391,1554 @@ FUNCTION void generate_bounding_box_for_mesh(Triangle_Mesh *mesh)
     mesh->bounding_box = {min, max};
 }
 
-FUNCTION void load_triangle_mesh(Arena *arena, Triangle_Mesh *mesh, String8 full_path)
+FUNCTION void generate_skinning_buckets_for_mesh(Arena *arena, Triangle_Mesh *mesh)
 {
-    mesh->full_path = full_path;
+    if (!mesh->skeleton) return;
     
-    String8 file = os->read_entire_file(full_path);
-    if (!file.data) {
-        debug_print("MESH LOAD ERROR: Couldn't load mesh at %S\n", full_path);
-        return;
+    Skeleton *skeleton = mesh->skeleton;
+    
+    Arena_Temp scratch = get_scratch(&arena, 1);
+    defer(free_scratch(scratch));
+    
+    // Counting sort of the vertices by (influence count, first joint). Grouping by first joint means 
+    // neighbouring vertices hit the same matrices, and most blocks of single-influence vertices end up
+    // with one joint for all lanes, which skin_bucket() has a fast path for.
+    s32 num_joints = (s32)skeleton->joint_info.count;
+    s32 num_keys   = MAX_JOINTS_PER_VERTEX*num_joints;
+    s32 *key_offsets             = PUSH_ARRAY_ZERO(scratch.arena, s32, num_keys + 1);
+    s32 *num_vertices_per_bucket = PUSH_ARRAY_ZERO(scratch.arena, s32, MAX_JOINTS_PER_VERTEX);
+    s32 *sorted_vertices         = PUSH_ARRAY(scratch.arena, s32, mesh->vertices.count);
+    
+    for (s32 i = 0; i < mesh->vertices.count; i++) {
+        Vertex_Blend_Info *blend_info = &skeleton->vertex_blend_info[mesh->canonical_vertex_map[i]];
+        if (blend_info->num_pieces > 0) {
+            s32 key = (blend_info->num_pieces - 1)*num_joints + blend_info->pieces[0].joint_id;
+            key_offsets[key + 1]++;
+            num_vertices_per_bucket[blend_info->num_pieces - 1]++;
+        }
+    }
+    for (s32 key = 0; key < num_keys; key++)
+        key_offsets[key + 1] += key_offsets[key];
+    for (s32 i = 0; i < mesh->vertices.count; i++) {
+        Vertex_Blend_Info *blend_info = &skeleton->vertex_blend_info[mesh->canonical_vertex_map[i]];
+        if (blend_info->num_pieces > 0) {
+            s32 key = (blend_info->num_pieces - 1)*num_joints + blend_info->pieces[0].joint_id;
+            sorted_vertices[key_offsets[key]++] = i;
+        }
+    }
+    
+    // Pack each bucket into SoA blocks.
+    s32 *bucket_vertices = sorted_vertices;
+    for (s32 b = 0; b < MAX_JOINTS_PER_VERTEX; b++) {
+        Skinning_Bucket *bucket = &mesh->skinning_buckets[b];
+        bucket->num_influences  = b + 1;
+        bucket->num_vertices    = num_vertices_per_bucket[b];
+        bucket->num_blocks      = (bucket->num_vertices + SKINNING_BLOCK_SIZE - 1) / SKINNING_BLOCK_SIZE;
+        
+        s32 n = bucket->num_blocks * SKINNING_BLOCK_SIZE;
+        bucket->positions      = PUSH_ARRAY(arena, f32, 3*n);
+        bucket->tbns           = PUSH_ARRAY(arena, f32, 9*n);
+        bucket->joint_ids      = PUSH_ARRAY(arena, s32, bucket->num_influences*n);
+        bucket->weights        = PUSH_ARRAY(arena, f32, bucket->num_influences*n);
+        bucket->vertex_indices = PUSH_ARRAY(arena, s32, n);
+        
+        for (s32 slot = 0; slot < n; slot++) {
+            s32 block = slot / SKINNING_BLOCK_SIZE;
+            s32 lane  = slot % SKINNING_BLOCK_SIZE;
+            
+            s32 vindex = bucket_vertices[MIN(slot, bucket->num_vertices - 1)];
+            bucket->vertex_indices[slot] = vindex;
+            
+            f32 *p = bucket->positions + block*3*SKINNING_BLOCK_SIZE + lane;
+            for (s32 c = 0; c < 3; c++)
+                p[c*SKINNING_BLOCK_SIZE] = mesh->vertices[vindex].I[c];
+            
+            // The tangent frames and weights the GPU gets (the packed weights are normalized).
+            Vertex_XTBNUCJW *vertex = &mesh->packed_vertices[vindex];
+            TBN vertex_tbn          = unpack_vertex_tbn(vertex);
+            
+            f32 *tbn = bucket->tbns + block*9*SKINNING_BLOCK_SIZE + lane;
+            for (s32 c = 0; c < 3; c++) {
+                tbn[(0 + c)*SKINNING_BLOCK_SIZE] = vertex_tbn.tangent.I[c];
+                tbn[(3 + c)*SKINNING_BLOCK_SIZE] = vertex_tbn.bitangent.I[c];
+                tbn[(6 + c)*SKINNING_BLOCK_SIZE] = vertex_tbn.normal.I[c];
+            }
+            
+            s32 *ids = bucket->joint_ids + block*bucket->num_influences*SKINNING_BLOCK_SIZE + lane;
+            f32 *w   = bucket->weights   + block*bucket->num_influences*SKINNING_BLOCK_SIZE + lane;
+            for (s32 piece_index = 0; piece_index < bucket->num_influences; piece_index++) {
+                ids[piece_index*SKINNING_BLOCK_SIZE] = vertex->joint_ids[piece_index];
+                w  [piece_index*SKINNING_BLOCK_SIZE] = unpack_vertex_weight(vertex, piece_index);
+            }
+        }
+        
+        bucket_vertices += bucket->num_vertices;
+    }
+}
+
+FUNCTION void generate_skinning_regions_for_mesh(Triangle_Mesh *mesh)
+{
+    // @Note: Every LOD gets its own regions, since the triangles and the regions they need differ.
+    
+    if (!mesh->skeleton) return;
+    
+    Skeleton *skeleton = mesh->skeleton;
+    s32 num_joints     = (s32)skeleton->joint_info.count;
+    s32 num_regions    = num_joints + 1;
+    s32 num_lods       = (s32)mesh->lods.count;
+    s32 static_region  = num_joints;
+    s32 words          = (num_regions + 63) / 64;
+    mesh->skinning_region_mask_words = words;
+    
+    array_init_and_resize(&mesh->skinning_regions,             num_lods*num_regions);
+    array_init_and_resize(&mesh->skinning_region_joints,       num_lods*num_regions*words);
+    array_init_and_resize(&mesh->skinning_region_dependencies, num_lods*num_regions*words);
+    array_init_and_resize(&mesh->skinning_region_indices,      mesh->indices.count);
+    array_init_and_resize(&mesh->joint_influence_bounds,       num_joints);
+    MEMORY_ZERO(mesh->skinning_regions.data,             mesh->skinning_regions.count*sizeof(Skinning_Region));
+    MEMORY_ZERO(mesh->skinning_region_joints.data,       mesh->skinning_region_joints.count*sizeof(u64));
+    MEMORY_ZERO(mesh->skinning_region_dependencies.data, mesh->skinning_region_dependencies.count*sizeof(u64));
+    for (s32 j = 0; j < num_joints; j++)
+        mesh->joint_influence_bounds[j] = {v3(F32_MAX), v3(-F32_MAX)};
+    
+    // Block ranges of each region. Blocks can straddle two regions; skinning a few extra vertices is fine.
+    for (s32 b = 0; b < MAX_JOINTS_PER_VERTEX; b++) {
+        Skinning_Bucket *bucket = &mesh->skinning_buckets[b];
+        for (s32 slot = 0; slot < bucket->num_vertices; slot++) {
+            s32 block = slot / SKINNING_BLOCK_SIZE;
+            s32 lane  = slot % SKINNING_BLOCK_SIZE;
+            s32 joint = bucket->joint_ids[block*bucket->num_influences*SKINNING_BLOCK_SIZE + lane];
+            
+            Skinning_Region *region = &mesh->skinning_regions[joint];
+            if (region->one_past_last_block[b] == 0)
+                region->first_block[b] = block;
+            region->one_past_last_block[b] = block + 1;
+        }
     }
+    for (s32 lod = 1; lod < num_lods; lod++)
+        MEMORY_COPY(&mesh->skinning_regions[lod*num_regions], mesh->skinning_regions.data, num_regions*sizeof(Skinning_Region));
     
-    String8 orig_file  = file;
+    // Joint influence bounds.
+    for (s32 i = 0; i < mesh->vertices.count; i++) {
+        Vertex_Blend_Info *blend_info = &skeleton->vertex_blend_info[mesh->canonical_vertex_map[i]];
+        for (s32 piece_index = 0; piece_index < blend_info->num_pieces; piece_index++) {
+            Rect3 *bounds = &mesh->joint_influence_bounds[blend_info->pieces[piece_index].joint_id];
+            bounds->min   = min_v3(bounds->min, mesh->vertices[i]);
+            bounds->max   = max_v3(bounds->max, mesh->vertices[i]);
+        }
+    }
     
-    load_mesh_data(arena, mesh, file);
-    load_mesh_textures(mesh);
-    generate_buffers_for_mesh(mesh);
-    generate_bounding_box_for_mesh(mesh);
+    // Triangle ownership, counted first so we can group the indices by region.
+    Arena_Temp scratch = get_scratch(0, 0);
+    defer(free_scratch(scratch));
+    
+    s32 *owners  = PUSH_ARRAY(scratch.arena, s32, mesh->indices.count / 3);
+    s32 *cursors = PUSH_ARRAY(scratch.arena, s32, num_regions);
+    
+    s32 first_index = 0;
+    for (s32 lod = 0; lod < num_lods; lod++) {
+        Skinning_Region *regions = &mesh->skinning_regions[lod*num_regions];
+        s32 first_triangle       = mesh->lods[lod].first_index / 3;
+        s32 one_past_last        = first_triangle + mesh->lods[lod].num_indices / 3;
+        
+        for (s32 t = first_triangle; t < one_past_last; t++) {
+            owners[t] = static_region;
+            for (s32 corner = 0; corner < 3; corner++) {
+                Vertex_Blend_Info *blend_info = &skeleton->vertex_blend_info[mesh->canonical_vertex_map[mesh->indices[3*t + corner]]];
+                if (blend_info->num_pieces) {
+                    owners[t] = blend_info->pieces[0].joint_id;
+                    break;
+                }
+            }
+            regions[owners[t]].num_indices += 3;
+        }
+        
+        for (s32 r = 0; r < num_regions; r++) {
+            regions[r].first_index = first_index;
+            cursors[r]   = first_index;
+            first_index += regions[r].num_indices;
+        }
+        
+        for (s32 t = first_triangle; t < one_past_last; t++) {
+            s32 r = owners[t];
+            u64 *joints       = &mesh->skinning_region_joints      [(lod*num_regions + r)*words];
+            u64 *dependencies = &mesh->skinning_region_dependencies[(lod*num_regions + r)*words];
+            
+            for (s32 corner = 0; corner < 3; corner++) {
+                u32 vindex = mesh->indices[3*t + corner];
+                mesh->skinning_region_indices[cursors[r]++] = vindex;
+                
+                Vertex_Blend_Info *blend_info = &skeleton->vertex_blend_info[mesh->canonical_vertex_map[vindex]];
+                if (!blend_info->num_pieces) continue;
+                
+                s32 vertex_region = blend_info->pieces[0].joint_id;
+                dependencies[vertex_region / 64] |= 1ULL << (vertex_region % 64);
+                for (s32 piece_index = 0; piece_index < blend_info->num_pieces; piece_index++) {
+                    s32 joint = blend_info->pieces[piece_index].joint_id;
+                    joints[joint / 64] |= 1ULL << (joint % 64);
+                }
+            }
+        }
+    }
+}
+
+//~ Index Optimization
+//
+// @Note: Done when cooking. Each triangle list is reordered with Tipsify (Sander, Nehab and Barczak, 
+// "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw") for the post-transform vertex 
+// cache, then the clusters Tipsify made are sorted so the ones on the outside facing out are drawn first,
+// unless that costs too many cache misses. Last, the vertices are renumbered in the order the indices 
+// first use them, so vertex fetches and the CPU ray tests that walk the indices go forward through memory.
+//
+
+#define VERTEX_CACHE_SIZE       16    // FIFO entries we optimize and report for.
+#define OVERDRAW_MAX_ACMR_RATIO 1.05f // How much the cluster sort may raise the ACMR of a triangle list.
+
+struct Vertex_Cache_Stats
+{
+    f32 acmr; // Average cache miss ratio: vertices transformed per triangle. Good meshes get below 0.7.
+    f32 atvr; // Average transform to vertex ratio: vertices transformed per vertex used. 1 is ideal.
+};
+
+FUNCTION Vertex_Cache_Stats get_vertex_cache_stats(u32 const *indices, s32 num_indices, s32 num_vertices, s32 cache_size)
+{
+    Arena_Temp scratch = get_scratch(0, 0);
+    defer(free_scratch(scratch));
+    
+    // A vertex is still in the FIFO if fewer than cache_size misses happened since it went in.
+    s32 *insert_time = PUSH_ARRAY(scratch.arena, s32, num_vertices);
+    u8  *used        = PUSH_ARRAY_ZERO(scratch.arena, u8, num_vertices);
+    for (s32 v = 0; v < num_vertices; v++)
+        insert_time[v] = -cache_size;
+    
+    s32 misses   = 0;
+    s32 num_used = 0;
+    for (s32 i = 0; i < num_indices; i++) {
+        u32 v = indices[i];
+        if (!used[v]) {
+            used[v] = 1;
+            num_used++;
+        }
+        if (misses - insert_time[v] >= cache_size)
+            insert_time[v] = misses++;
+    }
+    
+    Vertex_Cache_Stats result = {};
+    if (num_indices) result.acmr = (f32)misses / (f32)(num_indices / 3);
+    if (num_used)    result.atvr = (f32)misses / (f32)num_used;
+    return result;
+}
+
+FUNCTION s32 tipsify(u32 *indices, s32 num_indices, s32 num_vertices, s32 cache_size, s32 *cluster_starts)
+{
+    // Reorders the triangles in place. Writes the first triangle of each cluster (a run that starts after
+    // a dead end) to cluster_starts and returns the number of clusters.
+    
+    Arena_Temp scratch = get_scratch(0, 0);
+    defer(free_scratch(scratch));
+    
+    s32 num_triangles = num_indices / 3;
+    
+    // Triangles using each vertex. live counts the ones that aren't emitted yet.
+    s32 *live      = PUSH_ARRAY_ZERO(scratch.arena, s32, num_vertices);
+    s32 *offsets   = PUSH_ARRAY_ZERO(scratch.arena, s32, num_vertices + 1);
+    s32 *cursors   = PUSH_ARRAY(scratch.arena, s32, num_vertices);
+    s32 *adjacency = PUSH_ARRAY(scratch.arena, s32, num_indices);
+    for (s32 i = 0; i < num_indices; i++)
+        live[indices[i]]++;
+    for (s32 v = 0; v < num_vertices; v++) {
+        offsets[v + 1] = offsets[v] + live[v];
+        cursors[v]     = offsets[v];
+    }
+    for (s32 i = 0; i < num_indices; i++)
+        adjacency[cursors[indices[i]]++] = i / 3;
+    
+    s32 *cache_time  = PUSH_ARRAY_ZERO(scratch.arena, s32, num_vertices);
+    u8  *emitted     = PUSH_ARRAY_ZERO(scratch.arena, u8, num_triangles);
+    s32 *dead_ends   = PUSH_ARRAY(scratch.arena, s32, num_indices);
+    s32 *candidates  = PUSH_ARRAY(scratch.arena, s32, num_indices);
+    u32 *out         = PUSH_ARRAY(scratch.arena, u32, num_indices);
+    s32 num_dead_ends = 0;
+    s32 num_out       = 0;
+    s32 num_clusters  = 0;
+    s32 time          = cache_size + 1;
+    s32 scan_vertex   = 0;
+    b32 dead_end      = TRUE;
+    
+    s32 fan = num_indices? (s32)indices[0] : -1;
+    while (fan >= 0) {
+        if (dead_end)
+            cluster_starts[num_clusters++] = num_out / 3;
+        
+        // Emit the remaining triangles around the fanning vertex.
+        s32 num_candidates = 0;
+        for (s32 a = offsets[fan]; a < offsets[fan + 1]; a++) {
+            s32 t = adjacency[a];
+            if (emitted[t]) continue;
+            
+            for (s32 corner = 0; corner < 3; corner++) {
+                u32 v = indices[3*t + corner];
+                out[num_out++]               = v;
+                dead_ends[num_dead_ends++]   = v;
+                candidates[num_candidates++] = v;
+                live[v]--;
+                if (time - cache_time[v] > cache_size)
+                    cache_time[v] = time++;
+            }
+            emitted[t] = 1;
+        }
+        
+        // Fan around the oldest candidate that stays in the cache while we emit its remaining triangles,
+        // or any candidate that has some left.
+        s32 next          = -1;
+        s32 best_priority = -1;
+        for (s32 c = 0; c < num_candidates; c++) {
+            s32 v = candidates[c];
+            if (!live[v]) continue;
+            
+            s32 priority = 0;
+            if (time - cache_time[v] + 2*live[v] <= cache_size)
+                priority = time - cache_time[v];
+            if (priority > best_priority) {
+                best_priority = priority;
+                next          = v;
+            }
+        }
+        
+        // Dead end: go back to the most recent vertex that has triangles left, or find any vertex that does.
+        dead_end = (next < 0);
+        while ((next < 0) && num_dead_ends) {
+            s32 v = dead_ends[--num_dead_ends];
+            if (live[v]) next = v;
+        }
+        while ((next < 0) && (scan_vertex < num_vertices)) {
+            if (live[scan_vertex]) next = scan_vertex;
+            else                   scan_vertex++;
+        }
+        
+        fan = next;
+    }
+    
+    ASSERT(num_out == num_indices);
+    MEMORY_COPY(indices, out, num_indices*sizeof(u32));
+    return num_clusters;
+}
+
+FUNCTION void sort_descending(f32 const *keys, s32 *order, s32 count)
+{
+    // Writes the indices of keys to order, biggest key first; equal keys keep their order. Radix sort,
+    // four counting sort passes over the key bits flipped so that they sort like unsigned ints.
+    
+    Arena_Temp scratch = get_scratch(0, 0);
+    defer(free_scratch(scratch));
+    
+    u32 *bits = PUSH_ARRAY(scratch.arena, u32, count);
+    s32 *temp = PUSH_ARRAY(scratch.arena, s32, count);
+    for (s32 i = 0; i < count; i++) {
+        u32 b;
+        MEMORY_COPY(&b, &keys[i], sizeof(b));
+        b       = (b & 0x80000000)? ~b : (b | 0x80000000);
+        bits[i] = ~b;
+        order[i] = i;
+    }
+    
+    s32 *src = order;
+    s32 *dst = temp;
+    for (s32 shift = 0; shift < 32; shift += 8) {
+        s32 offsets[257] = {};
+        for (s32 i = 0; i < count; i++)
+            offsets[((bits[i] >> shift) & 0xFF) + 1]++;
+        for (s32 d = 0; d < 256; d++)
+            offsets[d + 1] += offsets[d];
+        for (s32 i = 0; i < count; i++)
+            dst[offsets[(bits[src[i]] >> shift) & 0xFF]++] = src[i];
+        
+        SWAP(src, dst, s32 *);
+    }
+}
+
+FUNCTION void sort_clusters_for_overdraw(V3 const *vertices, u32 *indices, s32 num_indices, s32 const *cluster_starts, s32 num_clusters)
+{
+    // @Note: Sander et al.'s view independent sort: clusters far out from the middle of the list and facing
+    // away from it are likely to hide the others, so they're drawn first. cluster_starts has one past the 
+    // last cluster too.
+    
+    Arena_Temp scratch = get_scratch(0, 0);
+    defer(free_scratch(scratch));
+    
+    s32 num_triangles = num_indices / 3;
+    V3 *centroids     = PUSH_ARRAY_ZERO(scratch.arena, V3, num_clusters);
+    V3 *normals       = PUSH_ARRAY_ZERO(scratch.arena, V3, num_clusters);
+    f32 *areas        = PUSH_ARRAY_ZERO(scratch.arena, f32, num_clusters);
+    
+    V3 middle = {};
+    for (s32 i = 0; i < num_indices; i++)
+        middle += vertices[indices[i]];
+    middle /= (f32)MAX(num_indices, 1);
+    
+    for (s32 c = 0; c < num_clusters; c++) {
+        for (s32 t = cluster_starts[c]; t < cluster_starts[c + 1]; t++) {
+            V3 a = vertices[indices[3*t + 0]];
+            V3 b = vertices[indices[3*t + 1]];
+            V3 d = vertices[indices[3*t + 2]];
+            
+            // The cross product is twice the area times the normal.
+            V3  n    = cross(b - a, d - a);
+            f32 area = length(n);
+            centroids[c] += (a + b + d) * (area / 3.0f);
+            normals[c]   += n;
+            areas[c]     += area;
+        }
+    }
+    
+    f32 *keys = PUSH_ARRAY(scratch.arena, f32, num_clusters);
+    for (s32 c = 0; c < num_clusters; c++) {
+        V3 centroid = areas[c] > 0.0f? centroids[c] / areas[c] : vertices[indices[3*cluster_starts[c]]];
+        keys[c]     = dot(centroid - middle, normalize_or_zero(normals[c]));
+    }
+    
+    s32 *order = PUSH_ARRAY(scratch.arena, s32, num_clusters);
+    sort_descending(keys, order, num_clusters);
+    
+    u32 *out     = PUSH_ARRAY(scratch.arena, u32, num_indices);
+    s32 num_out  = 0;
+    for (s32 i = 0; i < num_clusters; i++) {
+        s32 c = order[i];
+        s32 n = 3*(cluster_starts[c + 1] - cluster_starts[c]);
+        MEMORY_COPY(out + num_out, indices + 3*cluster_starts[c], n*sizeof(u32));
+        num_out += n;
+    }
+    ASSERT(num_out == 3*num_triangles);
+    MEMORY_COPY(indices, out, num_indices*sizeof(u32));
+}
+
+FUNCTION void optimize_triangle_list(Triangle_Mesh *mesh, Triangle_List_Info *list)
+{
+    Arena_Temp scratch = get_scratch(0, 0);
+    defer(free_scratch(scratch));
+    
+    u32 *indices      = mesh->indices.data + list->first_index;
+    s32 num_indices   = list->num_indices;
+    s32 num_vertices  = (s32)mesh->vertices.count;
+    
+    s32 *cluster_starts = PUSH_ARRAY(scratch.arena, s32, num_indices/3 + 1);
+    s32 num_clusters    = tipsify(indices, num_indices, num_vertices, VERTEX_CACHE_SIZE, cluster_starts);
+    cluster_starts[num_clusters] = num_indices / 3;
+    
+    u32 *tipsified = PUSH_ARRAY(scratch.arena, u32, num_indices);
+    MEMORY_COPY(tipsified, indices, num_indices*sizeof(u32));
+    
+    sort_clusters_for_overdraw(mesh->vertices.data, indices, num_indices, cluster_starts, num_clusters);
+    
+    f32 tipsified_acmr = get_vertex_cache_stats(tipsified, num_indices, num_vertices, VERTEX_CACHE_SIZE).acmr;
+    f32 sorted_acmr    = get_vertex_cache_stats(indices,   num_indices, num_vertices, VERTEX_CACHE_SIZE).acmr;
+    if (sorted_acmr > OVERDRAW_MAX_ACMR_RATIO*tipsified_acmr)
+        MEMORY_COPY(indices, tipsified, num_indices*sizeof(u32));
+}
+
+template<typename T>
+void permute_array(Array<T> *array, s32 const *new_index)
+{
+    // Moves element i to new_index[i].
+    
+    Arena_Temp scratch = get_scratch(0, 0);
+    defer(free_scratch(scratch));
+    
+    T *old = PUSH_ARRAY(scratch.arena, T, array->count);
+    MEMORY_COPY(old, array->data, array->count*sizeof(T));
+    for (s64 i = 0; i < array->count; i++)
+        array->data[new_index[i]] = old[i];
+}
+
+FUNCTION void optimize_vertex_fetch(Triangle_Mesh *mesh)
+{
+    // Renumbers the vertices in the order the indices first use them, then the canonical vertices (and 
+    // their blend info) in the order the vertices first use them. Unused ones go last, in the same order.
+    
+    Arena_Temp scratch = get_scratch(0, 0);
+    defer(free_scratch(scratch));
+    
+    s32 num_vertices = (s32)mesh->vertices.count;
+    s32 *new_index   = PUSH_ARRAY(scratch.arena, s32, num_vertices);
+    for (s32 v = 0; v < num_vertices; v++)
+        new_index[v] = -1;
+    
+    s32 next = 0;
+    for (s32 i = 0; i < mesh->indices.count; i++) {
+        u32 v = mesh->indices[i];
+        if (new_index[v] < 0)
+            new_index[v] = next++;
+        mesh->indices[i] = (u32)new_index[v];
+    }
+    for (s32 v = 0; v < num_vertices; v++) {
+        if (new_index[v] < 0)
+            new_index[v] = next++;
+    }
+    
+    permute_array(&mesh->vertices,             new_index);
+    permute_array(&mesh->tbns,                 new_index);
+    permute_array(&mesh->uvs,                  new_index);
+    permute_array(&mesh->colors,               new_index);
+    permute_array(&mesh->canonical_vertex_map, new_index);
+    
+    if (!mesh->skeleton) return;
+    
+    Array<Vertex_Blend_Info> *blend_info = &mesh->skeleton->vertex_blend_info;
+    s32 num_canonical    = (s32)blend_info->count;
+    s32 *new_canonical   = PUSH_ARRAY(scratch.arena, s32, num_canonical);
+    for (s32 c = 0; c < num_canonical; c++)
+        new_canonical[c] = -1;
+    
+    next = 0;
+    for (s32 v = 0; v < num_vertices; v++) {
+        s32 c = mesh->canonical_vertex_map[v];
+        if (new_canonical[c] < 0)
+            new_canonical[c] = next++;
+        mesh->canonical_vertex_map[v] = new_canonical[c];
+    }
+    for (s32 c = 0; c < num_canonical; c++) {
+        if (new_canonical[c] < 0)
+            new_canonical[c] = next++;
+    }
+    
+    permute_array(blend_info, new_canonical);
+}
+
+FUNCTION void optimize_mesh_indices(Triangle_Mesh *mesh)
+{
+    s32 num_vertices = (s32)mesh->vertices.count;
+    Vertex_Cache_Stats before = get_vertex_cache_stats(mesh->indices.data, (s32)mesh->indices.count, num_vertices, VERTEX_CACHE_SIZE);
+    
+    for (s32 i = 0; i < mesh->triangle_list_info.count; i++) {
+        Triangle_List_Info *list = &mesh->triangle_list_info[i];
+        
+        // Lists that don't start on a triangle boundary would get triangles of their neighbours.
+        if (list->first_index % 3) continue;
+        optimize_triangle_list(mesh, list);
+    }
+    optimize_vertex_fetch(mesh);
+    
+    Vertex_Cache_Stats after = get_vertex_cache_stats(mesh->indices.data, (s32)mesh->indices.count, num_vertices, VERTEX_CACHE_SIZE);
+    debug_print("Mesh %S: ACMR %f -> %f, ATVR %f -> %f (%d entry vertex cache)\n", 
+                mesh->full_path, before.acmr, after.acmr, before.atvr, after.atvr, VERTEX_CACHE_SIZE);
+}
+
+//~ Mesh LODs
+//
+// @Note: Made when cooking, after the index optimization. The triangle lists are simplified together with
+// Garland and Heckbert's quadric error metrics ("Surface Simplification Using Quadric Error Metrics"), by
+// collapsing vertices onto a neighbour, so the LODs don't need vertices of their own; each triangle stays in 
+// its list. UV and normal seams and the edges between materials split vertices in the vertex buffer: 
+// vertices on a seam only move along it, together with their twin on the other side, and vertices on a
+// border only move along the border. Where more seams meet (all over flat shaded meshes like the claw), the
+// vertices at a position move together if the triangles around it close up: each goes to the vertex at the
+// new position in its own triangles, or to the one there that's shaded the most like it. Other vertices 
+// don't move at all, so LODs don't crack open along seams or between materials. A collapse onto a vertex
+// with other skinning weights costs extra since the vertex would move with other joints, and so does 
+// shading a vertex like another one. These don't count in the LOD's error though, the surface doesn't move
+// any further.
+//
+
+#define MESH_LOD_TRIANGLE_RATIO  0.5f  // Triangles of a LOD over the previous LOD's.
+#define MESH_LOD_MIN_REDUCTION   0.85f // A LOD that keeps more of the previous LOD's triangles than this ends the chain.
+#define MESH_LOD_MAX_ERROR       0.05f // Of the bounds' radius. Collapses that cost more are never made.
+#define MESH_LOD_BORDER_WEIGHT   10.0f // Of the planes that keep borders and seams in place, per squared edge length.
+#define MESH_LOD_SKINNING_ERROR  0.1f  // Of the bounds' radius; what moving a vertex to one with no common weights costs.
+#define MESH_LOD_SHADING_ERROR   0.05f // Of the bounds' radius; what moving a vertex to one with the opposite normal costs.
+#define MESH_LOD_PASS_COST_RATIO 1.5f  // How much more than the collapses it needs a simplification pass may spend.
+
+enum Simplify_Vertex_Kind
+{
+    SimplifyVertexKind_MANIFOLD, // Can collapse onto any neighbour.
+    SimplifyVertexKind_BORDER,   // Along the border.
+    SimplifyVertexKind_SEAM,     // Along the seam, with its twin.
+    SimplifyVertexKind_WEDGES,   // Onto any neighbour, with all the vertices at its position.
+    SimplifyVertexKind_LOCKED,
+};
+
+struct Quadric
+{
+    // Sum of weight*SQUARE(dot(n, p) + d) over planes, as dot(p, A*p) + 2*dot(b, p) + c with A symmetric.
+    f64 a00, a11, a22, a10, a20, a21;
+    f64 b0, b1, b2;
+    f64 c;
+    f64 weight;
+};
+
+struct Mesh_Simplifier
+{
+    Triangle_Mesh *mesh;
+    s32 const     *remap; // The first vertex at the same position, per vertex.
+    f32            radius;
+    
+    u32 *indices;     // The mesh's triangles, as simplified so far.
+    s32 *lists;       // The triangle list of each triangle.
+    s32  num_indices;
+    f32  max_error;   // Squared; the farthest the collapses made so far moved the surface.
+    
+    u8      *kinds;    // Simplify_Vertex_Kind, per vertex.
+    s32     *wedges;   // The next vertex at the same position, round in a ring. A seam vertex's twin.
+    Quadric *quadrics; // Per position, i.e. only at remapped vertices.
+    
+    // Rebuilt by every pass: the triangles around each vertex, and the vertex at the other end of the open 
+    // edge going out of and into each vertex (-1 if there's none, -2 if there's more than one).
+    s32 *offsets;
+    s32 *adjacency;
+    s32 *open_out;
+    s32 *open_in;
+};
+
+FUNCTION void get_position_remap(V3 const *positions, s32 num_vertices, s32 *remap)
+{
+    // remap[v] is the first vertex at the same position as v. Hashes the position bits.
+    
+    Arena_Temp scratch = get_scratch(0, 0);
+    defer(free_scratch(scratch));
+    
+    s32 table_size = 1;
+    while (table_size < 2*num_vertices) table_size *= 2;
+    s32 *table = PUSH_ARRAY(scratch.arena, s32, table_size);
+    for (s32 i = 0; i < table_size; i++)
+        table[i] = -1;
+    
+    for (s32 v = 0; v < num_vertices; v++) {
+        u32 bits[3];
+        MEMORY_COPY(bits, &positions[v], sizeof(bits));
+        u32 slot = ((bits[0]*73856093u) ^ (bits[1]*19349663u) ^ (bits[2]*83492791u)) & (table_size - 1);
+        
+        while ((table[slot] >= 0) && !(positions[table[slot]] == positions[v]))
+            slot = (slot + 1) & (table_size - 1);
+        if (table[slot] < 0) table[slot] = v;
+        remap[v] = table[slot];
+    }
+}
+
+FUNCTION Quadric make_plane_quadric(V3 n, f32 d, f32 weight)
+{
+    Quadric q = {};
+    q.a00     = (f64)weight*n.x*n.x;
+    q.a11     = (f64)weight*n.y*n.y;
+    q.a22     = (f64)weight*n.z*n.z;
+    q.a10     = (f64)weight*n.y*n.x;
+    q.a20     = (f64)weight*n.z*n.x;
+    q.a21     = (f64)weight*n.z*n.y;
+    q.b0      = (f64)weight*n.x*d;
+    q.b1      = (f64)weight*n.y*d;
+    q.b2      = (f64)weight*n.z*d;
+    q.c       = (f64)weight*d*d;
+    q.weight  = weight;
+    return q;
+}
+
+FUNCTION void add_quadric(Quadric *q, Quadric const *r)
+{
+    q->a00 += r->a00; q->a11 += r->a11; q->a22 += r->a22;
+    q->a10 += r->a10; q->a20 += r->a20; q->a21 += r->a21;
+    q->b0  += r->b0;  q->b1  += r->b1;  q->b2  += r->b2;
+    q->c   += r->c;
+    q->weight += r->weight;
+}
+
+FUNCTION f32 get_quadric_error(Quadric const *q, V3 p)
+{
+    // The weighted mean of the squared distances from p to the planes.
     
-    os->free_file_memory(orig_file.data);
-}
\ No newline at end of file
+    f64 x = p.x, y = p.y, z = p.z;
+    f64 e = q->a00*x*x + q->a11*y*y + q->a22*z*z + 2.0*(q->a10*x*y + q->a20*x*z + q->a21*y*z) +
+        2.0*(q->b0*x + q->b1*y + q->b2*z) + q->c;
+    
+    return (q->weight > 0.0)? (f32)MAX(e / q->weight, 0.0) : 0.0f;
+}
+
+FUNCTION f32 get_skinning_distance(Skeleton *skeleton, s32 canonical_a, s32 canonical_b)
+{
+    // Half the L1 distance between the normalized weights: 0 for the same weights, 1 for no joints in common.
+    
+    if (!skeleton || (canonical_a == canonical_b)) return 0.0f;
+    
+    Vertex_Blend_Info *a = &skeleton->vertex_blend_info[canonical_a];
+    Vertex_Blend_Info *b = &skeleton->vertex_blend_info[canonical_b];
+    f32 sum_a = 0.0f, sum_b = 0.0f;
+    for (s32 i = 0; i < a->num_pieces; i++) sum_a += a->pieces[i].weight;
+    for (s32 i = 0; i < b->num_pieces; i++) sum_b += b->pieces[i].weight;
+    if ((sum_a <= 0.0f) || (sum_b <= 0.0f)) return ((sum_a <= 0.0f) && (sum_b <= 0.0f))? 0.0f : 1.0f;
+    
+    f32 distance = 0.0f;
+    for (s32 i = 0; i < a->num_pieces; i++) {
+        f32 weight_b = 0.0f;
+        for (s32 j = 0; j < b->num_pieces; j++) {
+            if (b->pieces[j].joint_id == a->pieces[i].joint_id) weight_b += b->pieces[j].weight / sum_b;
+        }
+        distance += ABS(a->pieces[i].weight / sum_a - weight_b);
+    }
+    for (s32 j = 0; j < b->num_pieces; j++) {
+        b32 shared = FALSE;
+        for (s32 i = 0; i < a->num_pieces; i++)
+            shared |= (a->pieces[i].joint_id == b->pieces[j].joint_id);
+        if (!shared) distance += b->pieces[j].weight / sum_b;
+    }
+    
+    return 0.5f*distance;
+}
+
+FUNCTION f32 get_shading_distance(Triangle_Mesh *mesh, u32 a, u32 b)
+{
+    // Half the distance between the normals, plus the distance between the UVs.
+    
+    f32 distance = 0.0f;
+    if (mesh->tbns.count) distance += 0.5f*length(mesh->tbns[a].normal - mesh->tbns[b].normal);
+    if (mesh->uvs.count)  distance += length(mesh->uvs[a] - mesh->uvs[b]);
+    
+    return distance;
+}
+
+FUNCTION b32 has_edge(Mesh_Simplifier *s, u32 a, u32 b)
+{
+    for (s32 i = s->offsets[a]; i < s->offsets[a + 1]; i++) {
+        u32 *t = &s->indices[3*s->adjacency[i]];
+        if (((t[0] == a) && (t[1] == b)) || ((t[1] == a) && (t[2] == b)) || ((t[2] == a) && (t[0] == b)))
+            return TRUE;
+    }
+    
+    return FALSE;
+}
+
+FUNCTION void build_simplifier_adjacency(Mesh_Simplifier *s)
+{
+    s32 num_vertices = (s32)s->mesh->vertices.count;
+    
+    MEMORY_ZERO(s->offsets, (num_vertices + 1)*sizeof(s32));
+    for (s32 i = 0; i < s->num_indices; i++)
+        s->offsets[s->indices[i] + 1]++;
+    for (s32 v = 0; v < num_vertices; v++)
+        s->offsets[v + 1] += s->offsets[v];
+    
+    // Filling moves each offset to the next vertex's, so shift them back after.
+    for (s32 i = 0; i < s->num_indices; i++)
+        s->adjacency[s->offsets[s->indices[i]]++] = i / 3;
+    for (s32 v = num_vertices; v > 0; v--)
+        s->offsets[v] = s->offsets[v - 1];
+    s->offsets[0] = 0;
+    
+    for (s32 v = 0; v < num_vertices; v++) {
+        s->open_out[v] = -1;
+        s->open_in [v] = -1;
+    }
+    for (s32 i = 0; i < s->num_indices; i++) {
+        u32 a = s->indices[i];
+        u32 b = s->indices[i - i%3 + (i + 1)%3];
+        if (has_edge(s, b, a)) continue;
+        
+        s->open_out[a] = (s->open_out[a] == -1)? (s32)b : -2;
+        s->open_in [b] = (s->open_in [b] == -1)? (s32)a : -2;
+    }
+}
+
+FUNCTION b32 is_closed_fan(Mesh_Simplifier *s, u32 v)
+{
+    // Whether the triangles around v's position close up around it, going by positions rather than vertices:
+    // every position next to it is on the way out of one triangle and on the way into one other.
+    
+    s32 const *remap = s->remap;
+    u32 w = v;
+    do {
+        for (s32 i = s->offsets[w]; i < s->offsets[w + 1]; i++) {
+            u32 *t     = &s->indices[3*s->adjacency[i]];
+            s32 corner = (t[0] == w)? 0 : (t[1] == w)? 1 : 2;
+            s32 out    = remap[t[(corner + 1)%3]];
+            
+            s32 num_out = 0, num_in = 0;
+            u32 x = v;
+            do {
+                for (s32 j = s->offsets[x]; j < s->offsets[x + 1]; j++) {
+                    u32 *r     = &s->indices[3*s->adjacency[j]];
+                    s32 at     = (r[0] == x)? 0 : (r[1] == x)? 1 : 2;
+                    num_out += (remap[r[(at + 1)%3]] == out);
+                    num_in  += (remap[r[(at + 2)%3]] == out);
+                }
+                x = (u32)s->wedges[x];
+            } while (x != v);
+            if ((num_out != 1) || (num_in != 1)) return FALSE;
+        }
+        w = (u32)s->wedges[w];
+    } while (w != v);
+    
+    return TRUE;
+}
+
+FUNCTION void init_mesh_simplifier(Arena *arena, Mesh_Simplifier *s, Triangle_Mesh *mesh, s32 const *remap, f32 radius)
+{
+    s32 num_indices     = (s32)mesh->indices.count;
+    s32 num_vertices    = (s32)mesh->vertices.count;
+    V3 const *positions = mesh->vertices.data;
+    
+    s->mesh      = mesh;
+    s->remap     = remap;
+    s->radius    = radius;
+    s->indices   = PUSH_ARRAY(arena, u32, num_indices);
+    s->lists     = PUSH_ARRAY(arena, s32, num_indices / 3);
+    s->kinds     = PUSH_ARRAY(arena, u8, num_vertices);
+    s->wedges    = PUSH_ARRAY(arena, s32, num_vertices);
+    s->quadrics  = PUSH_ARRAY_ZERO(arena, Quadric, num_vertices);
+    s->offsets   = PUSH_ARRAY(arena, s32, num_vertices + 1);
+    s->adjacency = PUSH_ARRAY(arena, s32, num_indices);
+    s->open_out  = PUSH_ARRAY(arena, s32, num_vertices);
+    s->open_in   = PUSH_ARRAY(arena, s32, num_vertices);
+    
+    // Degenerate triangles would only get in the way.
+    for (s32 l = 0; l < mesh->triangle_list_info.count; l++) {
+        Triangle_List_Info *list = &mesh->triangle_list_info[l];
+        for (s32 i = 0; i + 2 < list->num_indices; i += 3) {
+            u32 *t = &mesh->indices[list->first_index + i];
+            if ((t[0] == t[1]) || (t[1] == t[2]) || (t[2] == t[0])) continue;
+            
+            s->lists[s->num_indices / 3] = l;
+            s->indices[s->num_indices++] = t[0];
+            s->indices[s->num_indices++] = t[1];
+            s->indices[s->num_indices++] = t[2];
+        }
+    }
+    build_simplifier_adjacency(s);
+    
+    // The vertices at each position; there are two on a seam.
+    Arena_Temp scratch = get_scratch(&arena, 1);
+    defer(free_scratch(scratch));
+    
+    s32 *first_wedge = PUSH_ARRAY(scratch.arena, s32, num_vertices);
+    s32 *num_wedges  = PUSH_ARRAY_ZERO(scratch.arena, s32, num_vertices);
+    for (s32 v = 0; v < num_vertices; v++)
+        first_wedge[v] = -1;
+    for (s32 v = 0; v < num_vertices; v++) {
+        s->wedges[v] = -1;
+        if (s->offsets[v] == s->offsets[v + 1]) continue;
+        
+        s32 p = remap[v];
+        if (first_wedge[p] >= 0) {
+            s->wedges[v]              = s->wedges[first_wedge[p]];
+            s->wedges[first_wedge[p]] = v;
+        } else {
+            first_wedge[p] = v;
+            s->wedges[v]   = v;
+        }
+        num_wedges[p]++;
+    }
+    
+    for (s32 v = 0; v < num_vertices; v++) {
+        s32 p  = remap[v];
+        s32 in = s->open_in[v], out = s->open_out[v];
+        
+        s->kinds[v] = SimplifyVertexKind_LOCKED;
+        if (s->offsets[v] == s->offsets[v + 1]) continue;
+        
+        if (num_wedges[p] == 1) {
+            if ((in == -1) && (out == -1))    s->kinds[v] = SimplifyVertexKind_MANIFOLD;
+            else if ((in >= 0) && (out >= 0)) s->kinds[v] = SimplifyVertexKind_BORDER;
+        } else if (num_wedges[p] == 2) {
+            // Both sides of the seam have to go on to the same positions.
+            s32 twin    = s->wedges[v];
+            s32 twin_in = s->open_in[twin], twin_out = s->open_out[twin];
+            if ((in >= 0) && (out >= 0) && (twin_in >= 0) && (twin_out >= 0) &&
+                (remap[out] == remap[twin_in]) && (remap[in] == remap[twin_out]))
+                s->kinds[v] = SimplifyVertexKind_SEAM;
+        }
+        
+        if ((num_wedges[p] > 1) && (s->kinds[v] == SimplifyVertexKind_LOCKED) && is_closed_fan(s, v))
+            s->kinds[v] = SimplifyVertexKind_WEDGES;
+    }
+    
+    // Face planes weighted by area, and planes through the open edges (borders and seams) at a right angle
+    // to the face, so moving vertices off a border or seam line costs something too.
+    for (s32 i = 0; i < s->num_indices; i += 3) {
+        u32 *t = &s->indices[i];
+        V3 n   = cross(positions[t[1]] - positions[t[0]], positions[t[2]] - positions[t[0]]);
+        f32 double_area = length(n);
+        if (double_area <= 0.0f) continue;
+        n /= double_area;
+        
+        Quadric face = make_plane_quadric(n, -dot(n, positions[t[0]]), 0.5f*double_area);
+        for (s32 corner = 0; corner < 3; corner++)
+            add_quadric(&s->quadrics[remap[t[corner]]], &face);
+        
+        for (s32 corner = 0; corner < 3; corner++) {
+            u32 a = t[corner], b = t[(corner + 1)%3];
+            if (has_edge(s, b, a)) continue;
+            
+            V3 edge   = positions[b] - positions[a];
+            V3 normal = normalize_or_zero(cross(edge, n));
+            Quadric border = make_plane_quadric(normal, -dot(normal, positions[a]), MESH_LOD_BORDER_WEIGHT*dot(edge, edge));
+            add_quadric(&s->quadrics[remap[a]], &border);
+            add_quadric(&s->quadrics[remap[b]], &border);
+        }
+    }
+}
+
+FUNCTION s32 get_twin_target(Mesh_Simplifier *s, u32 u, u32 v)
+{
+    // Where the twin of seam vertex u goes when u collapses onto v, or -1 if it can't.
+    
+    s32 twin   = s->wedges[u];
+    s32 target = (s->open_out[u] == (s32)v)? s->open_in[twin] : s->open_out[twin];
+    if ((target < 0) || (s->remap[target] != s->remap[v])) return -1;
+    return target;
+}
+
+FUNCTION s32 get_wedge_target(Mesh_Simplifier *s, u32 w, u32 v)
+{
+    // Where w goes when the vertices at its position collapse onto v's: the vertex at v's position in w's own
+    // triangles, or the one there shaded the most like w. -1 if w's triangles have two vertices there.
+    
+    s32 target = -1;
+    for (s32 i = s->offsets[w]; i < s->offsets[w + 1]; i++) {
+        u32 *t = &s->indices[3*s->adjacency[i]];
+        for (s32 corner = 0; corner < 3; corner++) {
+            if (s->remap[t[corner]] != s->remap[v]) continue;
+            if ((target >= 0) && (target != (s32)t[corner])) return -1;
+            target = (s32)t[corner];
+        }
+    }
+    if (target >= 0) return target;
+    
+    f32 closest = F32_MAX;
+    u32 x       = v;
+    do {
+        f32 distance = get_shading_distance(s->mesh, w, x);
+        if (distance < closest) {
+            closest = distance;
+            target  = (s32)x;
+        }
+        x = (u32)s->wedges[x];
+    } while (x != v);
+    
+    return target;
+}
+
+FUNCTION f32 get_wedges_shading_distance(Mesh_Simplifier *s, u32 u, u32 v)
+{
+    // The most the shading of a vertex at u's position changes when they all collapse onto v's, or -1 if 
+    // one of them can't. Vertices whose triangles are all gone don't count.
+    
+    f32 result = 0.0f;
+    u32 w      = u;
+    do {
+        if (s->offsets[w] != s->offsets[w + 1]) {
+            s32 target = get_wedge_target(s, w, v);
+            if (target < 0) return -1.0f;
+            result = MAX(result, get_shading_distance(s->mesh, w, (u32)target));
+        }
+        w = (u32)s->wedges[w];
+    } while (w != u);
+    
+    return result;
+}
+
+FUNCTION b32 can_collapse(Mesh_Simplifier *s, u32 u, u32 v)
+{
+    if (s->remap[u] == s->remap[v]) return FALSE;
+    
+    switch (s->kinds[u]) {
+        case SimplifyVertexKind_MANIFOLD: return TRUE;
+        case SimplifyVertexKind_BORDER:   return (s->open_out[u] == (s32)v) || (s->open_in[u] == (s32)v);
+        case SimplifyVertexKind_SEAM:     return ((s->open_out[u] == (s32)v) || (s->open_in[u] == (s32)v)) && (get_twin_target(s, u, v) >= 0);
+        case SimplifyVertexKind_WEDGES:   return is_closed_fan(s, u) && (get_wedges_shading_distance(s, u, v) >= 0.0f);
+    }
+    
+    return FALSE;
+}
+
+FUNCTION f32 get_collapse_cost(Mesh_Simplifier *s, u32 u, u32 v)
+{
+    // Squared, like the quadric errors.
+    
+    s32 const *canonical = s->mesh->canonical_vertex_map.data;
+    f32 skinning = get_skinning_distance(s->mesh->skeleton, canonical[u], canonical[v]) * MESH_LOD_SKINNING_ERROR * s->radius;
+    f32 shading  = 0.0f;
+    if (s->kinds[u] == SimplifyVertexKind_WEDGES)
+        shading = get_wedges_shading_distance(s, u, v) * MESH_LOD_SHADING_ERROR * s->radius;
+    
+    return get_quadric_error(&s->quadrics[s->remap[u]], s->mesh->vertices[v]) + skinning*skinning + shading*shading;
+}
+
+FUNCTION b32 collapse_flips_triangles(Mesh_Simplifier *s, u32 u, u32 v)
+{
+    // Whether moving u to v turns any of the triangles that stay around.
+    
+    V3 const *positions = s->mesh->vertices.data;
+    for (s32 i = s->offsets[u]; i < s->offsets[u + 1]; i++) {
+        u32 *t = &s->indices[3*s->adjacency[i]];
+        if ((t[0] == t[1]) || (t[1] == t[2]) || (t[2] == t[0])) continue;
+        if ((t[0] == v)    || (t[1] == v)    || (t[2] == v))    continue;
+        
+        V3 p[3], q[3];
+        for (s32 corner = 0; corner < 3; corner++) {
+            p[corner] = positions[t[corner]];
+            q[corner] = positions[(t[corner] == u)? v : t[corner]];
+        }
+        if (dot(cross(p[1] - p[0], p[2] - p[0]), cross(q[1] - q[0], q[2] - q[0])) <= 0.0f) 
+            return TRUE;
+    }
+    
+    return FALSE;
+}
+
+FUNCTION s32 collapse_vertex(Mesh_Simplifier *s, u32 u, u32 v)
+{
+    // Returns the number of triangles that went away.
+    
+    s32 removed = 0;
+    for (s32 i = s->offsets[u]; i < s->offsets[u + 1]; i++) {
+        u32 *t = &s->indices[3*s->adjacency[i]];
+        if ((t[0] == t[1]) || (t[1] == t[2]) || (t[2] == t[0])) continue;
+        
+        for (s32 corner = 0; corner < 3; corner++) {
+            if (t[corner] == u) t[corner] = v;
+        }
+        if ((t[0] == t[1]) || (t[1] == t[2]) || (t[2] == t[0])) removed++;
+    }
+    
+    return removed;
+}
+
+FUNCTION void simplify_mesh(Mesh_Simplifier *s, s32 target_triangles, f32 max_error)
+{
+    // Collapses vertices until the mesh is down to target_triangles, or every collapse left would move the 
+    // surface by more than max_error. Every pass collapses the cheapest edges whose positions haven't been
+    // touched by the pass yet.
+    
+    Arena_Temp scratch = get_scratch(0, 0);
+    defer(free_scratch(scratch));
+    
+    s32 const *remap = s->remap;
+    s32 num_vertices = (s32)s->mesh->vertices.count;
+    f32 max_cost     = max_error*max_error;
+    u32 *from        = PUSH_ARRAY(scratch.arena, u32, s->num_indices);
+    u32 *to          = PUSH_ARRAY(scratch.arena, u32, s->num_indices);
+    f32 *keys        = PUSH_ARRAY(scratch.arena, f32, s->num_indices);
+    s32 *order       = PUSH_ARRAY(scratch.arena, s32, s->num_indices);
+    u8  *locked      = PUSH_ARRAY(scratch.arena, u8, num_vertices);
+    
+    s32 num_triangles = s->num_indices / 3;
+    while (num_triangles > target_triangles) {
+        build_simplifier_adjacency(s);
+        
+        // The cheaper way to collapse each edge. Edges shared by two triangles come up twice, that's fine.
+        // Collapses that would turn triangles over don't count, or they'd stay the cheapest ones forever.
+        s32 num_candidates = 0;
+        for (s32 i = 0; i < s->num_indices; i++) {
+            u32 a = s->indices[i];
+            u32 b = s->indices[i - i%3 + (i + 1)%3];
+            
+            f32 cost_ab = can_collapse(s, a, b)? get_collapse_cost(s, a, b) : F32_MAX;
+            f32 cost_ba = can_collapse(s, b, a)? get_collapse_cost(s, b, a) : F32_MAX;
+            if ((cost_ab <= max_cost) && collapse_flips_triangles(s, a, b)) cost_ab = F32_MAX;
+            if ((cost_ba <= max_cost) && collapse_flips_triangles(s, b, a)) cost_ba = F32_MAX;
+            
+            f32 cost = MIN(cost_ab, cost_ba);
+            if (cost > max_cost) continue;
+            
+            from[num_candidates] = (cost_ab <= cost_ba)? a : b;
+            to  [num_candidates] = (cost_ab <= cost_ba)? b : a;
+            keys[num_candidates] = -cost;
+            num_candidates++;
+        }
+        if (!num_candidates) break;
+        
+        sort_descending(keys, order, num_candidates);
+        MEMORY_ZERO(locked, num_vertices);
+        
+        // A collapse takes away two triangles, most of the time. Don't go much past the cost of the
+        // collapses we need: costs around the ones we make are stale, they'll be cheaper next pass.
+        s32 goal      = MIN(num_candidates, (num_triangles - target_triangles + 1) / 2);
+        f32 pass_cost = -keys[order[MAX(goal, 1) - 1]] * MESH_LOD_PASS_COST_RATIO;
+        
+        s32 num_collapses = 0;
+        for (s32 i = 0; (i < num_candidates) && (num_triangles > target_triangles); i++) {
+            s32 candidate = order[i];
+            if (-keys[candidate] > pass_cost) break;
+            
+            u32 u = from[candidate], v = to[candidate];
+            if (locked[remap[u]] || locked[remap[v]]) continue;
+            
+            b32 seam        = (s->kinds[u] == SimplifyVertexKind_SEAM);
+            s32 twin        = seam? s->wedges[u]              : -1;
+            s32 twin_target = seam? get_twin_target(s, u, v) : -1;
+            if (collapse_flips_triangles(s, u, v) || (seam && collapse_flips_triangles(s, (u32)twin, (u32)twin_target)))
+                continue;
+            
+            if (s->kinds[u] == SimplifyVertexKind_WEDGES) {
+                // Every vertex at u's position goes, or none does.
+                b32 flips = FALSE;
+                u32 w     = u;
+                do {
+                    flips |= collapse_flips_triangles(s, w, (u32)get_wedge_target(s, w, v));
+                    w      = (u32)s->wedges[w];
+                } while ((w != u) && !flips);
+                if (flips) continue;
+                
+                do {
+                    if (w != u) num_triangles -= collapse_vertex(s, w, (u32)get_wedge_target(s, w, v));
+                    w = (u32)s->wedges[w];
+                } while (w != u);
+                v = (u32)get_wedge_target(s, u, v);
+            }
+            
+            num_triangles -= collapse_vertex(s, u, v);
+            if (seam) num_triangles -= collapse_vertex(s, (u32)twin, (u32)twin_target);
+            
+            // The penalties only pick the collapses; the LOD's error is how far the surface moved.
+            s->max_error = MAX(s->max_error, get_quadric_error(&s->quadrics[remap[u]], s->mesh->vertices[v]));
+            add_quadric(&s->quadrics[remap[v]], &s->quadrics[remap[u]]);
+            locked[remap[u]] = 1;
+            locked[remap[v]] = 1;
+            num_collapses++;
+        }
+        
+        // Drop the triangles that went away.
+        s32 num_indices = 0;
+        for (s32 i = 0; i < s->num_indices; i += 3) {
+            u32 *t = &s->indices[i];
+            if ((t[0] == t[1]) || (t[1] == t[2]) || (t[2] == t[0])) continue;
+            
+            s->lists[num_indices / 3] = s->lists[i / 3];
+            s->indices[num_indices++] = t[0];
+            s->indices[num_indices++] = t[1];
+            s->indices[num_indices++] = t[2];
+        }
+        s->num_indices = num_indices;
+        
+        if (!num_collapses) break;
+    }
+}
+
+FUNCTION void generate_lods_for_mesh(Triangle_Mesh *mesh)
+{
+    // Appends the indices of each LOD to mesh->indices, see Mesh_LOD. Needs the bounding box.
+    
+    Arena_Temp scratch = get_scratch(0, 0);
+    defer(free_scratch(scratch));
+    
+    s32 num_lists    = (s32)mesh->triangle_list_info.count;
+    s32 num_vertices = (s32)mesh->vertices.count;
+    s32 *remap       = PUSH_ARRAY(scratch.arena, s32, num_vertices);
+    get_position_remap(mesh->vertices.data, num_vertices, remap);
+    
+    array_init(&mesh->lods);
+    array_init(&mesh->lod_lists);
+    
+    Mesh_LOD full_lod = {0.0f, 0, (s32)mesh->indices.count};
+    array_add(&mesh->lods, full_lod);
+    for (s32 l = 0; l < num_lists; l++) {
+        Mesh_LOD_List lod_list = {mesh->triangle_list_info[l].first_index, mesh->triangle_list_info[l].num_indices};
+        array_add(&mesh->lod_lists, lod_list);
+    }
+    
+    f32 radius = 0.5f*length(get_size(mesh->bounding_box));
+    Mesh_Simplifier simplifier = {};
+    init_mesh_simplifier(scratch.arena, &simplifier, mesh, remap, radius);
+    
+    // The LODs' indices go here first; array_resize() doesn't keep what's in the array when it grows.
+    s32 num_full_indices = (s32)mesh->indices.count;
+    u32 *lod_indices     = PUSH_ARRAY(scratch.arena, u32, (MAX_MESH_LODS - 1)*num_full_indices);
+    s32 num_lod_indices  = 0;
+    
+    for (s32 lod_index = 1; lod_index < MAX_MESH_LODS; lod_index++) {
+        Mesh_LOD lod    = {};
+        lod.first_index = num_full_indices + num_lod_indices;
+        
+        // Every LOD goes on from the previous one.
+        Mesh_Simplifier *s = &simplifier;
+        simplify_mesh(s, (s32)(MESH_LOD_TRIANGLE_RATIO*(mesh->lods[lod_index - 1].num_indices / 3)), MESH_LOD_MAX_ERROR*radius);
+        lod.error = safe_div0(_sqrt(s->max_error), radius);
+        
+        for (s32 l = 0; l < num_lists; l++) {
+            Mesh_LOD_List lod_list = {num_full_indices + num_lod_indices, 0};
+            for (s32 i = 0; i < s->num_indices; i += 3) {
+                if (s->lists[i / 3] != l) continue;
+                
+                MEMORY_COPY(lod_indices + num_lod_indices, &s->indices[i], 3*sizeof(u32));
+                num_lod_indices += 3;
+            }
+            lod_list.num_indices = num_full_indices + num_lod_indices - lod_list.first_index;
+            array_add(&mesh->lod_lists, lod_list);
+            
+            lod.num_indices += lod_list.num_indices;
+        }
+        
+        // Not worth a LOD.
+        if (lod.num_indices > MESH_LOD_MIN_REDUCTION*mesh->lods[lod_index - 1].num_indices) {
+            num_lod_indices = lod.first_index - num_full_indices;
+            array_resize(&mesh->lod_lists, lod_index*num_lists);
+            break;
+        }
+        array_add(&mesh->lods, lod);
+        
+        debug_print("Mesh %S: LOD %d, %d of %d triangles, error %f of the radius\n", 
+                    mesh->full_path, lod_index, lod.num_indices / 3, num_full_indices / 3, lod.error);
+    }
+    
+    Array<u32> indices;
+    array_init_and_resize(&indices, num_full_indices + num_lod_indices);
+    MEMORY_COPY(indices.data, mesh->indices.data, num_full_indices*sizeof(u32));
+    MEMORY_COPY(indices.data + num_full_indices, lod_indices, num_lod_indices*sizeof(u32));
+    array_free(&mesh->indices);
+    mesh->indices = indices;
+    
+    for (s32 i = num_lists; i < mesh->lod_lists.count; i++) {
+        Triangle_List_Info list = {};
+        list.first_index        = mesh->lod_lists[i].first_index;
+        list.num_indices        = mesh->lod_lists[i].num_indices;
+        optimize_triangle_list(mesh, &list);
+    }
+}
+
+FUNCTION inline Mesh_LOD_List* get_lod_list(Triangle_Mesh *mesh, s32 lod, s32 list_index)
+{
+    return &mesh->lod_lists[lod*mesh->triangle_list_info.count + list_index];
+}
+
+//~ Mesh Validation
+//
+
+FUNCTION b32 validate_mesh_data(String8 file, String8 full_path)
+{
+    // @Note: Walks a .mesh the way load_mesh_data() reads it, but checks every count, index and range 
+    // first, so broken exporter output is reported instead of tripping asserts (or worse) later.
+    
+    s32 version = 0;
+    if (!get_checked(&file, &version))                  return validation_error(full_path, "no version");
+    if ((version <= 0) || (version > MESH_FILE_VERSION)) return validation_error(full_path, "unknown version");
+    
+    Triangle_Mesh_Header header = {};
+    if (!get_checked(&file, &header)) return validation_error(full_path, "truncated header");
+    if ((header.num_vertices <= 0) || (header.num_indices < 0) || (header.num_triangle_lists < 0) || 
+        (header.num_materials < 0) || (header.num_skeleton_joints < 0))
+        return validation_error(full_path, "negative or zero counts in header");
+    if (header.num_indices % 3) return validation_error(full_path, "number of indices isn't a multiple of 3");
+    
+    // Vertex data, all floats.
+    u64 vertex_size = sizeof(V3) + sizeof(TBN) + sizeof(V2) + sizeof(V4);
+    if (file.count < (u64)header.num_vertices * vertex_size) return validation_error(full_path, "truncated vertex data");
+    if (!are_finite((f32 *)file.data, (u64)header.num_vertices * vertex_size / sizeof(f32)))
+        return validation_error(full_path, "vertex data isn't finite");
+    advance(&file, (u64)header.num_vertices * vertex_size);
+    
+    // Canonical vertex map. We can only check the upper bound once we know the number of canonical vertices.
+    s32 max_canonical_vertex = -1;
+    for (s32 i = 0; i < header.num_vertices; i++) {
+        s32 canonical_vertex;
+        if (!get_checked(&file, &canonical_vertex)) return validation_error(full_path, "truncated canonical vertex map");
+        if (canonical_vertex < 0)                   return validation_error(full_path, "negative canonical vertex");
+        max_canonical_vertex = MAX(max_canonical_vertex, canonical_vertex);
+    }
+    
+    for (s32 i = 0; i < header.num_indices; i++) {
+        u32 index;
+        if (!get_checked(&file, &index))      return validation_error(full_path, "truncated indices");
+        if (index >= (u32)header.num_vertices) return validation_error(full_path, "index out of range");
+    }
+    
+    for (s32 i = 0; i < header.num_triangle_lists; i++) {
+        s32 list[3]; // material_index, num_indices, first_index
+        if (!get_checked(&file, &list)) return validation_error(full_path, "truncated triangle lists");
+        if ((list[0] < 0) || (list[0] >= header.num_materials))
+            return validation_error(full_path, "triangle list material out of range");
+        if ((list[1] < 0) || (list[1] % 3) || (list[2] < 0) || (list[2] > header.num_indices - list[1]))
+            return validation_error(full_path, "triangle list indices out of range");
+    }
+    
+    for (s32 i = 0; i < header.num_materials; i++) {
+        f32 values[6]; // base_color, metallic, roughness
+        if (!get_checked(&file, &values))   return validation_error(full_path, "truncated materials");
+        if (!are_finite(values, 6))         return validation_error(full_path, "material values aren't finite");
+        
+        for (s32 map_index = 0; map_index < MaterialTextureMapType_COUNT; map_index++) {
+            s32 map_name_len = 0;
+            if (!get_checked(&file, &map_name_len) || (map_name_len < 0) || ((u64)map_name_len > file.count))
+                return validation_error(full_path, "truncated texture map name");
+            advance(&file, map_name_len);
+        }
+    }
+    
+    if (!header.num_skeleton_joints) {
+        if (file.count) return validation_error(full_path, "trailing data");
+        return TRUE;
+    }
+    
+    for (s32 i = 0; i < header.num_skeleton_joints; i++) {
+        f32 transform[16 + 4]; // object_to_joint_matrix, rest_pose_rotation_relative
+        if (!get_checked(&file, &transform)) return validation_error(full_path, "truncated joints");
+        if (!are_finite(transform, 16 + 4))  return validation_error(full_path, "joint transform isn't finite");
+        
+        s32 joint_name_len = 0;
+        if (!get_checked(&file, &joint_name_len) || (joint_name_len < 0) || ((u64)joint_name_len > file.count))
+            return validation_error(full_path, "truncated joint name");
+        advance(&file, joint_name_len);
+        
+        s32 parent_id;
+        if (!get_checked(&file, &parent_id)) return validation_error(full_path, "truncated joints");
+        if ((parent_id < -1) || (parent_id >= header.num_skeleton_joints) || (parent_id == i))
+            return validation_error(full_path, "joint parent out of range");
+        if (parent_id > i)
+            return validation_error(full_path, "joint comes before its parent"); // The hierarchy pass needs parents first.
+    }
+    
+    s32 num_canonical_vertices;
+    if (!get_checked(&file, &num_canonical_vertices)) return validation_error(full_path, "truncated blend info");
+    if (max_canonical_vertex >= num_canonical_vertices) return validation_error(full_path, "canonical vertex out of range");
+    
+    for (s32 i = 0; i < num_canonical_vertices; i++) {
+        s32 num_pieces;
+        if (!get_checked(&file, &num_pieces)) return validation_error(full_path, "truncated blend info");
+        if ((num_pieces < 0) || (num_pieces > MAX_JOINTS_PER_VERTEX))
+            return validation_error(full_path, "too many joint influences");
+        
+        for (s32 piece_index = 0; piece_index < num_pieces; piece_index++) {
+            Vertex_Blend_Piece piece;
+            if (!get_checked(&file, &piece)) return validation_error(full_path, "truncated blend info");
+            if ((piece.joint_id < 0) || (piece.joint_id >= header.num_skeleton_joints))
+                return validation_error(full_path, "blend joint out of range");
+            if (!are_finite(&piece.weight, 1) || (piece.weight < 0.0f))
+                return validation_error(full_path, "blend weight isn't a finite positive number");
+        }
+    }
+    
+    if (file.count) return validation_error(full_path, "trailing data");
+    return TRUE;
+}
+
+//~ Cooked Meshes
+//
+
+FUNCTION String8 get_cooked_mesh_path(Arena *arena, String8 full_path)
+{
+    return sprint(arena, "%S.cooked_mesh", chop_extension(full_path));
+}
+
+FUNCTION void cook_mesh(Arena *arena, Triangle_Mesh *mesh)
+{
+    // Everything we compute from a freshly loaded .mesh before using or cooking it.
+    
+    optimize_mesh_indices(mesh);
+    
+    mesh->packed_vertices = PUSH_ARRAY(arena, Vertex_XTBNUCJW, mesh->vertices.count);
+    pack_vertices(mesh, mesh->packed_vertices);
+    
+    generate_bounding_box_for_mesh(mesh);
+    generate_lods_for_mesh(mesh);
+    generate_skinning_buckets_for_mesh(arena, mesh);
+    generate_skinning_regions_for_mesh(mesh);
+}
+
+FUNCTION String8 build_cooked_mesh(Arena *arena, Triangle_Mesh *mesh, u64 source_date, u64 source_size, u64 source_hash)
+{
+    // Returns the .cooked_mesh for a cooked mesh (see cook_mesh()).
+    
+    Skeleton *skeleton    = mesh->skeleton;
+    s64 num_vertices      = mesh->vertices.count;
+    s64 num_materials     = mesh->material_info.count;
+    s64 num_joints        = skeleton? skeleton->joint_info.count        : 0;
+    s64 num_bucket_arrays = skeleton? 5*MAX_JOINTS_PER_VERTEX            : 0;
+    
+    s64 counts[MeshSection_COUNT] = {};
+    counts[MeshSection_INFO]                         = 1;
+    counts[MeshSection_VERTEX_BUFFER]                = num_vertices;
+    counts[MeshSection_POSITIONS]                    = num_vertices;
+    counts[MeshSection_TBNS]                         = mesh->tbns.count;
+    counts[MeshSection_UVS]                          = mesh->uvs.count;
+    counts[MeshSection_COLORS]                       = mesh->colors.count;
+    counts[MeshSection_CANONICAL_VERTEX_MAP]         = mesh->canonical_vertex_map.count;
+    counts[MeshSection_INDICES]                      = mesh->indices.count;
+    counts[MeshSection_TRIANGLE_LISTS]               = mesh->triangle_list_info.count;
+    counts[MeshSection_LODS]                         = mesh->lods.count;
+    counts[MeshSection_LOD_LISTS]                    = mesh->lod_lists.count;
+    counts[MeshSection_MATERIALS]                    = num_materials;
+    counts[MeshSection_JOINTS]                       = num_joints;
+    counts[MeshSection_BLEND_INFO]                   = skeleton? skeleton->vertex_blend_info.count : 0;
+    counts[MeshSection_SKINNING_BUCKETS]             = skeleton? MAX_JOINTS_PER_VERTEX : 0;
+    counts[MeshSection_SKINNING_REGIONS]             = mesh->skinning_regions.count;
+    counts[MeshSection_SKINNING_REGION_JOINTS]       = mesh->skinning_region_joints.count;
+    counts[MeshSection_SKINNING_REGION_DEPENDENCIES] = mesh->skinning_region_dependencies.count;
+    counts[MeshSection_SKINNING_REGION_INDICES]      = mesh->skinning_region_indices.count;
+    counts[MeshSection_JOINT_INFLUENCE_BOUNDS]       = mesh->joint_influence_bounds.count;
+    
+    u64 max_blob_size = num_bucket_arrays*COOKED_FILE_ALIGNMENT;
+    for (s32 i = 0; i < num_materials; i++) {
+        for (s32 map_index = 0; map_index < MaterialTextureMapType_COUNT; map_index++)
+            max_blob_size += mesh->material_info[i].texture_map_names[map_index].count + 1;
+    }
+    for (s32 i = 0; i < num_joints; i++)
+        max_blob_size += skeleton->joint_info[i].name.count + 1;
+    for (s32 b = 0; skeleton && (b < MAX_JOINTS_PER_VERTEX); b++) {
+        Skinning_Bucket *bucket = &mesh->skinning_buckets[b];
+        s64 n                   = bucket->num_blocks * SKINNING_BLOCK_SIZE;
+        max_blob_size          += (3 + 9 + 2*bucket->num_influences + 1) * n * sizeof(f32);
+    }
+    s64 max_fixups = num_materials*MaterialTextureMapType_COUNT + num_joints + num_bucket_arrays;
+    
+    Cooked_File_Writer writer = begin_cooked_file(arena, &MESH_COOKED_FILE, counts, max_blob_size, max_fixups);
+    Cooked_Section *sections  = writer.sections;
+    
+    Mesh_Cooked_Info *info           = (Mesh_Cooked_Info *) get_section_data(&writer, MeshSection_INFO);
+    info->flags                      = mesh->flags;
+    info->skinning_region_mask_words = mesh->skinning_region_mask_words;
+    info->bounding_box               = mesh->bounding_box;
+    
+    MEMORY_COPY(get_section_data(&writer, MeshSection_VERTEX_BUFFER),        mesh->packed_vertices,           sections[MeshSection_VERTEX_BUFFER]       .size);
+    MEMORY_COPY(get_section_data(&writer, MeshSection_POSITIONS),            mesh->vertices.data,             sections[MeshSection_POSITIONS]           .size);
+    MEMORY_COPY(get_section_data(&writer, MeshSection_TBNS),                 mesh->tbns.data,                 sections[MeshSection_TBNS]                .size);
+    MEMORY_COPY(get_section_data(&writer, MeshSection_UVS),                  mesh->uvs.data,                  sections[MeshSection_UVS]                 .size);
+    MEMORY_COPY(get_section_data(&writer, MeshSection_COLORS),               mesh->colors.data,               sections[MeshSection_COLORS]              .size);
+    MEMORY_COPY(get_section_data(&writer, MeshSection_CANONICAL_VERTEX_MAP), mesh->canonical_vertex_map.data, sections[MeshSection_CANONICAL_VERTEX_MAP].size);
+    MEMORY_COPY(get_section_data(&writer, MeshSection_INDICES),              mesh->indices.data,              sections[MeshSection_INDICES]             .size);
+    
+    Triangle_List_Info *lists = (Triangle_List_Info *) get_section_data(&writer, MeshSection_TRIANGLE_LISTS);
+    for (s32 i = 0; i < mesh->triangle_list_info.count; i++) {
+        lists[i].material_index = mesh->triangle_list_info[i].material_index;
+        lists[i].num_indices    = mesh->triangle_list_info[i].num_indices;
+        lists[i].first_index    = mesh->triangle_list_info[i].first_index;
+    }
+    
+    MEMORY_COPY(get_section_data(&writer, MeshSection_LODS),      mesh->lods.data,      sections[MeshSection_LODS]     .size);
+    MEMORY_COPY(get_section_data(&writer, MeshSection_LOD_LISTS), mesh->lod_lists.data, sections[MeshSection_LOD_LISTS].size);
+    
+    Material_Info *materials = (Material_Info *) get_section_data(&writer, MeshSection_MATERIALS);
+    for (s32 i = 0; i < num_materials; i++) {
+        materials[i] = mesh->material_info[i];
+        for (s32 map_index = 0; map_index < MaterialTextureMapType_COUNT; map_index++)
+            write_cooked_string(&writer, &materials[i].texture_map_names[map_index]);
+    }
+    
+    if (skeleton) {
+        Skeleton_Joint_Info *joints = (Skeleton_Joint_Info *) get_section_data(&writer, MeshSection_JOINTS);
+        for (s32 i = 0; i < num_joints; i++) {
+            joints[i] = skeleton->joint_info[i];
+            write_cooked_string(&writer, &joints[i].name);
+        }
+        MEMORY_COPY(get_section_data(&writer, MeshSection_BLEND_INFO), skeleton->vertex_blend_info.data, sections[MeshSection_BLEND_INFO].size);
+        
+        Skinning_Bucket *buckets = (Skinning_Bucket *) get_section_data(&writer, MeshSection_SKINNING_BUCKETS);
+        for (s32 b = 0; b < MAX_JOINTS_PER_VERTEX; b++) {
+            Skinning_Bucket *bucket = &buckets[b];
+            *bucket                 = mesh->skinning_buckets[b];
+            
+            u64 n = (u64)bucket->num_blocks * SKINNING_BLOCK_SIZE;
+            write_cooked_blob(&writer, &bucket->positions,      bucket->positions,      3*n*sizeof(f32),                       COOKED_FILE_ALIGNMENT);
+            write_cooked_blob(&writer, &bucket->tbns,           bucket->tbns,           9*n*sizeof(f32),                       COOKED_FILE_ALIGNMENT);
+            write_cooked_blob(&writer, &bucket->joint_ids,      bucket->joint_ids,      bucket->num_influences*n*sizeof(s32), COOKED_FILE_ALIGNMENT);
+            write_cooked_blob(&writer, &bucket->weights,        bucket->weights,        bucket->num_influences*n*sizeof(f32), COOKED_FILE_ALIGNMENT);
+            write_cooked_blob(&writer, &bucket->vertex_indices, bucket->vertex_indices, n*sizeof(s32),                         COOKED_FILE_ALIGNMENT);
+        }
+        
+        MEMORY_COPY(get_section_data(&writer, MeshSection_SKINNING_REGIONS),             mesh->skinning_regions.data,             sections[MeshSection_SKINNING_REGIONS]            .size);
+        MEMORY_COPY(get_section_data(&writer, MeshSection_SKINNING_REGION_JOINTS),       mesh->skinning_region_joints.data,       sections[MeshSection_SKINNING_REGION_JOINTS]      .size);
+        MEMORY_COPY(get_section_data(&writer, MeshSection_SKINNING_REGION_DEPENDENCIES), mesh->skinning_region_dependencies.data, sections[MeshSection_SKINNING_REGION_DEPENDENCIES].size);
+        MEMORY_COPY(get_section_data(&writer, MeshSection_SKINNING_REGION_INDICES),      mesh->skinning_region_indices.data,      sections[MeshSection_SKINNING_REGION_INDICES]     .size);
+        MEMORY_COPY(get_section_data(&writer, MeshSection_JOINT_INFLUENCE_BOUNDS),       mesh->joint_influence_bounds.data,       sections[MeshSection_JOINT_INFLUENCE_BOUNDS]      .size);
+    }
+    
+    return end_cooked_file(&writer, source_date, source_size, source_hash);
+}
+
+FUNCTION b32 load_cooked_mesh(Arena *arena, Triangle_Mesh *mesh, String8 full_path, File_Info *source)
+{
+    String8 file = map_cooked_file(full_path, &MESH_COOKED_FILE, source);
+    if (!file.data) return FALSE;
+    
+    Cooked_Section *sections = get_cooked_sections(file);
+    if ((sections[MeshSection_INFO].count != 1) ||
+        (sections[MeshSection_VERTEX_BUFFER].count != sections[MeshSection_POSITIONS].count) ||
+        (sections[MeshSection_LODS].count < 1) ||
+        (sections[MeshSection_LOD_LISTS].count != sections[MeshSection_LODS].count*sections[MeshSection_TRIANGLE_LISTS].count) ||
+        (sections[MeshSection_SKINNING_BUCKETS].count && (sections[MeshSection_SKINNING_BUCKETS].count != MAX_JOINTS_PER_VERTEX))) {
+        debug_print("Cooked mesh %S is broken, cooking it again.\n", full_path);
+        os->unmap_file(file.data);
+        return FALSE;
+    }
+    
+    Mesh_Cooked_Info *info = (Mesh_Cooked_Info *) get_section_data(file, MeshSection_INFO);
+    mesh->cooked           = file;
+    mesh->packed_vertices  = (Vertex_XTBNUCJW *) get_section_data(file, MeshSection_VERTEX_BUFFER);
+    mesh->flags           |= info->flags;
+    mesh->bounding_box     = info->bounding_box;
+    
+    point_array_at_section(&mesh->vertices,             file, MeshSection_POSITIONS);
+    point_array_at_section(&mesh->tbns,                 file, MeshSection_TBNS);
+    point_array_at_section(&mesh->uvs,                  file, MeshSection_UVS);
+    point_array_at_section(&mesh->colors,               file, MeshSection_COLORS);
+    point_array_at_section(&mesh->canonical_vertex_map, file, MeshSection_CANONICAL_VERTEX_MAP);
+    point_array_at_section(&mesh->indices,              file, MeshSection_INDICES);
+    point_array_at_section(&mesh->triangle_list_info,   file, MeshSection_TRIANGLE_LISTS);
+    point_array_at_section(&mesh->lods,                 file, MeshSection_LODS);
+    point_array_at_section(&mesh->lod_lists,            file, MeshSection_LOD_LISTS);
+    point_array_at_section(&mesh->material_info,        file, MeshSection_MATERIALS);
+    
+    if (sections[MeshSection_JOINTS].count) {
+        mesh->skeleton = PUSH_STRUCT_ZERO(arena, Skeleton);
+        point_array_at_section(&mesh->skeleton->joint_info,        file, MeshSection_JOINTS);
+        point_array_at_section(&mesh->skeleton->vertex_blend_info, file, MeshSection_BLEND_INFO);
+        
+        MEMORY_COPY(mesh->skinning_buckets, get_section_data(file, MeshSection_SKINNING_BUCKETS), sizeof(mesh->skinning_buckets));
+        point_array_at_section(&mesh->skinning_regions,             file, MeshSection_SKINNING_REGIONS);
+        point_array_at_section(&mesh->skinning_region_joints,       file, MeshSection_SKINNING_REGION_JOINTS);
+        point_array_at_section(&mesh->skinning_region_dependencies, file, MeshSection_SKINNING_REGION_DEPENDENCIES);
+        point_array_at_section(&mesh->skinning_region_indices,      file, MeshSection_SKINNING_REGION_INDICES);
+        point_array_at_section(&mesh->joint_influence_bounds,       file, MeshSection_JOINT_INFLUENCE_BOUNDS);
+        mesh->skinning_region_mask_words = info->skinning_region_mask_words;
+    }
+    
+    return TRUE;
+}
+
+FUNCTION b32 load_and_cook_mesh(Arena *arena, Triangle_Mesh *mesh, String8 file, String8 full_path)
+{
+    // Loads mesh from the contents of a .mesh and cooks it. Returns FALSE if the .mesh is broken.
+    
+    if (!validate_mesh_data(file, full_path)) return FALSE;
+    
+    load_mesh_data(arena, mesh, file);
+    cook_mesh(arena, mesh);
+    return TRUE;
+}
+
+#if !COOKER
+//~ Triangle Mesh Loading
+//
+
+FUNCTION void load_triangle_mesh(Arena *arena, Triangle_Mesh *mesh, String8 full_path)
+{
+    // @Note: Maps the cooked mesh if it's there and up to date (run the cooker to make sure of that). 
+    // Otherwise we load the .mesh, cook it and write the cooked mesh for next time.
+    
+    mesh->full_path = full_path;
+    
+    Arena_Temp scratch = get_scratch(&arena, 1);
+    defer(free_scratch(scratch));
+    
+    File_Group source = os->get_all_files_in_path(scratch.arena, full_path);
+    if (!source.first_file_info) {
+        debug_print("MESH LOAD ERROR: Couldn't find mesh at %S\n", full_path);
+        return;
+    }
+    File_Info *source_info = source.first_file_info;
+    
+    String8 cooked_path = get_cooked_mesh_path(scratch.arena, full_path);
+    if (!load_cooked_mesh(arena, mesh, cooked_path, source_info)) {
+        String8 file = os->read_entire_file(full_path);
+        if (!file.data) {
+            debug_print("MESH LOAD ERROR: Couldn't load mesh at %S\n", full_path);
+            return;
+        }
+        
+        b32 loaded = load_and_cook_mesh(arena, mesh, file, full_path);
+        u64 source_hash = get_cooked_hash(file.data, file.count);
+        os->free_file_memory(file.data);
+        if (!loaded) return;
+        
+        String8 cooked = build_cooked_mesh(scratch.arena, mesh, source_info->file_date, source_info->file_size, source_hash);
+        if (!os->write_entire_file(cooked_path, cooked))
+            debug_print("MESH COOK ERROR: Couldn't write cooked mesh %S\n", cooked_path);
+    }
+    
+    load_mesh_textures(mesh);
+    generate_buffers_for_mesh(mesh);
+}
+#endif
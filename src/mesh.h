@@ -42,11 +42,68 @@ struct Vertex_Blend_Info
     Vertex_Blend_Piece pieces[MAX_JOINTS_PER_VERTEX]; // Weights should add to 1?
 };
 
+// @Note: Vertices are regrouped for the CPU skinning kernel (skin_mesh()) at load time: one bucket per 
+// number of joint influences, so the inner loop doesn't branch on num_pieces, and each bucket is stored 
+// in blocks of SKINNING_BLOCK_SIZE vertices in SoA form (xxxx yyyy zzzz) so that a SIMD register holds 
+// the same component of a whole block. The last block of a bucket repeats its last vertex as padding.
+// Weights are normalized when building the buckets.
+#define SKINNING_BLOCK_SIZE 4
+struct Skinning_Bucket
+{
+    s32  num_influences; // 1 to MAX_JOINTS_PER_VERTEX
+    s32  num_vertices;
+    s32  num_blocks;
+    
+    f32 *positions;      // 3*SKINNING_BLOCK_SIZE per block.
+    f32 *tbns;           // 9*SKINNING_BLOCK_SIZE per block; tangents, bitangents, then normals.
+    s32 *joint_ids;      // num_influences*SKINNING_BLOCK_SIZE per block, influence-major.
+    f32 *weights;        // Same layout as joint_ids.
+    s32 *vertex_indices; // SKINNING_BLOCK_SIZE per block; the mesh vertex each lane writes to.
+};
+
+// @Note: For picking we also split the mesh into regions, one per joint, made of the vertices whose first
+// influence is that joint. The buckets are sorted by first joint, so a region is a contiguous range of 
+// blocks in each bucket. Every triangle is owned by the region of its first skinned vertex; the last 
+// region holds the triangles that no joint moves. This lets us skin and ray test only the regions 
+// whose posed bounds the ray hits (see segment_skinned_mesh_intersect()).
+struct Skinning_Region
+{
+    s32 first_block        [MAX_JOINTS_PER_VERTEX]; // Per bucket.
+    s32 one_past_last_block[MAX_JOINTS_PER_VERTEX];
+    
+    s32 first_index;  // Into Triangle_Mesh::skinning_region_indices.
+    s32 num_indices;
+};
+
+// @Note: Meshes get a chain of LODs when cooking (see generate_lods_for_mesh()). LOD 0 is the mesh as 
+// exported, and each next one has about half the triangles of the one before. A LOD has the same triangle
+// lists and vertices as the full mesh, only other indices: the indices of every LOD are in 
+// Triangle_Mesh::indices, one LOD after the other, and within a LOD one triangle list after the other.
+#define MAX_MESH_LODS 4
+struct Mesh_LOD
+{
+    f32 error;       // How far the surface may be from LOD 0's, as a fraction of the bounds' radius.
+    s32 first_index; // Of the LOD's first triangle list.
+    s32 num_indices; // Of all its triangle lists.
+};
+
+struct Mesh_LOD_List
+{
+    s32 first_index;
+    s32 num_indices;
+};
+
+// A LOD is drawn when its error, projected on screen, is under this many pixels (see select_mesh_lod()).
+GLOBAL f32 const MESH_LOD_MAX_SCREEN_ERROR = 1.0f;
+
+// Switching to a coarser LOD needs this much less projected error than switching back.
+GLOBAL f32 const MESH_LOD_HYSTERESIS = 1.1f;
+
 struct Skeleton_Joint_Info
 {
     // People call this "inverse bind pose matrix" or "offset matrix"; it transforms vertices from
     // object/mesh space to joint space (relative to parent).
-    M4x4       object_to_joint_matrix; 
+    M3x4       object_to_joint_matrix; 
     
     // Joint's rest pose rotation relative to its parent (joint space).
     // We use this to figure out if we are in the neighborhood of the rest pose when blending animations.
@@ -131,10 +188,23 @@ struct Triangle_Mesh
     Array<Triangle_List_Info> triangle_list_info;
 	Array<Material_Info>      material_info;
     
-#if DEVELOPER
-    // @Note: Used for mouse picking.
-    Array<V3> skinned_vertices;
-#endif
+    // lods[0] is the full mesh. One lod_list per LOD and triangle list, see get_lod_list().
+    Array<Mesh_LOD>      lods;
+    Array<Mesh_LOD_List> lod_lists;
+    
+    // Index with (num_influences - 1). Vertices with no influences aren't in any bucket.
+    Skinning_Bucket skinning_buckets[MAX_JOINTS_PER_VERTEX];
+    
+    // num_skeleton_joints + 1 regions per LOD, LOD by LOD. The masks are bitsets of skinning_region_mask_words
+    // u64s per region. Dependencies are region numbers within the LOD; the block ranges are the same in every LOD.
+    Array<Skinning_Region> skinning_regions;
+    Array<u64>             skinning_region_joints;       // Joints moving any vertex of the region's triangles.
+    Array<u64>             skinning_region_dependencies; // Regions holding the vertices of the region's triangles.
+    Array<u32>             skinning_region_indices;      // `indices`, grouped by LOD then owner region.
+    s32                    skinning_region_mask_words;
+    
+    // Rest pose bounds of the vertices each joint influences.
+    Array<Rect3> joint_influence_bounds;
     
     // Bounds of the mesh, computed at mesh load time, in local space.
     Rect3 bounding_box;
@@ -148,7 +218,66 @@ struct Triangle_Mesh
     ID3D11Buffer *vbo;
     ID3D11Buffer *ibo;
     
+    // The vertex buffer contents, packed by cook_mesh().
+    Vertex_XTBNUCJW *packed_vertices;
+    
+    // When the mesh was loaded from a cooked mesh, its arrays point into this mapping (don't grow them).
+    String8          cooked;
+    
     u32 flags;
 };
 
+// @Note: Cooked meshes (.cooked_mesh files next to the .mesh ones, see cooked.h) hold everything 
+// cook_mesh() computes. Meshes with a cooked mesh that's up to date are mapped; the others are loaded 
+// from the .mesh, cooked and written for next time.
+#define MESH_COOKED_MAGIC 0x4853454D // "MESH"
+GLOBAL s32 const MESH_COOKED_VERSION = 7;
+
+enum Mesh_Section
+{
+    MeshSection_INFO,                         // Mesh_Cooked_Info, one.
+    MeshSection_VERTEX_BUFFER,                // Vertex_XTBNUCJW
+    MeshSection_POSITIONS,                    // V3
+    MeshSection_TBNS,                         // TBN
+    MeshSection_UVS,                          // V2
+    MeshSection_COLORS,                       // V4
+    MeshSection_CANONICAL_VERTEX_MAP,         // s32
+    MeshSection_INDICES,                      // u32
+    MeshSection_TRIANGLE_LISTS,               // Triangle_List_Info, texture maps are null.
+    MeshSection_LODS,                         // Mesh_LOD
+    MeshSection_LOD_LISTS,                    // Mesh_LOD_List
+    MeshSection_MATERIALS,                    // Material_Info
+    MeshSection_JOINTS,                       // Skeleton_Joint_Info
+    MeshSection_BLEND_INFO,                   // Vertex_Blend_Info
+    MeshSection_SKINNING_BUCKETS,             // Skinning_Bucket, MAX_JOINTS_PER_VERTEX of them.
+    MeshSection_SKINNING_REGIONS,             // Skinning_Region
+    MeshSection_SKINNING_REGION_JOINTS,       // u64
+    MeshSection_SKINNING_REGION_DEPENDENCIES, // u64
+    MeshSection_SKINNING_REGION_INDICES,      // u32
+    MeshSection_JOINT_INFLUENCE_BOUNDS,       // Rect3
+    
+    MeshSection_COUNT
+};
+
+struct Mesh_Cooked_Info
+{
+    u32   flags; // Mesh_Flags
+    s32   skinning_region_mask_words;
+    Rect3 bounding_box;
+};
+
+GLOBAL u32 const MESH_SECTION_ELEMENT_SIZES[MeshSection_COUNT] = 
+{
+    sizeof(Mesh_Cooked_Info), sizeof(Vertex_XTBNUCJW), sizeof(V3), sizeof(TBN), sizeof(V2), sizeof(V4), sizeof(s32), 
+    sizeof(u32), sizeof(Triangle_List_Info), sizeof(Mesh_LOD), sizeof(Mesh_LOD_List), sizeof(Material_Info), 
+    sizeof(Skeleton_Joint_Info), sizeof(Vertex_Blend_Info), sizeof(Skinning_Bucket), sizeof(Skinning_Region), sizeof(u64), 
+    sizeof(u64), sizeof(u32), sizeof(Rect3),
+};
+
+GLOBAL Cooked_File_Kind const MESH_COOKED_FILE = 
+{
+    MESH_COOKED_MAGIC, MESH_COOKED_VERSION, MeshSection_COUNT, MESH_SECTION_ELEMENT_SIZES, 
+    (MAX_JOINTS_PER_VERTEX << 8) | SKINNING_BLOCK_SIZE, "mesh",
+};
+
 #endif //MESH_H
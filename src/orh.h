@@ -1,4 +1,4 @@
-/* orh.h - v0.91 - C++ utility library. Includes types, math, string, memory arena, and other stuff.
+/* orh.h - v0.92 - C++ utility library. Includes types, math, string, memory arena, and other stuff.
 
 In _one_ C++ file, #define ORH_IMPLEMENTATION before including this header to create the
  implementation. 
@@ -9,6 +9,7 @@ Like this:
 #include "orh.h"
 
 REVISION HISTORY:
+0.92 - added M3x4 type for affine transforms (implicit last row of 0, 0, 0, 1) and its helpers.
 0.91 - fixed array arena reserving too much virtual memory issue.
 0.90 - added frame vs. tick dt and time. Added V3_INF. Added abs() for V2 and V3. added sign(). added get_row() and get_column() for M3x3.
 0.89 - added str8_contains(). Fixed quaternion_from_euler(). Added equal() for nearly equal comparison. Added rotate_towards().
@@ -625,6 +626,23 @@ union M4x4
     };
 };
 
+union M3x4
+{
+    // @Note: Affine transform stored without the last row, which is always (0, 0, 0, 1).
+    // Same layout as the first three rows of M4x4 (row-major with column vectors).
+    
+    f32 II [3][4];
+    f32 I    [12];
+    V4  row   [3];
+    struct
+    {
+        // First index is row.
+        f32 _11, _12, _13, _14;
+        f32 _21, _22, _23, _24;
+        f32 _31, _32, _33, _34;
+    };
+};
+
 struct M4x4_Inverse
 {
     M4x4 forward;
@@ -835,6 +853,14 @@ FUNCDEF inline V4   transform(M4x4 const &m, V4 v);
 FUNCDEF inline V3   transform_point(M4x4 const &m, V3 p);
 FUNCDEF inline V3   transform_vector(M4x4 const &m, V3 v);
 
+FUNCDEF inline M3x4 m3x4_identity();
+FUNCDEF inline M3x4 m3x4(M4x4 const &affine);
+FUNCDEF inline M4x4 m4x4(M3x4 const &affine);
+FUNCDEF inline M3x4 m3x4_from_translation_rotation_scale(V3 t, Quaternion r, V3 s);
+FUNCDEF inline V3   get_translation(M3x4 const &affine);
+FUNCDEF inline V3   transform_point(M3x4 const &affine, V3 p);
+FUNCDEF inline V3   transform_vector(M3x4 const &affine, V3 v);
+
 
 // Linear interpolation. Returns value between a and b based on fraction t.
 FUNCDEF inline f32 lerp(f32 a, f32 t, f32 b);
@@ -1272,6 +1298,16 @@ inline M4x4 operator*(M4x4 a, M4x4 b)
             {result.II[r][c] += a.II[r][i] * b.II[i][c];}}}
     return result;
 }
+inline M3x4 operator*(M3x4 a, M3x4 b)
+{
+    // @Note: Affine multiply, the implicit last rows are (0, 0, 0, 1). 36 multiplies instead of 64.
+    M3x4 result;
+    for(s32 r = 0; r < 3; r++)
+    {for(s32 c = 0; c < 4; c++)
+        {result.II[r][c] = a.II[r][0] * b.II[0][c] + a.II[r][1] * b.II[1][c] + a.II[r][2] * b.II[2][c];}
+        result.II[r][3] += a.II[r][3];}
+    return result;
+}
 
 #if COMPILER_GCC
 #    pragma GCC diagnostic pop
@@ -2138,7 +2174,11 @@ struct OS_State
     b32        (*commit)  (void *memory, u64 size);
     void       (*decommit)(void *memory, u64 size);
     String8    (*read_entire_file)(String8 full_path);
+    u64        (*read_file_range)(String8 full_path, u64 offset, void *dest, u64 size); // Returns bytes read. Safe to call from any thread.
     b32        (*write_entire_file)(String8 full_path, String8 data);
+    b32        (*write_file_range)(String8 full_path, u64 offset, String8 data); // Overwrites part of an existing file.
+    String8    (*map_file)(String8 full_path); // Copy-on-write view; writing to it never changes the file.
+    void       (*unmap_file)(void *memory);
     void       (*free_file_memory)(void *memory);  // @Redundant: Does same thing as release().
     File_Group (*get_all_files_in_path)(Arena *arena, String8 path_wildcard);
     Sound      (*sound_load)(String8 full_path, u32 sample_rate);
@@ -3551,6 +3591,66 @@ FUNCDEF inline V3 transform_vector(M4x4 const &m, V3 v)
     return result;
 }
 
+FUNCDEF inline M3x4 m3x4_identity()
+{
+    M3x4 result = 
+    {
+        1.0f, 0.0f, 0.0f, 0.0f,
+        0.0f, 1.0f, 0.0f, 0.0f,
+        0.0f, 0.0f, 1.0f, 0.0f,
+    };
+    return result;
+}
+FUNCDEF inline M3x4 m3x4(M4x4 const &affine)
+{
+    M3x4 result;
+    result.row[0] = affine.row[0];
+    result.row[1] = affine.row[1];
+    result.row[2] = affine.row[2];
+    return result;
+}
+FUNCDEF inline M4x4 m4x4(M3x4 const &affine)
+{
+    M4x4 result   = m4x4_identity();
+    result.row[0] = affine.row[0];
+    result.row[1] = affine.row[1];
+    result.row[2] = affine.row[2];
+    return result;
+}
+FUNCDEF inline M3x4 m3x4_from_translation_rotation_scale(V3 t, Quaternion r, V3 s)
+{
+    // @Note: Same as m4x4_from_translation_rotation_scale() minus the last row.
+    
+    M3x3 rot = m3x3_from_quaternion(r);
+    
+    M3x4 result;
+    result.row[0] = v4(rot.row[0] * s, t.x);
+    result.row[1] = v4(rot.row[1] * s, t.y);
+    result.row[2] = v4(rot.row[2] * s, t.z);
+    return result;
+}
+FUNCDEF inline V3 get_translation(M3x4 const &affine)
+{
+    V3 result = {affine._14, affine._24, affine._34};
+    return result;
+}
+FUNCDEF inline V3 transform_point(M3x4 const &affine, V3 p)
+{
+    V3 result;
+    result.x = affine._11*p.x + affine._12*p.y + affine._13*p.z + affine._14;
+    result.y = affine._21*p.x + affine._22*p.y + affine._23*p.z + affine._24;
+    result.z = affine._31*p.x + affine._32*p.y + affine._33*p.z + affine._34;
+    return result;
+}
+FUNCDEF inline V3 transform_vector(M3x4 const &affine, V3 v)
+{
+    V3 result;
+    result.x = affine._11*v.x + affine._12*v.y + affine._13*v.z;
+    result.y = affine._21*v.x + affine._22*v.y + affine._23*v.z;
+    result.z = affine._31*v.x + affine._32*v.y + affine._33*v.z;
+    return result;
+}
+
 FUNCDEF inline f32 lerp(f32 a, f32 t, f32 b) 
 {
     f32 result = a*(1.0f - t) + b*t; 
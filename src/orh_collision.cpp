@@ -432,7 +432,10 @@ FUNCTION b32 segment_triangle_intersect(V3 const &a, V3 const &b,
     
     // t here already represents percent (instead of a distance from segment origin along direction).
     f32 percent = t;
-    if ((u < 0.0f) || (v < 0.0f) || ((u+v) > 1.0f) || (percent < 0.0f) || (percent > 1.0f)) {
+    
+    // @Note: One branch instead of five; which test rejects a triangle is hard to predict when the 
+    // triangles come in vertex cache order (fans), and almost all of them get rejected.
+    if ((u < 0.0f) | (v < 0.0f) | ((u+v) > 1.0f) | (percent < 0.0f) | (percent > 1.0f)) {
         // Also ignore intersections that are behind a and ahead of b.
         if (barycentric_out) *barycentric_out = {-1.0f, -1.0f, -1.0f};
         return FALSE;
@@ -525,11 +528,8 @@ struct Collision_Shape
             V3 half_extents;
         }; // Box
         
-        struct
-        {
-            f32 radius;
-        }; // Sphere
-        
+        // @Note: Spheres only use radius. It's one struct because only MSVC accepts the same member in
+        // two anonymous structs.
         struct
         {
             f32 radius;
@@ -537,7 +537,7 @@ struct Collision_Shape
             // Distance (in local-space) from the center of the capsule to the tip of the capsule.
             // (half_height - radius) gives you the "half axis height" that you can use to calculate the center of the upper and lower spheres/caps,
             f32 half_height;
-        }; // Capsule
+        }; // Sphere and capsule
     };
     
     Collision_Shape_Type type;
@@ -0,0 +1,398 @@
+/* orh_jobs.cpp - v0.00 - small work-stealing job system for data-parallel loops.
+
+REVISION HISTORY:
+
+
+@Note: There is one pool of worker threads, started by jobs_init(). parallel_for() splits [0, count)
+evenly between the workers and the calling thread. Each thread eats its own range from the front in
+batches; when it runs out, it steals the back half of whichever range has the most work left.
+A range is packed into 64 bits so the owner and thieves can both update it with one compare-exchange.
+
+jobs_init() also starts one background thread for work nobody waits on, like reading files. 
+push_background_job() queues a job on it and returns right away; jobs run one at a time, in order.
+
+Scratch arenas are thread-local, so jobs can use get_scratch() like everybody else. Anything else
+the jobs share is the caller's problem.
+
+*/
+
+#include "orh.h"
+
+#if OS_WINDOWS
+#include <windows.h>
+#include <intrin.h>
+#else
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <x86intrin.h>
+#endif
+
+#define JOBS_MAX_THREADS      64
+#define BACKGROUND_JOBS_MAX 1024
+
+typedef void Parallel_For_Proc(void *data, s32 first, s32 one_past_last);
+typedef void Background_Job_Proc(void *data);
+
+//~ Platform
+//
+#if OS_WINDOWS
+typedef HANDLE Job_Semaphore;
+
+FUNCTION inline s64 atomic_compare_exchange_s64(s64 volatile *dst, s64 exchange, s64 comparand)
+{
+    return InterlockedCompareExchange64((LONG64 volatile *)dst, exchange, comparand);
+}
+FUNCTION inline s64 atomic_exchange_s64(s64 volatile *dst, s64 value)
+{
+    return InterlockedExchange64((LONG64 volatile *)dst, value);
+}
+FUNCTION inline s32 atomic_add_s32(s32 volatile *dst, s32 value)
+{
+    // Returns the new value.
+    return InterlockedAdd((LONG volatile *)dst, value);
+}
+FUNCTION inline s32 atomic_exchange_s32(s32 volatile *dst, s32 value)
+{
+    return InterlockedExchange((LONG volatile *)dst, value);
+}
+
+FUNCTION void semaphore_init(Job_Semaphore *sem)
+{
+    *sem = CreateSemaphoreA(0, 0, JOBS_MAX_THREADS*1024, 0);
+    ASSERT(*sem);
+}
+FUNCTION void semaphore_wait(Job_Semaphore *sem)
+{
+    WaitForSingleObjectEx(*sem, INFINITE, FALSE);
+}
+FUNCTION void semaphore_signal(Job_Semaphore *sem, s32 count)
+{
+    ReleaseSemaphore(*sem, count, 0);
+}
+
+FUNCTION s32 get_num_logical_processors()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (s32)info.dwNumberOfProcessors;
+}
+#else
+typedef sem_t Job_Semaphore;
+
+FUNCTION inline s64 atomic_compare_exchange_s64(s64 volatile *dst, s64 exchange, s64 comparand)
+{
+    return __sync_val_compare_and_swap(dst, comparand, exchange);
+}
+FUNCTION inline s64 atomic_exchange_s64(s64 volatile *dst, s64 value)
+{
+    return __atomic_exchange_n(dst, value, __ATOMIC_SEQ_CST);
+}
+FUNCTION inline s32 atomic_add_s32(s32 volatile *dst, s32 value)
+{
+    // Returns the new value.
+    return __sync_add_and_fetch(dst, value);
+}
+FUNCTION inline s32 atomic_exchange_s32(s32 volatile *dst, s32 value)
+{
+    return __atomic_exchange_n(dst, value, __ATOMIC_SEQ_CST);
+}
+
+FUNCTION void semaphore_init(Job_Semaphore *sem)
+{
+    sem_init(sem, 0, 0);
+}
+FUNCTION void semaphore_wait(Job_Semaphore *sem)
+{
+    while (sem_wait(sem) != 0) {}
+}
+FUNCTION void semaphore_signal(Job_Semaphore *sem, s32 count)
+{
+    for (s32 i = 0; i < count; i++)
+        sem_post(sem);
+}
+
+FUNCTION s32 get_num_logical_processors()
+{
+    return (s32)sysconf(_SC_NPROCESSORS_ONLN);
+}
+#endif
+
+//~ Job System
+//
+struct Job_Range
+{
+    // (one_past_last << 32) | first. Empty when first >= one_past_last.
+    s64 volatile packed;
+    
+    // Keep each range on its own cache line, owners hammer on them.
+    u8 padding[64 - sizeof(s64)];
+};
+
+struct Job_System
+{
+    Job_Range ranges[JOBS_MAX_THREADS];
+    s32       num_threads; // Including the thread that calls parallel_for().
+    
+    Job_Semaphore work_semaphore;
+    
+    // The parallel_for() in flight.
+    Parallel_For_Proc *proc;
+    void              *data;
+    s32                batch_size;
+    s32 volatile       items_remaining;
+};
+
+GLOBAL Job_System jobs;
+
+threadvar b32 inside_parallel_for;
+
+FUNCTION inline s64 pack_job_range(s32 first, s32 one_past_last)
+{
+    return ((s64)(u32)one_past_last << 32) | (s64)(u32)first;
+}
+FUNCTION inline void unpack_job_range(s64 packed, s32 *first, s32 *one_past_last)
+{
+    *first         = (s32)(u32)(packed & 0xFFFFFFFF);
+    *one_past_last = (s32)(u32)((u64)packed >> 32);
+}
+
+FUNCTION b32 claim_job_batch(Job_Range *range, s32 batch_size, s32 *first_out, s32 *one_past_last_out)
+{
+    // Owner side: take up to batch_size items from the front.
+    for (;;) {
+        s64 old = range->packed;
+        s32 first, one_past_last;
+        unpack_job_range(old, &first, &one_past_last);
+        if (first >= one_past_last) return FALSE;
+        
+        s32 end = MIN(first + batch_size, one_past_last);
+        if (atomic_compare_exchange_s64(&range->packed, pack_job_range(end, one_past_last), old) == old) {
+            *first_out         = first;
+            *one_past_last_out = end;
+            return TRUE;
+        }
+    }
+}
+
+FUNCTION b32 steal_job_range(s32 thief_index, s32 *first_out, s32 *one_past_last_out)
+{
+    // Thief side: take the back half of the range with the most work left.
+    for (;;) {
+        s32 victim_index  = -1;
+        s32 most_left     = 0;
+        s64 victim_packed = 0;
+        for (s32 i = 0; i < jobs.num_threads; i++) {
+            if (i == thief_index) continue;
+            
+            s64 packed = jobs.ranges[i].packed;
+            s32 first, one_past_last;
+            unpack_job_range(packed, &first, &one_past_last);
+            if ((one_past_last - first) > most_left) {
+                most_left     = one_past_last - first;
+                victim_index  = i;
+                victim_packed = packed;
+            }
+        }
+        
+        if (victim_index < 0) return FALSE;
+        
+        s32 first, one_past_last;
+        unpack_job_range(victim_packed, &first, &one_past_last);
+        s32 split = one_past_last - (most_left - most_left/2);
+        
+        Job_Range *victim = &jobs.ranges[victim_index];
+        if (atomic_compare_exchange_s64(&victim->packed, pack_job_range(first, split), victim_packed) == victim_packed) {
+            *first_out         = split;
+            *one_past_last_out = one_past_last;
+            return TRUE;
+        }
+    }
+}
+
+FUNCTION void run_job_items(s32 first, s32 one_past_last)
+{
+    jobs.proc(jobs.data, first, one_past_last);
+    atomic_add_s32(&jobs.items_remaining, -(one_past_last - first));
+}
+
+FUNCTION void do_jobs(s32 thread_index)
+{
+    Job_Range *own = &jobs.ranges[thread_index];
+    
+    for (;;) {
+        s32 first, one_past_last;
+        while (claim_job_batch(own, jobs.batch_size, &first, &one_past_last))
+            run_job_items(first, one_past_last);
+        
+        if (!steal_job_range(thread_index, &first, &one_past_last))
+            break;
+        
+        // Our own range is empty, so others can steal from the stolen range once we put it there.
+        // If our slot isn't empty anymore (a new parallel_for() started), just eat the stolen range ourselves.
+        s64 empty = own->packed;
+        s32 own_first, own_one_past_last;
+        unpack_job_range(empty, &own_first, &own_one_past_last);
+        if ((own_first < own_one_past_last) ||
+            (atomic_compare_exchange_s64(&own->packed, pack_job_range(first, one_past_last), empty) != empty)) {
+            while (first < one_past_last) {
+                s32 end = MIN(first + jobs.batch_size, one_past_last);
+                run_job_items(first, end);
+                first = end;
+            }
+        }
+    }
+}
+
+#if OS_WINDOWS
+FUNCTION DWORD WINAPI job_worker_proc(LPVOID param)
+#else
+FUNCTION void* job_worker_proc(void *param)
+#endif
+{
+    s32 thread_index = (s32)(umm)param;
+    for (;;) {
+        semaphore_wait(&jobs.work_semaphore);
+        do_jobs(thread_index);
+    }
+}
+
+//~ Background Jobs
+//
+struct Background_Job
+{
+    Background_Job_Proc *proc;
+    void                *data;
+};
+
+struct Background_Job_Queue
+{
+    // Ring buffer with one producer (the main thread) and one consumer (the background thread). Each
+    // side only moves its own index.
+    Background_Job jobs[BACKGROUND_JOBS_MAX];
+    s32 volatile   write_index;
+    s32 volatile   read_index;
+    
+    Job_Semaphore  semaphore; // One signal per job pushed.
+    b32            running;
+};
+
+GLOBAL Background_Job_Queue background_jobs;
+
+#if OS_WINDOWS
+FUNCTION DWORD WINAPI background_worker_proc(LPVOID)
+#else
+FUNCTION void* background_worker_proc(void *)
+#endif
+{
+    for (;;) {
+        semaphore_wait(&background_jobs.semaphore);
+        
+        Background_Job job = background_jobs.jobs[background_jobs.read_index % BACKGROUND_JOBS_MAX];
+        job.proc(job.data);
+        atomic_add_s32(&background_jobs.read_index, 1);
+    }
+}
+
+FUNCTION b32 push_background_job(Background_Job_Proc *proc, void *data)
+{
+    // @Note: Main thread only. Returns FALSE if the queue is full, try again later. Before jobs_init()
+    // the job just runs right here.
+    
+    if (!background_jobs.running) {
+        proc(data);
+        return TRUE;
+    }
+    
+    s32 write_index = background_jobs.write_index;
+    if ((write_index - background_jobs.read_index) >= BACKGROUND_JOBS_MAX)
+        return FALSE;
+    
+    Background_Job *job = &background_jobs.jobs[write_index % BACKGROUND_JOBS_MAX];
+    job->proc           = proc;
+    job->data           = data;
+    
+    // The atomic add is a full barrier, so the job is written before the background thread can see it.
+    atomic_add_s32(&background_jobs.write_index, 1);
+    semaphore_signal(&background_jobs.semaphore, 1);
+    return TRUE;
+}
+
+FUNCTION void jobs_init(s32 num_threads = 0)
+{
+    // @Note: num_threads includes the main thread. Pass 0 to use one thread per logical processor.
+    
+    if (num_threads <= 0)
+        num_threads = get_num_logical_processors();
+    num_threads = CLAMP(1, num_threads, JOBS_MAX_THREADS);
+    
+    jobs.num_threads = num_threads;
+    semaphore_init(&jobs.work_semaphore);
+    
+    for (s32 i = 1; i < num_threads; i++) {
+#if OS_WINDOWS
+        HANDLE thread = CreateThread(0, 0, job_worker_proc, (LPVOID)(umm)i, 0, 0);
+        ASSERT(thread);
+        CloseHandle(thread);
+#else
+        pthread_t thread;
+        pthread_create(&thread, 0, job_worker_proc, (void *)(umm)i);
+        pthread_detach(thread);
+#endif
+    }
+    
+    semaphore_init(&background_jobs.semaphore);
+#if OS_WINDOWS
+    HANDLE thread = CreateThread(0, 0, background_worker_proc, 0, 0, 0);
+    ASSERT(thread);
+    CloseHandle(thread);
+#else
+    pthread_t thread;
+    pthread_create(&thread, 0, background_worker_proc, 0);
+    pthread_detach(thread);
+#endif
+    background_jobs.running = TRUE;
+}
+
+FUNCTION s32 get_num_job_threads()
+{
+    return MAX(jobs.num_threads, 1);
+}
+
+FUNCTION void parallel_for(s32 count, s32 batch_size, Parallel_For_Proc *proc, void *data)
+{
+    // @Note: Calls proc(data, first, one_past_last) over [0, count) on all job threads and returns
+    // when every item is done. Nested calls (and calls before jobs_init()) just run serially.
+    
+    if (count <= 0) return;
+    batch_size = MAX(batch_size, 1);
+    
+    if ((jobs.num_threads <= 1) || (count <= batch_size) || inside_parallel_for) {
+        proc(data, 0, count);
+        return;
+    }
+    
+    inside_parallel_for = TRUE;
+    
+    jobs.proc       = proc;
+    jobs.data       = data;
+    jobs.batch_size = batch_size;
+    
+    // Split the work evenly; stealing takes care of the imbalance.
+    s32 num_threads = jobs.num_threads;
+    atomic_add_s32(&jobs.items_remaining, count);
+    for (s32 i = 0; i < num_threads; i++) {
+        s32 first         = (s32)(((s64)count *  i)      / num_threads);
+        s32 one_past_last = (s32)(((s64)count * (i + 1)) / num_threads);
+        atomic_exchange_s64(&jobs.ranges[i].packed, pack_job_range(first, one_past_last));
+    }
+    
+    semaphore_signal(&jobs.work_semaphore, num_threads - 1);
+    do_jobs(0);
+    
+    // Whatever is left is already being run by other threads.
+    while (jobs.items_remaining > 0)
+        _mm_pause();
+    
+    inside_parallel_for = FALSE;
+}
@@ -2,62 +2,8 @@
 
 */
 
-struct Vertex_XTBNUCJW
-{
-    V3 position;
-    V3 tangent;
-    V3 bitangent;
-    V3 normal;
-    V2 uv;
-    V4 color;
-    
-    // V4 because MAX_JOINTS_PER_VERTEX is 4.
-    V4s joint_ids;
-    V4  weights;
-};
+#include "shaders/skeletal_mesh_pbr.h"
 
-#define MAX_JOINTS 65
-#define VSConstantsFlags_SHOULD_SKIN 0x1
-struct PBR_VS_Constants
-{
-    M4x4 skinning_matrices[MAX_JOINTS];
-    M4x4 object_to_proj_matrix;
-    M4x4 object_to_world_matrix;
-    u32  flags;
-};
-#define MAX_POINT_LIGHTS 5
-#define MAX_DIR_LIGHTS   2
-struct Point_Light
-{
-    V3  position;  // In world space
-    f32 intensity; // Unitless
-    V3  color;
-    f32 range;	 // In world space units
-};
-struct Directional_Light
-{
-    V3  direction; // In world space
-    f32 intensity; // Unitless
-    V3  color;
-    f32 indirect_lighting_intensity; // Unitless @Incomplete: Is this used? 
-};
-struct PBR_PS_Constants
-{
-    // @Note: HLSL cbuffers pack everything in 16 bytes (Vector4), so we order stuff this way... yikes.
-    Point_Light       point_lights[MAX_POINT_LIGHTS];
-	Directional_Light dir_lights[MAX_DIR_LIGHTS];
-    
-    V3  camera_position; // In world space
-    b32 use_normal_map;
-    
-	V3  base_color;
-    f32 metallic;
-	f32 roughness;
-    f32 ambient_occlusion;
-    
-    s32 num_point_lights;
-    s32 num_dir_lights;
-};
 GLOBAL ID3D11InputLayout  *pbr_input_layout;
 GLOBAL ID3D11Buffer       *pbr_vs_cbuffer;
 GLOBAL ID3D11Buffer       *pbr_ps_cbuffer;
@@ -70,13 +16,11 @@ FUNCTION void skeletal_mesh_pbr_create_shader()
     D3D11_INPUT_ELEMENT_DESC layout_desc[] = 
     {
         {"POSITION",  0, DXGI_FORMAT_R32G32B32_FLOAT,    0, offsetof(Vertex_XTBNUCJW, position),  D3D11_INPUT_PER_VERTEX_DATA, 0},
-        {"TANGENT",   0, DXGI_FORMAT_R32G32B32_FLOAT,    0, offsetof(Vertex_XTBNUCJW, tangent),   D3D11_INPUT_PER_VERTEX_DATA, 0},
-        {"BITANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT,    0, offsetof(Vertex_XTBNUCJW, bitangent), D3D11_INPUT_PER_VERTEX_DATA, 0},
-        {"NORMAL",    0, DXGI_FORMAT_R32G32B32_FLOAT,    0, offsetof(Vertex_XTBNUCJW, normal),    D3D11_INPUT_PER_VERTEX_DATA, 0},
-        {"TEXCOORD",  0, DXGI_FORMAT_R32G32_FLOAT,       0, offsetof(Vertex_XTBNUCJW, uv),        D3D11_INPUT_PER_VERTEX_DATA, 0},
-        {"COLOR",     0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, offsetof(Vertex_XTBNUCJW, color),     D3D11_INPUT_PER_VERTEX_DATA, 0},
-        {"JOINT_IDS", 0, DXGI_FORMAT_R32G32B32A32_SINT,  0, offsetof(Vertex_XTBNUCJW, joint_ids),     D3D11_INPUT_PER_VERTEX_DATA, 0},
-        {"WEIGHTS",   0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, offsetof(Vertex_XTBNUCJW, weights),     D3D11_INPUT_PER_VERTEX_DATA, 0},
+        {"TBN",       0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, offsetof(Vertex_XTBNUCJW, tbn),       D3D11_INPUT_PER_VERTEX_DATA, 0},
+        {"TEXCOORD",  0, VERTEX_HALF_UVS? DXGI_FORMAT_R16G16_FLOAT : DXGI_FORMAT_R32G32_FLOAT, 0, offsetof(Vertex_XTBNUCJW, uv), D3D11_INPUT_PER_VERTEX_DATA, 0},
+        {"COLOR",     0, DXGI_FORMAT_R8G8B8A8_UNORM,     0, offsetof(Vertex_XTBNUCJW, color),     D3D11_INPUT_PER_VERTEX_DATA, 0},
+        {"JOINT_IDS", 0, DXGI_FORMAT_R8G8B8A8_UINT,      0, offsetof(Vertex_XTBNUCJW, joint_ids), D3D11_INPUT_PER_VERTEX_DATA, 0},
+        {"WEIGHTS",   0, DXGI_FORMAT_R8G8B8A8_UNORM,     0, offsetof(Vertex_XTBNUCJW, weights),   D3D11_INPUT_PER_VERTEX_DATA, 0},
     };
     
     //
@@ -0,0 +1,82 @@
+#ifndef SKELETAL_MESH_PBR_H
+#define SKELETAL_MESH_PBR_H
+
+// @Note: The CPU side types of the shader, separate from the D3D code so that tools that don't render
+// (the asset cooker) can use the vertex format.
+
+// Half float UVs save 4 more bytes per vertex, but near 1 they're only good to about a texel of a 2k 
+// texture, and worse for UVs that tile.
+#ifndef VERTEX_HALF_UVS
+#define VERTEX_HALF_UVS 0
+#endif
+
+// Unused influences; weights of those are 0.
+#define VERTEX_NO_JOINT 0xFF
+
+// @Note: Packed to 40 bytes (36 with half UVs), down from 104 with all floats. See pack_vertices() in 
+// mesh.cpp for the encoding and unpack_vertex_*() for the CPU decoders; the vertex shader decodes the same.
+struct Vertex_XTBNUCJW
+{
+    V3  position;
+    
+    // Unit quaternion that rotates X, Y and Z to the tangent, bitangent and normal, snorm16. Its w is
+    // never 0 and its sign is the handedness of the bitangent.
+    s16 tbn[4];
+    
+#if VERTEX_HALF_UVS
+    u16 uv[2];
+#else
+    V2  uv;
+#endif
+    u8  color[4];     // unorm8
+    
+    // 4 because MAX_JOINTS_PER_VERTEX is 4.
+    u8  joint_ids[4];
+    u8  weights[4];   // unorm8, they add up to 255.
+};
+
+#define MAX_JOINTS 65
+STATIC_ASSERT(MAX_JOINTS < VERTEX_NO_JOINT, joint_ids_fit_in_u8);
+#define VSConstantsFlags_SHOULD_SKIN 0x1
+struct PBR_VS_Constants
+{
+    M3x4 skinning_matrices[MAX_JOINTS]; // Affine, so we skip the last row.
+    M4x4 object_to_proj_matrix;
+    M4x4 object_to_world_matrix;
+    u32  flags;
+};
+#define MAX_POINT_LIGHTS 5
+#define MAX_DIR_LIGHTS   2
+struct Point_Light
+{
+    V3  position;  // In world space
+    f32 intensity; // Unitless
+    V3  color;
+    f32 range;	 // In world space units
+};
+struct Directional_Light
+{
+    V3  direction; // In world space
+    f32 intensity; // Unitless
+    V3  color;
+    f32 indirect_lighting_intensity; // Unitless @Incomplete: Is this used? 
+};
+struct PBR_PS_Constants
+{
+    // @Note: HLSL cbuffers pack everything in 16 bytes (Vector4), so we order stuff this way... yikes.
+    Point_Light       point_lights[MAX_POINT_LIGHTS];
+	Directional_Light dir_lights[MAX_DIR_LIGHTS];
+    
+    V3  camera_position; // In world space
+    b32 use_normal_map;
+    
+	V3  base_color;
+    f32 metallic;
+	f32 roughness;
+    f32 ambient_occlusion;
+    
+    s32 num_point_lights;
+    s32 num_dir_lights;
+};
+
+#endif //SKELETAL_MESH_PBR_H
@@ -3,14 +3,12 @@ R"(
 struct VS_Input
 {
 	float3 position  : POSITION;
-	float3 tangent   : TANGENT;
-	float3 bitangent : BITANGENT;
-	float3 normal    : NORMAL;
+	float4 tbn       : TBN;       // Quaternion, see Vertex_XTBNUCJW.
 	float2 uv        : TEXCOORD;
 	float4 color     : COLOR;
 
-	// V4 because MAX_JOINTS_PER_VERTEX is 4.
-    int4   joint_ids : JOINT_IDS;
+	// 4 because MAX_JOINTS_PER_VERTEX is 4.
+    uint4  joint_ids : JOINT_IDS;
     float4 weights   : WEIGHTS;
 };
 
@@ -25,10 +23,11 @@ struct PS_Input
 
 #define MAX_JOINTS_PER_VERTEX 4
 #define MAX_JOINTS 65
+#define VERTEX_NO_JOINT 0xFF
 #define VSConstantsFlags_SHOULD_SKIN 0x1
 cbuffer VS_Constants : register(b0)
 {
-	float4x4 skinning_matrices[MAX_JOINTS];
+	float3x4 skinning_matrices[MAX_JOINTS]; // Affine, so we skip the last row.
 	float4x4 object_to_proj_matrix;
 	float4x4 object_to_world_matrix;
 	uint flags;
@@ -78,37 +77,50 @@ Texture2D<float4> ao_map         : register(t4);
 
 PS_Input vs(VS_Input input)
 {
+	//
+	// Unpack the tangent frame; same as unpack_vertex_tbn().
+	//
+	float4 q = normalize(input.tbn);
+	float3 tangent   = float3(1.0f - 2.0f*(q.y*q.y + q.z*q.z), 2.0f*(q.x*q.y + q.w*q.z), 2.0f*(q.x*q.z - q.w*q.y));
+	float3 bitangent = float3(2.0f*(q.x*q.y - q.w*q.z), 1.0f - 2.0f*(q.x*q.x + q.z*q.z), 2.0f*(q.y*q.z + q.w*q.x));
+	float3 normal    = float3(2.0f*(q.x*q.z + q.w*q.y), 2.0f*(q.y*q.z - q.w*q.x), 1.0f - 2.0f*(q.x*q.x + q.y*q.y));
+	if (q.w < 0.0f)
+		bitangent = -bitangent;
+
 	//
 	// Skin the input vertex and normal if required.
 	//
 	float4 pos;
 	float4 nor;
 	if (flags & VSConstantsFlags_SHOULD_SKIN) {
-		pos = float4(0,0,0,0);
-		nor = float4(0,0,0,0);
+		float3 p = float3(0,0,0);
+		float3 n = float3(0,0,0);
+		float  w = 0.0f;
 		
 		for (int piece_index = 0; piece_index < MAX_JOINTS_PER_VERTEX; piece_index++) {
-			int joint_id = input.joint_ids[piece_index];
-			if (joint_id == -1) continue;
+			uint joint_id = input.joint_ids[piece_index];
+			if (joint_id == VERTEX_NO_JOINT) continue;
 			if (joint_id >= MAX_JOINTS) {
-				pos = float4(input.position, 1.0f);
-				nor = float4(input.normal,   0.0f);
+				p = input.position;
+				n = normal;
+				w = 1.0f;
 				break;
 			}
 			
-			float4x4 m = skinning_matrices[joint_id];
-			pos       += mul(m, float4(input.position, 1.0f)) * input.weights[piece_index];
-			nor       += mul(m, float4(input.normal,   0.0f)) * input.weights[piece_index];
+			float3x4 m = skinning_matrices[joint_id];
+			p         += mul(m, float4(input.position, 1.0f)) * input.weights[piece_index];
+			n         += mul(m, float4(normal,         0.0f)) * input.weights[piece_index];
+			w         += input.weights[piece_index];
 		}
 
-		if (pos.w)
-			pos.xyz /= pos.w;
+		if (w)
+			p /= w;
 
-		pos.w = 1.0f;
-		nor.w = 0.0f;
+		pos = float4(p, 1.0f);
+		nor = float4(n, 0.0f);
 	} else {
 		pos = float4(input.position, 1.0f);
-		nor = float4(input.normal,   0.0f);
+		nor = float4(normal,         0.0f);
 	}
 
 	//
@@ -116,8 +128,8 @@ PS_Input vs(VS_Input input)
 	//
 	float3 pos_world = mul(object_to_world_matrix, pos).xyz;
 
-	float3 t = normalize(mul(object_to_world_matrix, float4(input.tangent,   0.0f)).xyz);
-	float3 b = normalize(mul(object_to_world_matrix, float4(input.bitangent, 0.0f)).xyz);
+	float3 t = normalize(mul(object_to_world_matrix, float4(tangent,   0.0f)).xyz);
+	float3 b = normalize(mul(object_to_world_matrix, float4(bitangent, 0.0f)).xyz);
 	float3 n = normalize(mul(object_to_world_matrix, nor                          ).xyz);
 
 	PS_Input output;
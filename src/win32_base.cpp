@@ -323,6 +323,74 @@ FUNCTION String8 win32_read_entire_file(String8 full_path)
     return result;
 }
 
+FUNCTION u64 win32_read_file_range(String8 full_path, u64 offset, void *dest, u64 size)
+{
+    HANDLE file_handle = CreateFile((char*)full_path.data, GENERIC_READ, FILE_SHARE_READ, 0, 
+                                    OPEN_EXISTING, 0, 0);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        win32_print_to_debug_output(S8LIT("OS Error: read_file_range() INVALID_HANDLE_VALUE!\n"));
+        return 0;
+    }
+    
+    u64 result = 0;
+    
+    LARGE_INTEGER distance;
+    distance.QuadPart = (LONGLONG)offset;
+    if (SetFilePointerEx(file_handle, distance, 0, FILE_BEGIN)) {
+        while (result < size) {
+            DWORD to_read    = (DWORD)MIN(size - result, (u64)U32_MAX);
+            DWORD bytes_read = 0;
+            if (!ReadFile(file_handle, (u8 *)dest + result, to_read, &bytes_read, 0) || (bytes_read == 0))
+                break;
+            result += bytes_read;
+        }
+    } else {
+        win32_print_to_debug_output(S8LIT("OS Error: read_file_range() SetFilePointerEx() failed!\n"));
+    }
+    
+    CloseHandle(file_handle);
+    
+    return result;
+}
+
+FUNCTION String8 win32_map_file(String8 full_path)
+{
+    String8 result = {};
+    
+    HANDLE file_handle = CreateFile((char*)full_path.data, GENERIC_READ, FILE_SHARE_READ, 0, 
+                                    OPEN_EXISTING, 0, 0);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        // Not an error, callers check whether files they might have written are there.
+        return result;
+    }
+    
+    LARGE_INTEGER file_size64;
+    if (GetFileSizeEx(file_handle, &file_size64) && file_size64.QuadPart) {
+        HANDLE mapping = CreateFileMapping(file_handle, 0, PAGE_WRITECOPY, 0, 0, 0);
+        if (mapping) {
+            result.data = (u8 *) MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+            if (result.data) result.count = (u64)file_size64.QuadPart;
+            else             win32_print_to_debug_output(S8LIT("OS Error: map_file() MapViewOfFile() failed!\n"));
+            
+            // The view keeps the mapping alive.
+            CloseHandle(mapping);
+        } else {
+            win32_print_to_debug_output(S8LIT("OS Error: map_file() CreateFileMapping() failed!\n"));
+        }
+    }
+    
+    CloseHandle(file_handle);
+    
+    return result;
+}
+
+FUNCTION void win32_unmap_file(void *memory)
+{
+    if (memory) {
+        UnmapViewOfFile(memory);
+    }
+}
+
 FUNCTION b32 win32_write_entire_file(String8 full_path, String8 data)
 {
     b32 result = FALSE;
@@ -344,6 +412,34 @@ FUNCTION b32 win32_write_entire_file(String8 full_path, String8 data)
     return result;
 }
 
+FUNCTION b32 win32_write_file_range(String8 full_path, u64 offset, String8 data)
+{
+    HANDLE file_handle = CreateFile((char*)full_path.data, GENERIC_WRITE, 0, 0, OPEN_EXISTING, 0, 0);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        win32_print_to_debug_output(S8LIT("OS Error: write_file_range() INVALID_HANDLE_VALUE!\n"));
+        return FALSE;
+    }
+    
+    b32 result = FALSE;
+    
+    LARGE_INTEGER distance;
+    distance.QuadPart = (LONGLONG)offset;
+    if (SetFilePointerEx(file_handle, distance, 0, FILE_BEGIN)) {
+        DWORD bytes_written;
+        if (WriteFile(file_handle, data.data, (DWORD)data.count, &bytes_written, 0) && (bytes_written == data.count)) {
+            result = TRUE;
+        } else {
+            win32_print_to_debug_output(S8LIT("OS Error: write_file_range() WriteFile() failed!\n"));
+        }
+    } else {
+        win32_print_to_debug_output(S8LIT("OS Error: write_file_range() SetFilePointerEx() failed!\n"));
+    }
+    
+    CloseHandle(file_handle);
+    
+    return result;
+}
+
 FUNCTION File_Group win32_get_all_files_in_path(Arena *arena, String8 path_wildcard)
 {
     File_Group result = {};
@@ -956,7 +1052,11 @@ FUNCTION void win32_os_state_init(HWND window)
     _win32.state.commit                = win32_commit;
     _win32.state.decommit              = win32_decommit;
     _win32.state.read_entire_file      = win32_read_entire_file;
+    _win32.state.read_file_range       = win32_read_file_range;
     _win32.state.write_entire_file     = win32_write_entire_file;
+    _win32.state.write_file_range      = win32_write_file_range;
+    _win32.state.map_file              = win32_map_file;
+    _win32.state.unmap_file            = win32_unmap_file;
     _win32.state.free_file_memory      = win32_free_file_memory;
     _win32.state.get_all_files_in_path = win32_get_all_files_in_path;
 #ifdef INCLUDE_WASAPI
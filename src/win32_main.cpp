@@ -20,6 +20,7 @@
 #include "orh.h"
 #include "orh_d3d11.cpp"
 #include "orh_collision.cpp"
+#include "orh_jobs.cpp"
 
 #include "game.h"
 #include "game.cpp"
@@ -30,6 +31,7 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE prev_instance,
     HWND window = win32_create_window(1600, 900, "APP", instance);
     
     win32_os_state_init(window);
+    jobs_init();
     d3d11_init(window);
     
 #if DEVELOPER